@@ -0,0 +1,107 @@
+// Completion handles for work running on the native thread pool.
+//
+// A task owns a self-pipe. When the work finishes (successfully or
+// not) a byte is written to it, so an event loop can watch `fileno()`
+// instead of blocking a thread on the result.
+
+#ifndef RPS_EXTRAS_ASYNC_HPP
+#define RPS_EXTRAS_ASYNC_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/noncopyable.hpp>
+
+class AsyncTask : private boost::noncopyable
+{
+public:
+    AsyncTask() : cancelled_(false), done_(false)
+        {
+            if (pipe(fds_) != 0)
+                throw std::runtime_error(std::string("pipe: ") + std::strerror(errno));
+            for (int i = 0; i < 2; ++i) {
+                fcntl(fds_[i], F_SETFD, FD_CLOEXEC);
+                fcntl(fds_[i], F_SETFL, O_NONBLOCK);
+            }
+        }
+
+    virtual ~AsyncTask()
+        {
+            close(fds_[0]);
+            close(fds_[1]);
+        }
+
+    /* The read end of the self-pipe; readable once the task is done. */
+    int fileno() const { return fds_[0]; }
+
+    bool done() const { return done_.load(std::memory_order_acquire); }
+
+    /* Asks the running work to stop. Matches notice this before their
+     * next round. */
+    void cancel() { cancelled_ = true; }
+    bool cancelled() const { return cancelled_; }
+
+    /* The flag handed to the work to poll for cancellation. */
+    std::atomic<bool>& stopFlag() { return cancelled_; }
+
+    /* Called by the work when it has finished. */
+    void finish()
+        {
+            done_.store(true, std::memory_order_release);
+            char byte = 1;
+            while (write(fds_[1], &byte, 1) < 0 && errno == EINTR)
+                ;
+        }
+
+    /* Called by the work when it has failed. */
+    void fail(std::exception_ptr error)
+        {
+            error_ = error;
+            finish();
+        }
+
+    /* Rethrows the failure, if any. Throws if the task is still running. */
+    void check() const
+        {
+            if (!done())
+                throw std::runtime_error("task has not finished");
+            if (error_)
+                std::rethrow_exception(error_);
+        }
+
+private:
+    int fds_[2];
+    std::atomic<bool> cancelled_;
+    std::atomic<bool> done_;
+    std::exception_ptr error_;
+};
+
+/* A task producing a value of type R. */
+template <typename R>
+class AsyncResult : public AsyncTask
+{
+public:
+    void set(const R& value)
+        {
+            value_ = value;
+            finish();
+        }
+
+    const R& get() const
+        {
+            check();
+            return value_;
+        }
+
+private:
+    R value_;
+};
+
+#endif
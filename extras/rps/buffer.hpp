@@ -0,0 +1,187 @@
+// Zero-copy array views for handing native memory to Python.
+//
+// `arrayView` wraps a block of native memory in a memoryview which
+// keeps the owning Python object alive. numpy.asarray() accepts these
+// views directly, so results can be read as NumPy arrays without a copy
+// and without the module having to link against NumPy.
+
+#ifndef RPS_EXTRAS_BUFFER_HPP
+#define RPS_EXTRAS_BUFFER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/python.hpp>
+
+namespace bp=boost::python;
+
+/* The buffer-protocol format character for an element type. */
+template <typename T> struct BufferFormat;
+template <> struct BufferFormat<std::int8_t>   { static const char* get() { return "b"; } };
+template <> struct BufferFormat<std::uint8_t>  { static const char* get() { return "B"; } };
+template <> struct BufferFormat<std::int16_t>  { static const char* get() { return "h"; } };
+template <> struct BufferFormat<std::int32_t>  { static const char* get() { return "i"; } };
+template <> struct BufferFormat<std::uint32_t> { static const char* get() { return "I"; } };
+template <> struct BufferFormat<std::int64_t>  { static const char* get() { return "q"; } };
+template <> struct BufferFormat<std::uint64_t> { static const char* get() { return "Q"; } };
+template <> struct BufferFormat<float>         { static const char* get() { return "f"; } };
+template <> struct BufferFormat<double>        { static const char* get() { return "d"; } };
+
+/* The Python object exporting a native block through the buffer
+ * protocol. It holds a reference to `owner`, which must keep `data`
+ * alive.
+ */
+struct ArrayViewObject
+{
+    PyObject_HEAD
+    PyObject* owner;
+    void* data;
+    const char* format;
+    Py_ssize_t itemsize;
+    int ndim;
+    int readonly;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+};
+
+inline int arrayViewGetBuffer(PyObject* self, Py_buffer* view, int flags)
+{
+    ArrayViewObject* av = reinterpret_cast<ArrayViewObject*>(self);
+    if ((flags & PyBUF_WRITABLE) && av->readonly) {
+        PyErr_SetString(PyExc_BufferError, "array view is read-only");
+        return -1;
+    }
+
+    view->buf = av->data;
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = av->itemsize;
+    for (int d = 0; d < av->ndim; ++d)
+        view->len *= av->shape[d];
+    view->readonly = av->readonly;
+    view->itemsize = av->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(av->format) : 0;
+    view->ndim = av->ndim;
+    view->shape = (flags & PyBUF_ND) ? av->shape : 0;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? av->strides : 0;
+    view->suboffsets = 0;
+    view->internal = 0;
+    return 0;
+}
+
+inline void arrayViewDealloc(PyObject* self)
+{
+    Py_XDECREF(reinterpret_cast<ArrayViewObject*>(self)->owner);
+    Py_TYPE(self)->tp_free(self);
+}
+
+inline PyTypeObject* arrayViewType()
+{
+    static PyBufferProcs buffer_procs;
+    static PyTypeObject type;
+    static bool initialized = false;
+    if (!initialized) {
+        buffer_procs.bf_getbuffer = &arrayViewGetBuffer;
+
+        type.tp_name = "rps.ArrayView";
+        type.tp_basicsize = sizeof(ArrayViewObject);
+        type.tp_flags = Py_TPFLAGS_DEFAULT;
+        type.tp_dealloc = &arrayViewDealloc;
+        type.tp_as_buffer = &buffer_procs;
+        type.tp_new = 0;
+        if (PyType_Ready(&type) < 0)
+            bp::throw_error_already_set();
+
+        initialized = true;
+    }
+    return &type;
+}
+
+/* Returns a memoryview over `rows` x `cols` elements of type T starting
+ * at `data`. A negative `cols` produces a one-dimensional view.
+ */
+template <typename T>
+bp::object arrayView(bp::object owner,
+                     T* data,
+                     Py_ssize_t rows,
+                     Py_ssize_t cols=-1,
+                     bool readonly=false)
+{
+    ArrayViewObject* av = PyObject_New(ArrayViewObject, arrayViewType());
+    if (!av)
+        bp::throw_error_already_set();
+
+    Py_INCREF(owner.ptr());
+    av->owner = owner.ptr();
+    av->data = data;
+    av->format = BufferFormat<T>::get();
+    av->itemsize = sizeof(T);
+    av->readonly = readonly ? 1 : 0;
+    av->shape[0] = rows;
+    if (cols < 0) {
+        av->ndim = 1;
+        av->shape[1] = 0;
+        av->strides[0] = sizeof(T);
+        av->strides[1] = 0;
+    } else {
+        av->ndim = 2;
+        av->shape[1] = cols;
+        av->strides[0] = cols * sizeof(T);
+        av->strides[1] = sizeof(T);
+    }
+
+    bp::object exporter((bp::handle<>(reinterpret_cast<PyObject*>(av))));
+    return bp::object(bp::handle<>(PyMemoryView_FromObject(exporter.ptr())));
+}
+
+template <typename T>
+void destroyOwnedVector(PyObject* capsule)
+{
+    delete static_cast<std::vector<T>*>(PyCapsule_GetPointer(capsule, 0));
+}
+
+/* Like `arrayView`, but the view takes ownership of `data`. */
+template <typename T>
+bp::object ownedArrayView(std::vector<T>& data,
+                          Py_ssize_t rows,
+                          Py_ssize_t cols=-1)
+{
+    std::unique_ptr<std::vector<T> > owned(new std::vector<T>());
+    owned->swap(data);
+    T* items = owned->empty() ? 0 : &(*owned)[0];
+    PyObject* capsule = PyCapsule_New(owned.get(), 0, &destroyOwnedVector<T>);
+    if (!capsule)
+        bp::throw_error_already_set();
+    owned.release();  // The capsule deletes it from now on.
+    return arrayView(bp::object(bp::handle<>(capsule)), items, rows, cols);
+}
+
+/* Read access to a C-contiguous buffer-protocol object (bytes,
+ * bytearray, array.array, a NumPy array, ...) whose items are T. */
+template <typename T>
+class InputBuffer : private boost::noncopyable
+{
+public:
+    InputBuffer(bp::object obj)
+        {
+            if (PyObject_GetBuffer(obj.ptr(), &view_, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+                bp::throw_error_already_set();
+            if (view_.itemsize != sizeof(T)) {
+                PyBuffer_Release(&view_);
+                throw std::invalid_argument("buffer has the wrong item size");
+            }
+        }
+
+    ~InputBuffer() { PyBuffer_Release(&view_); }
+
+    const T* data() const { return static_cast<const T*>(view_.buf); }
+    std::size_t size() const { return view_.len / sizeof(T); }
+
+private:
+    Py_buffer view_;
+};
+
+#endif
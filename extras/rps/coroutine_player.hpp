@@ -0,0 +1,352 @@
+// Stateful strategies written as C++20 coroutines.
+//
+// A strategy is a coroutine which `co_yield`s its moves and
+// `co_await`s the opponent's reply, keeping whatever state it needs in
+// local variables:
+//
+//     Strategy beatLast(MatchArena&) {
+//         Move m = randomMove();
+//         for (;;) {
+//             co_yield m;
+//             m = beats(co_await reply);
+//         }
+//     }
+//
+// Coroutine frames are placed in a MatchArena supplied as the first
+// argument, so starting a match is a bump allocation and playing a
+// round allocates nothing at all.
+
+#ifndef RPS_EXTRAS_COROUTINE_PLAYER_HPP
+#define RPS_EXTRAS_COROUTINE_PLAYER_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "rps.hpp"
+
+/* A fixed-size bump allocator holding the coroutine frames of one
+ * match. Everything in it is released at once by `reset()`. */
+class MatchArena : private boost::noncopyable
+{
+public:
+    static const std::size_t CAPACITY = 2048;
+
+    MatchArena() : used_(0) {}
+
+    void* allocate(std::size_t size)
+        {
+            const std::size_t align = alignof(std::max_align_t);
+            std::size_t offset = (used_ + align - 1) & ~(align - 1);
+            if (offset + size > CAPACITY)
+                throw std::bad_alloc();
+            used_ = offset + size;
+            return storage_ + offset;
+        }
+
+    void reset() { used_ = 0; }
+
+    std::size_t used() const { return used_; }
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[CAPACITY];
+    std::size_t used_;
+};
+
+/* Awaited by a strategy to get the opponent's move in the round it has
+ * just yielded a move for. */
+struct OpponentReply {};
+inline constexpr OpponentReply reply{};
+
+/* The coroutine type of a strategy. */
+class Strategy : private boost::noncopyable
+{
+public:
+    struct promise_type
+    {
+        Move move = Rock;
+        Move reply = Rock;
+        std::exception_ptr error;
+
+        template <typename... Args>
+        static void* operator new(std::size_t size, MatchArena& arena, Args&&...)
+            {
+                return arena.allocate(size);
+            }
+
+        // Frames are released with their arena.
+        static void operator delete(void*, std::size_t) {}
+
+        Strategy get_return_object()
+            {
+                return Strategy(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+        std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+        std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+
+        std::suspend_always yield_value(Move m)
+            {
+                move = m;
+                return std::suspend_always();
+            }
+
+        struct ReplyAwaiter
+        {
+            Move reply;
+            bool await_ready() const noexcept { return true; }
+            void await_suspend(std::coroutine_handle<>) const noexcept {}
+            Move await_resume() const noexcept { return reply; }
+        };
+
+        ReplyAwaiter await_transform(OpponentReply) { return ReplyAwaiter{reply}; }
+
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    Strategy() : handle_() {}
+    Strategy(Strategy&& other) : handle_(std::exchange(other.handle_, Handle())) {}
+
+    Strategy& operator=(Strategy&& other)
+        {
+            if (this != &other) {
+                destroy();
+                handle_ = std::exchange(other.handle_, Handle());
+            }
+            return *this;
+        }
+
+    ~Strategy() { destroy(); }
+
+    /* Runs the strategy up to its next move. */
+    Move next()
+        {
+            if (!handle_ || handle_.done())
+                throw std::logic_error("strategy is not running");
+            handle_.resume();
+            if (handle_.promise().error)
+                std::rethrow_exception(handle_.promise().error);
+            if (handle_.done())
+                throw std::runtime_error("strategy ended before the match did");
+            return handle_.promise().move;
+        }
+
+    /* Tells the strategy what its opponent played in the current round. */
+    void tell(Move opponent) { handle_.promise().reply = opponent; }
+
+    /* Whether the strategy can still move: it has started and has
+     * neither ended nor failed. */
+    bool valid() const { return handle_ && !handle_.done(); }
+
+    void destroy()
+        {
+            if (handle_) {
+                handle_.destroy();
+                handle_ = Handle();
+            }
+        }
+
+private:
+    explicit Strategy(Handle h) : handle_(h) {}
+
+    Handle handle_;
+};
+
+typedef Strategy (*StrategyFn)(MatchArena&);
+
+/* Returns the move which beats `m`. */
+inline Move beats(Move m)
+{
+    return static_cast<Move>((m + 1) % 3);
+}
+
+/* Copies the opponent's previous move, like TitForTat. */
+inline Strategy titForTatStrategy(MatchArena&)
+{
+    Move m = randomMove();
+    for (;;) {
+        co_yield m;
+        m = co_await reply;
+    }
+}
+
+/* Keeps its move after a win and switches to the one that would have
+ * won otherwise. */
+inline Strategy winStayLoseShiftStrategy(MatchArena&)
+{
+    Move m = randomMove();
+    for (;;) {
+        co_yield m;
+        Move theirs = co_await reply;
+        if (score(m, theirs) != -1)
+            m = beats(theirs);
+    }
+}
+
+/* Plays Rock, Paper, Scissors, Rock, ... */
+inline Strategy cycleStrategy(MatchArena&)
+{
+    for (Move m = Rock; ; m = beats(m))
+        co_yield m;
+}
+
+/* Plays whatever beats the opponent's previous move. */
+inline Strategy beatLastStrategy(MatchArena&)
+{
+    Move m = randomMove();
+    for (;;) {
+        co_yield m;
+        m = beats(co_await reply);
+    }
+}
+
+/* Plays whatever beats the opponent's most frequent move so far. */
+inline Strategy beatFrequentStrategy(MatchArena&)
+{
+    std::size_t counts[3] = {0, 0, 0};
+    Move m = randomMove();
+    for (;;) {
+        co_yield m;
+        ++counts[co_await reply];
+        Move favourite = Rock;
+        for (int c = Paper; c <= Scissors; ++c)
+            if (counts[c] > counts[favourite])
+                favourite = static_cast<Move>(c);
+        m = beats(favourite);
+    }
+}
+
+/* The built-in coroutine strategies by name. */
+inline const std::map<std::string, StrategyFn>& strategies()
+{
+    static const std::map<std::string, StrategyFn> fns = {
+        {"tit_for_tat", &titForTatStrategy},
+        {"win_stay_lose_shift", &winStayLoseShiftStrategy},
+        {"cycle", &cycleStrategy},
+        {"beat_last", &beatLastStrategy},
+        {"beat_frequent", &beatFrequentStrategy},
+    };
+    return fns;
+}
+
+inline StrategyFn findStrategy(const std::string& name)
+{
+    std::map<std::string, StrategyFn>::const_iterator it = strategies().find(name);
+    if (it == strategies().end())
+        throw std::invalid_argument("unknown strategy: " + name);
+    return it->second;
+}
+
+/* One seat's running strategy: its coroutine and the arena its frame
+ * lives in. */
+class StrategyRun : public PlayerState, private boost::noncopyable
+{
+public:
+    void start(StrategyFn fn)
+        {
+            strategy_.destroy();
+            arena_.reset();
+            strategy_ = fn(arena_);
+        }
+
+    Strategy& strategy() { return strategy_; }
+
+private:
+    MatchArena arena_;
+    Strategy strategy_;
+};
+
+/* Plays two coroutine strategies against each other. This needs no
+   history at all: each strategy is simply told its opponent's move.
+   Returns a sequence of scores as `play` does.
+*/
+inline std::vector<int> playStrategies(StrategyFn s1,
+                                       StrategyFn s2,
+                                       std::vector<int>::size_type num_rounds)
+{
+    StrategyRun run1, run2;
+    run1.start(s1);
+    run2.start(s2);
+
+    std::vector<int> scores;
+    scores.reserve(num_rounds);
+    for (std::vector<int>::size_type i = 0; i < num_rounds; ++i) {
+        Move m1 = run1.strategy().next();
+        Move m2 = run2.strategy().next();
+        run1.strategy().tell(m2);
+        run2.strategy().tell(m1);
+        scores.push_back(score(m1, m2));
+    }
+    return scores;
+}
+
+/* A Player driven by a coroutine strategy.
+
+   The strategy is restarted whenever a match starts (i.e. the history
+   is empty) and from then on is only told the opponent's last move. A
+   seat with no running strategy mid-match, because its first move
+   was never asked for there or its strategy failed, starts one.
+   The running strategy is kept in the match's context, so one
+   instance may play itself or any number of matches at once.
+*/
+class CoroutinePlayer : public Player
+{
+public:
+    CoroutinePlayer(const std::string& name,
+                    const std::string& strategy) :
+        Player(name),
+        strategy_name_(strategy),
+        fn_(findStrategy(strategy))
+        {}
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            assert(my_pos == 0 || my_pos == 1);
+
+            return runs_.apply(*this, 0, my_pos, [&](StrategyRun& run) {
+                    if (history.empty())
+                        return step(run, 0);
+                    const Round& r = *history.rbegin();
+                    return step(run, 1, (my_pos == 0) ? r.p2 : r.p1);
+                });
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            return runs_.apply(*this, view.stateSlot(), view.position(), [&](StrategyRun& run) {
+                    if (view.empty())
+                        return step(run, 0);
+                    return step(run, 1, static_cast<Move>(view.theirs()[view.size() - 1]));
+                });
+        }
+
+    std::string strategy() const { return strategy_name_; }
+
+private:
+    Move step(StrategyRun& run, bool started, Move theirs=Rock) const
+        {
+            if (started && run.strategy().valid())
+                run.strategy().tell(theirs);
+            else
+                run.start(fn_);
+            return run.strategy().next();
+        }
+
+    std::string strategy_name_;
+    StrategyFn fn_;
+    SeatStates<StrategyRun> runs_;
+};
+
+#endif
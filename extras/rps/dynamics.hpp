@@ -0,0 +1,290 @@
+// Population dynamics over a game between strategies.
+//
+// The game is a MatrixGame whose moves are the strategies, with A[i][j]
+// the payoff of strategy i against j; strategyGame builds one from
+// memory-one strategies with the exact per-round net scores. Two
+// models run on it:
+//
+//  - Replicator follows the replicator-mutator equation on strategy
+//    frequencies, integrated with fourth-order Runge-Kutta.
+//  - AgentPopulation keeps one byte per agent, the agent's strategy,
+//    and updates all of them synchronously by pairwise comparison:
+//    each agent meets a random opponent, looks at a random model
+//    agent's game against a random opponent of its own, and imitates
+//    the model with a probability rising with the payoff difference.
+//
+// Both advance in chunks and report the trajectory of each chunk.
+
+#ifndef RPS_EXTRAS_DYNAMICS_HPP
+#define RPS_EXTRAS_DYNAMICS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "equilibrium.hpp"
+#include "game.hpp"
+#include "markov.hpp"
+#include "memory_one.hpp"
+#include "rng.hpp"
+#include "simd.hpp"
+#include "strategy_space.hpp"
+#include "thread_pool.hpp"
+
+/* The game between `strategies` in which the payoff of i against j is
+ * i's expected net score per round over `num_rounds` rounds. */
+inline MatrixGame strategyGame(const std::vector<MemoryOne>& strategies,
+                               std::size_t num_rounds,
+                               ThreadPool& pool)
+{
+    const std::size_t n = strategies.size();
+    if (n == 0)
+        throw std::invalid_argument("a game needs at least one strategy");
+    std::vector<Automaton> automata;
+    for (std::size_t i = 0; i < n; ++i) {
+        automata.push_back(Automaton::fromMemoryOne(strategies[i]));
+        automata.back().check();
+    }
+
+    std::vector<double> payoff(n * n);
+    const double scale = 1.0 / std::max<std::size_t>(num_rounds, 1);
+    parallelFor(pool, n, [&](std::size_t i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                if (strategies[i].deterministic() && strategies[j].deterministic()) {
+                    std::size_t w1, w2;
+                    detail::deterministicMatch(strategies[i], strategies[j], num_rounds, w1, w2);
+                    payoff[i * n + j] = (double(w1) - double(w2)) * scale;
+                } else {
+                    Expectation e = ProductChain(automata[i], automata[j]).expected(num_rounds);
+                    payoff[i * n + j] = (e.p1_wins - e.p2_wins) * scale;
+                }
+            }
+        });
+    return MatrixGame(payoff, n);
+}
+
+/* Replicator-mutator dynamics,
+
+       dx_i/dt = x_i ((A x)_i - x.A x) + mutation (1/n - x_i),
+
+   i.e. replication plus a uniform mutation flow, which keeps the
+   frequencies on the simplex whatever the signs of the payoffs.
+*/
+class Replicator
+{
+public:
+    Replicator(const MatrixGame& game, double mutation) :
+        a_(game),
+        mutation_(mutation),
+        time_(0),
+        x_(a_.size(), 1.0 / a_.size())
+        {
+            if (mutation < 0)
+                throw std::invalid_argument("mutation must be non-negative");
+        }
+
+    std::size_t size() const { return a_.size(); }
+    double time() const { return time_; }
+    const std::vector<double>& frequencies() const { return x_; }
+
+    void setFrequencies(const std::vector<double>& x)
+        {
+            if (x.size() != size())
+                throw std::invalid_argument("one frequency per strategy");
+            for (std::size_t i = 0; i < x.size(); ++i)
+                if (!(x[i] >= 0))
+                    throw std::invalid_argument("frequencies must be non-negative");
+            x_ = x;
+            normalize(x_);
+        }
+
+    /* Takes `steps` steps of `dt`, appending the frequencies after
+     * every `record_every`-th step to `trajectory`. */
+    void advance(std::size_t steps,
+                 double dt,
+                 std::size_t record_every,
+                 std::vector<double>& trajectory,
+                 ThreadPool& pool)
+        {
+            const std::size_t n = size();
+            std::vector<double> k1(n), k2(n), k3(n), k4(n), y(n);
+            for (std::size_t s = 1; s <= steps; ++s) {
+                derivative(x_, k1, pool);
+                for (std::size_t i = 0; i < n; ++i)
+                    y[i] = x_[i] + 0.5 * dt * k1[i];
+                derivative(y, k2, pool);
+                for (std::size_t i = 0; i < n; ++i)
+                    y[i] = x_[i] + 0.5 * dt * k2[i];
+                derivative(y, k3, pool);
+                for (std::size_t i = 0; i < n; ++i)
+                    y[i] = x_[i] + dt * k3[i];
+                derivative(y, k4, pool);
+                for (std::size_t i = 0; i < n; ++i)
+                    x_[i] = std::max(0.0, x_[i] + dt / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]));
+                normalize(x_);
+                time_ += dt;
+
+                if (record_every && s % record_every == 0)
+                    trajectory.insert(trajectory.end(), x_.begin(), x_.end());
+            }
+        }
+
+private:
+    void derivative(const std::vector<double>& x, std::vector<double>& dx, ThreadPool& pool) const
+        {
+            const std::size_t n = size();
+            a_.rowPayoffs(&x[0], &dx[0], pool);
+            double mean = dot(&x[0], &dx[0], n);
+            for (std::size_t i = 0; i < n; ++i)
+                dx[i] = x[i] * (dx[i] - mean) + mutation_ * (1.0 / n - x[i]);
+        }
+
+    PayoffMatrix a_;
+    double mutation_;
+    double time_;
+    std::vector<double> x_;
+};
+
+/* Agent-based pairwise comparison dynamics for up to 256 strategies.
+
+   In each generation every agent i, in parallel, meets a uniformly
+   random opponent j, and picks a model agent k, who meets an opponent
+   l of its own. With payoffs p_i = A[s_i][s_j] and p_k = A[s_k][s_l],
+   i adopts s_k with the Fermi probability 1 / (1 + exp(-selection
+   (p_k - p_i))); then, with probability `mutation`, it takes a
+   uniformly random strategy instead. Every agent draws from its own
+   counter-based stream, so a run is reproducible whatever the number
+   of threads.
+*/
+class AgentPopulation : private boost::noncopyable
+{
+public:
+    AgentPopulation(const MatrixGame& game,
+                    std::size_t num_agents,
+                    double selection,
+                    double mutation,
+                    std::uint64_t seed) :
+        n_(game.numMoves()),
+        payoff_(game.payoffMatrix()),
+        selection_(selection),
+        mutation_(mutation),
+        seed_(seed),
+        generation_(0),
+        agents_(num_agents),
+        next_(num_agents)
+        {
+            if (n_ > 256)
+                throw std::invalid_argument("agents hold at most 256 strategies");
+            if (num_agents < 2)
+                throw std::invalid_argument("a population needs at least two agents");
+            if (mutation < 0 || mutation > 1)
+                throw std::invalid_argument("mutation must be in [0, 1]");
+            for (std::size_t i = 0; i < num_agents; ++i)
+                agents_[i] = boundedValue(streamValue(seed_, i), n_);
+        }
+
+    std::size_t size() const { return agents_.size(); }
+    std::size_t numStrategies() const { return n_; }
+    std::size_t generation() const { return generation_; }
+
+    /* The strategy of each agent, one byte each. The array stays in
+     * place as the population advances. */
+    const unsigned char* agents() const { return &agents_[0]; }
+
+    /* Assigns agents to strategies in order: counts[0] agents to
+     * strategy 0, and so on. */
+    void setCounts(const std::vector<std::size_t>& counts)
+        {
+            if (counts.size() != n_)
+                throw std::invalid_argument("one count per strategy");
+            std::size_t total = 0;
+            for (std::size_t s = 0; s < n_; ++s)
+                total += counts[s];
+            if (total != size())
+                throw std::invalid_argument("counts must add up to the number of agents");
+            std::size_t i = 0;
+            for (std::size_t s = 0; s < n_; ++s)
+                for (std::size_t c = 0; c < counts[s]; ++c)
+                    agents_[i++] = s;
+        }
+
+    std::vector<std::int64_t> counts() const
+        {
+            std::vector<std::int64_t> rslt(n_, 0);
+            for (std::size_t i = 0; i < agents_.size(); ++i)
+                ++rslt[agents_[i]];
+            return rslt;
+        }
+
+    /* Runs `generations` generations, appending the strategy counts
+     * after each to `trajectory`. */
+    void advance(std::size_t generations,
+                 std::vector<std::int64_t>& trajectory,
+                 ThreadPool& pool)
+        {
+            const std::size_t num_blocks = (size() + BLOCK - 1) / BLOCK;
+            std::vector<std::int64_t> block_counts(num_blocks * n_);
+            for (std::size_t g = 0; g < generations; ++g) {
+                std::uint64_t stream = mix64(seed_ ^ mix64(generation_ + 1));
+                std::fill(block_counts.begin(), block_counts.end(), 0);
+                parallelFor(pool, num_blocks, [&](std::size_t b) {
+                        updateBlock(stream, b, &block_counts[b * n_]);
+                    });
+                std::copy(next_.begin(), next_.end(), agents_.begin());
+                ++generation_;
+
+                std::size_t start = trajectory.size();
+                trajectory.resize(start + n_, 0);
+                for (std::size_t b = 0; b < num_blocks; ++b)
+                    for (std::size_t s = 0; s < n_; ++s)
+                        trajectory[start + s] += block_counts[b * n_ + s];
+            }
+        }
+
+private:
+    static const std::size_t BLOCK = 4096;
+
+    // Reads the current generation from agents_ and writes the next
+    // into next_, so that agents within a generation do not see each
+    // other's updates.
+    void updateBlock(std::uint64_t stream, std::size_t b, std::int64_t* counts)
+        {
+            const std::size_t num_agents = size();
+            const std::size_t end = std::min(num_agents, (b + 1) * BLOCK);
+            const unsigned char* agents = &agents_[0];
+            const double* payoff = &payoff_[0];
+            const std::uint64_t mutation_threshold = mutation_ * 4294967296.0;
+            for (std::size_t i = b * BLOCK; i < end; ++i) {
+                std::uint64_t v1 = streamValue(stream, 3 * i);
+                std::uint64_t v2 = streamValue(stream, 3 * i + 1);
+                std::uint64_t v3 = streamValue(stream, 3 * i + 2);
+                unsigned si = agents[i];
+                unsigned sj = agents[boundedValue(v1, num_agents)];
+                unsigned sk = agents[boundedValue(v1 << 32, num_agents)];
+                unsigned sl = agents[boundedValue(v2, num_agents)];
+
+                double diff = payoff[sk * n_ + sl] - payoff[si * n_ + sj];
+                double adopt = 1.0 / (1.0 + std::exp(-selection_ * diff));
+                unsigned s = ((v2 & 0xffffffff) * (1.0 / 4294967296.0) < adopt) ? sk : si;
+                if ((v3 >> 32) < mutation_threshold)
+                    s = boundedValue(v3 << 32, n_);
+                next_[i] = s;
+                ++counts[s];
+            }
+        }
+
+    std::size_t n_;
+    std::vector<double> payoff_;
+    double selection_;
+    double mutation_;
+    std::uint64_t seed_;
+    std::size_t generation_;
+    std::vector<unsigned char> agents_, next_;
+};
+
+#endif
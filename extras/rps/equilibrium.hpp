@@ -0,0 +1,280 @@
+// Mixed-strategy equilibria of matrix games.
+//
+// The solvers treat a payoff matrix A as a zero-sum game in which the
+// row player receives A[i][j] and the column player pays it. For the
+// symmetric zero-sum games in game.hpp (rps, rpsls, ...) the row
+// strategy returned is then a Nash equilibrium strategy for either
+// seat.
+//
+// The iterative solvers spend their time in matrix-vector products,
+// which are vectorized (simd.hpp) and, for large games, split by rows
+// over the thread pool.
+
+#ifndef RPS_EXTRAS_EQUILIBRIUM_HPP
+#define RPS_EXTRAS_EQUILIBRIUM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+/* A dense square payoff matrix kept in both row-major and transposed
+ * form, so that products with A and with A^T are both contiguous dot
+ * products. */
+class PayoffMatrix
+{
+public:
+    explicit PayoffMatrix(const MatrixGame& game) :
+        n_(game.numMoves()),
+        a_(game.payoffMatrix()),
+        at_(n_ * n_)
+        {
+            for (std::size_t i = 0; i < n_; ++i)
+                for (std::size_t j = 0; j < n_; ++j)
+                    at_[j * n_ + i] = a_[i * n_ + j];
+        }
+
+    std::size_t size() const { return n_; }
+    const double* row(std::size_t i) const { return &a_[i * n_]; }
+    const double* column(std::size_t j) const { return &at_[j * n_]; }
+
+    /* out = A y: the row player's payoff for each move against y. */
+    void rowPayoffs(const double* y, double* out, ThreadPool& pool) const
+        {
+            multiply(a_, y, out, pool);
+        }
+
+    /* out = A^T x: what the column player pays for each move against x. */
+    void columnPayoffs(const double* x, double* out, ThreadPool& pool) const
+        {
+            multiply(at_, x, out, pool);
+        }
+
+private:
+    // Rows are handed out in blocks; small games are not worth the
+    // synchronization.
+    static const std::size_t BLOCK = 64;
+    static const std::size_t PARALLEL_THRESHOLD = 256;
+
+    void multiply(const std::vector<double>& m,
+                  const double* v,
+                  double* out,
+                  ThreadPool& pool) const
+        {
+            const std::size_t n = n_;
+            const double* data = &m[0];
+            if (n < PARALLEL_THRESHOLD) {
+                for (std::size_t i = 0; i < n; ++i)
+                    out[i] = dot(data + i * n, v, n);
+                return;
+            }
+
+            parallelFor(pool, (n + BLOCK - 1) / BLOCK, [=](std::size_t b) {
+                    std::size_t end = std::min(n, (b + 1) * BLOCK);
+                    for (std::size_t i = b * BLOCK; i < end; ++i)
+                        out[i] = dot(data + i * n, v, n);
+                });
+        }
+
+    std::size_t n_;
+    std::vector<double> a_, at_;
+};
+
+/* Scales `v` to sum to one, or makes it uniform if it sums to zero. */
+inline void normalize(std::vector<double>& v)
+{
+    double total = sum(&v[0], v.size());
+    if (total > 0) {
+        for (std::size_t i = 0; i < v.size(); ++i)
+            v[i] /= total;
+    } else {
+        std::fill(v.begin(), v.end(), 1.0 / v.size());
+    }
+}
+
+/* How much a player gains by deviating to a best response when the
+   opponent plays `x` and it would otherwise play `x` itself:
+   max_i (A x)_i - x^T A x. This is zero exactly when `x` is a
+   symmetric equilibrium.
+*/
+inline double exploitability(const MatrixGame& game, const std::vector<double>& x)
+{
+    const std::size_t n = game.numMoves();
+    if (x.size() != n)
+        throw std::invalid_argument("strategy has the wrong number of moves");
+
+    PayoffMatrix a(game);
+    std::vector<double> u(n);
+    a.rowPayoffs(&x[0], &u[0], defaultPool());
+    return *std::max_element(u.begin(), u.end()) - dot(&x[0], &u[0], n);
+}
+
+/* Regret matching+ self-play. Returns the row player's linearly
+   weighted average strategy, which converges to an equilibrium at a
+   rate of O(1/sqrt(iterations)) or better.
+*/
+inline std::vector<double> regretMatching(const MatrixGame& game,
+                                          std::size_t iterations,
+                                          ThreadPool& pool)
+{
+    const PayoffMatrix a(game);
+    const std::size_t n = a.size();
+    std::vector<double> x(n, 1.0 / n), y(n, 1.0 / n);
+    std::vector<double> rx(n, 0.0), ry(n, 0.0);
+    std::vector<double> ux(n), uy(n), avg(n, 0.0);
+
+    for (std::size_t t = 1; t <= iterations; ++t) {
+        a.rowPayoffs(&y[0], &ux[0], pool);
+        a.columnPayoffs(&x[0], &uy[0], pool);
+
+        double vx = dot(&x[0], &ux[0], n);
+        double vy = dot(&y[0], &uy[0], n);
+        for (std::size_t i = 0; i < n; ++i) {
+            rx[i] = std::max(rx[i] + ux[i] - vx, 0.0);
+            // The column player's payoffs are -uy.
+            ry[i] = std::max(ry[i] - uy[i] + vy, 0.0);
+        }
+
+        axpy(double(t), &x[0], &avg[0], n);
+
+        x = rx;
+        normalize(x);
+        y = ry;
+        normalize(y);
+    }
+
+    normalize(avg);
+    return avg;
+}
+
+/* Fictitious play: each player best-responds to the other's empirical
+   mixture. The running payoff sums are updated with one row or column
+   of A per iteration, so each iteration costs O(n).
+*/
+inline std::vector<double> fictitiousPlay(const MatrixGame& game,
+                                          std::size_t iterations)
+{
+    const PayoffMatrix a(game);
+    const std::size_t n = a.size();
+    std::vector<double> counts(n, 0.0);
+    std::vector<double> row_sums(n, 0.0), col_sums(n, 0.0);
+    std::size_t i = 0, j = 0;
+
+    for (std::size_t t = 0; t < iterations; ++t) {
+        counts[i] += 1;
+        axpy(1.0, a.column(j), &row_sums[0], n);
+        axpy(1.0, a.row(i), &col_sums[0], n);
+
+        i = std::max_element(row_sums.begin(), row_sums.end()) - row_sums.begin();
+        j = std::min_element(col_sums.begin(), col_sums.end()) - col_sums.begin();
+    }
+
+    normalize(counts);
+    return counts;
+}
+
+/* Solves the game exactly with the simplex method. Only sensible for
+   small games; the tableau is O(n^2) and pivoting O(n^3).
+
+   The payoffs are shifted to be positive, and the column player's
+   problem "maximize sum(y) subject to A y <= 1, y >= 0" is solved. The
+   row strategy is read off the final objective row (the dual values).
+*/
+inline std::vector<double> linearProgram(const MatrixGame& game)
+{
+    const std::size_t MAX_MOVES = 500;
+    const double EPS = 1e-12;
+
+    const std::size_t n = game.numMoves();
+    if (n > MAX_MOVES)
+        throw std::invalid_argument("game is too large for the LP solver");
+
+    const std::vector<double>& payoff = game.payoffMatrix();
+    double shift = 1.0 - *std::min_element(payoff.begin(), payoff.end());
+
+    // Rows 0..n-1 are constraints, row n the objective. Columns 0..n-1
+    // are y, n..2n-1 the slacks and 2n the right-hand side.
+    const std::size_t cols = 2 * n + 1;
+    std::vector<double> tab((n + 1) * cols, 0.0);
+    std::vector<std::size_t> basis(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j)
+            tab[i * cols + j] = payoff[i * n + j] + shift;
+        tab[i * cols + n + i] = 1;
+        tab[i * cols + 2 * n] = 1;
+        basis[i] = n + i;
+    }
+    for (std::size_t j = 0; j < n; ++j)
+        tab[n * cols + j] = -1;
+
+    for (;;) {
+        // Bland's rule: lowest entering and leaving indices, so the
+        // method cannot cycle.
+        std::size_t enter = cols;
+        for (std::size_t j = 0; j < 2 * n; ++j)
+            if (tab[n * cols + j] < -EPS) {
+                enter = j;
+                break;
+            }
+        if (enter == cols)
+            break;
+
+        std::size_t leave = n;
+        double best = std::numeric_limits<double>::infinity();
+        for (std::size_t i = 0; i < n; ++i) {
+            double coef = tab[i * cols + enter];
+            if (coef > EPS) {
+                double ratio = tab[i * cols + 2 * n] / coef;
+                if (ratio < best - EPS ||
+                    (ratio < best + EPS && leave < n && basis[i] < basis[leave])) {
+                    best = ratio;
+                    leave = i;
+                }
+            }
+        }
+        if (leave == n)
+            throw std::runtime_error("LP is unbounded");
+
+        double* pivot_row = &tab[leave * cols];
+        double pivot = pivot_row[enter];
+        for (std::size_t j = 0; j < cols; ++j)
+            pivot_row[j] /= pivot;
+        for (std::size_t i = 0; i <= n; ++i) {
+            if (i == leave)
+                continue;
+            double factor = tab[i * cols + enter];
+            if (factor != 0)
+                axpy(-factor, pivot_row, &tab[i * cols], cols);
+        }
+        basis[leave] = enter;
+    }
+
+    std::vector<double> x(n);
+    for (std::size_t i = 0; i < n; ++i)
+        x[i] = std::max(tab[n * cols + n + i], 0.0);
+    normalize(x);
+    return x;
+}
+
+/* Runs the named solver: "regret_matching", "fictitious_play" or "lp". */
+inline std::vector<double> solveEquilibrium(const MatrixGame& game,
+                                            const std::string& method,
+                                            std::size_t iterations)
+{
+    if (method == "regret_matching")
+        return regretMatching(game, iterations, defaultPool());
+    if (method == "fictitious_play")
+        return fictitiousPlay(game, iterations);
+    if (method == "lp")
+        return linearProgram(game);
+    throw std::invalid_argument("unknown solver: " + method);
+}
+
+#endif
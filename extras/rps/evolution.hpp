@@ -0,0 +1,220 @@
+// Evolving memory-one strategies with a genetic algorithm.
+//
+// A genome is a deterministic MemoryOne: ten genes, each a move. Its
+// fitness is its mean net score per round against a fixed set of
+// opponents, computed exactly (by cycle detection against
+// deterministic opponents, on the Markov chain against the others), so
+// it depends on the genome alone and is cached by genome code. Genomes
+// are evaluated in parallel; selection, crossover and mutation draw
+// from counter-based streams keyed by generation and child, so a run
+// is reproducible from its seed whatever the number of threads.
+
+#ifndef RPS_EXTRAS_EVOLUTION_HPP
+#define RPS_EXTRAS_EVOLUTION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "markov.hpp"
+#include "memory_one.hpp"
+#include "rng.hpp"
+#include "strategy_space.hpp"
+#include "thread_pool.hpp"
+
+struct EvolutionConfig
+{
+    EvolutionConfig() :
+        population_size(100),
+        elite(2),
+        tournament_size(3),
+        crossover_rate(0.7),
+        mutation_rate(0.05),
+        num_rounds(100),
+        seed(0)
+        {}
+
+    std::size_t population_size;
+    std::size_t elite;            // Best genomes copied unchanged
+    std::size_t tournament_size;  // Genomes compared per parent selection
+    double crossover_rate;        // Chance a child mixes two parents
+    double mutation_rate;         // Chance per gene of a new move
+    std::size_t num_rounds;
+    std::uint64_t seed;
+};
+
+/* A population and its fitness, best first. */
+struct Generation
+{
+    std::size_t index;
+    std::vector<MemoryOne> population;
+    std::vector<double> fitness;
+    std::size_t evaluated;        // Genomes whose fitness was computed
+    std::size_t cache_hits;       // Genomes whose fitness was known
+};
+
+class Evolution : private boost::noncopyable
+{
+public:
+    Evolution(const std::vector<MemoryOne>& opponents, const EvolutionConfig& config) :
+        opponents_(opponents),
+        config_(config),
+        generation_(0),
+        cache_(MemoryOne::NUM_DETERMINISTIC, std::numeric_limits<double>::quiet_NaN()),
+        cached_(0)
+        {
+            if (opponents_.empty())
+                throw std::invalid_argument("evolution needs opponents");
+            if (config_.population_size < 2 || config_.elite > config_.population_size ||
+                config_.tournament_size == 0)
+                throw std::invalid_argument("invalid evolution settings");
+            BOOST_FOREACH(const MemoryOne& o, opponents_) {
+                Automaton a = Automaton::fromMemoryOne(o);
+                a.check();
+                chains_.push_back(a);
+            }
+
+            population_.resize(config_.population_size);
+            for (std::size_t i = 0; i < population_.size(); ++i)
+                population_[i] = MemoryOne::fromCode(
+                    boundedValue(streamValue(config_.seed, i), MemoryOne::NUM_DETERMINISTIC));
+        }
+
+    std::size_t generation() const { return generation_; }
+    std::size_t cacheSize() const { return cached_; }
+
+    /* Evaluates the current population, then breeds the next one from
+       it. Returns the evaluated population, sorted best first.
+
+       The elite pass unchanged; every other child takes a parent by
+       tournament selection and, with the crossover rate, mixes in a
+       second one gene by gene, before each gene mutates with the
+       mutation rate.
+    */
+    Generation step(ThreadPool& pool)
+        {
+            Generation g;
+            g.index = generation_;
+            evaluate(pool, g);
+
+            std::vector<std::size_t> order(population_.size());
+            for (std::size_t i = 0; i < order.size(); ++i)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+                    return g.fitness[a] > g.fitness[b];
+                });
+            g.population.resize(order.size());
+            std::vector<double> fitness(order.size());
+            for (std::size_t i = 0; i < order.size(); ++i) {
+                g.population[i] = population_[order[i]];
+                fitness[i] = g.fitness[order[i]];
+            }
+            g.fitness.swap(fitness);
+
+            std::vector<MemoryOne> next(g.population.begin(), g.population.begin() + config_.elite);
+            for (std::size_t c = config_.elite; c < population_.size(); ++c)
+                next.push_back(breed(g, c));
+            population_.swap(next);
+            ++generation_;
+            return g;
+        }
+
+    /* The fitness of one genome, computed without the cache. Any
+     * MemoryOne may be given; one with random entries is evaluated on
+     * the Markov chain against every opponent. */
+    double fitness(const MemoryOne& genome) const
+        {
+            Automaton chain = Automaton::fromMemoryOne(genome);
+            chain.check();
+            double total = 0;
+            for (std::size_t o = 0; o < opponents_.size(); ++o) {
+                if (genome.deterministic() && opponents_[o].deterministic()) {
+                    std::size_t w1, w2;
+                    detail::deterministicMatch(genome, opponents_[o], config_.num_rounds, w1, w2);
+                    total += double(w1) - double(w2);
+                } else {
+                    Expectation e = ProductChain(chain, chains_[o]).expected(config_.num_rounds);
+                    total += e.p1_wins - e.p2_wins;
+                }
+            }
+            return total / (double(opponents_.size()) * std::max<std::size_t>(config_.num_rounds, 1));
+        }
+
+private:
+    void evaluate(ThreadPool& pool, Generation& g)
+        {
+            g.fitness.resize(population_.size());
+            std::vector<std::uint32_t> codes(population_.size()), missing;
+            for (std::size_t i = 0; i < population_.size(); ++i) {
+                codes[i] = population_[i].code();
+                if (std::isnan(cache_[codes[i]]))
+                    missing.push_back(codes[i]);
+            }
+            std::sort(missing.begin(), missing.end());
+            missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+            parallelFor(pool, missing.size(), [&](std::size_t m) {
+                    cache_[missing[m]] = fitness(MemoryOne::fromCode(missing[m]));
+                });
+            cached_ += missing.size();
+
+            for (std::size_t i = 0; i < population_.size(); ++i)
+                g.fitness[i] = cache_[codes[i]];
+            // Duplicates of a genome evaluated in this generation count
+            // as hits.
+            g.evaluated = missing.size();
+            g.cache_hits = population_.size() - missing.size();
+        }
+
+    // Child c of a generation draws from its own stream, derived from
+    // the seed, the generation and c.
+    MemoryOne breed(const Generation& g, std::size_t c) const
+        {
+            std::uint64_t stream = streamValue(config_.seed ^ mix64(generation_), c);
+            std::uint64_t pos = 0;
+            const MemoryOne& first = g.population[select(stream, pos)];
+            MemoryOne child = first;
+            if (unitDouble(streamValue(stream, pos++)) < config_.crossover_rate) {
+                const MemoryOne& second = g.population[select(stream, pos)];
+                std::uint64_t mask = streamValue(stream, pos++);
+                child.first = (mask & 1) ? second.first : first.first;
+                for (int k = 0; k < 9; ++k)
+                    child.table[k] = (mask >> (k + 1) & 1) ? second.table[k] : first.table[k];
+            }
+            unsigned char* genes[10] = { &child.first };
+            for (int k = 0; k < 9; ++k)
+                genes[k + 1] = &child.table[k];
+            for (int k = 0; k < 10; ++k)
+                if (unitDouble(streamValue(stream, pos++)) < config_.mutation_rate)
+                    *genes[k] = (*genes[k] + 1 + boundedValue(streamValue(stream, pos++), 2)) % 3;
+            return child;
+        }
+
+    // The best of tournament_size uniform draws; g is sorted best
+    // first, so that is the smallest index drawn.
+    std::size_t select(std::uint64_t stream, std::uint64_t& pos) const
+        {
+            std::size_t best = population_.size();
+            for (std::size_t t = 0; t < config_.tournament_size; ++t)
+                best = std::min<std::size_t>(
+                    best, boundedValue(streamValue(stream, pos++), population_.size()));
+            return best;
+        }
+
+    std::vector<MemoryOne> opponents_;
+    std::vector<Automaton> chains_;
+    EvolutionConfig config_;
+    std::size_t generation_;
+    std::vector<double> cache_;       // Fitness by genome code, NaN if unknown
+    std::size_t cached_;
+    std::vector<MemoryOne> population_;
+};
+
+#endif
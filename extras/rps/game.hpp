@@ -0,0 +1,380 @@
+// Generic two-player matrix games.
+//
+// Rock-paper-scissors is one symmetric matrix game among many. A game
+// descriptor gives the number of moves and the payoff matrix at
+// compile time:
+//
+//     struct MyGame
+//     {
+//         static constexpr std::size_t num_moves = 2;
+//         static constexpr int payoff[2][2] = {{3, 0}, {5, 1}};
+//         static const char* name() { return "my_game"; }
+//     };
+//
+// where payoff[a][b] is what a player gets for playing move a against
+// move b. Scoring against a descriptor compiles to a fully unrolled,
+// branch-free table lookup that vectorizes. MatrixGame is the runtime
+// counterpart for payoff matrices supplied from Python.
+//
+// The rock-paper-scissors Player, Round and play in rps.hpp are not
+// templated on a descriptor; they score with the RockPaperScissors one.
+// They are what the Python bindings, Python subclasses of Player and
+// every native driver are written against, and a template parameter
+// there would make each of those a template as well. Other games are
+// played through GamePlayer and GameRound below instead, with moves as
+// plain numbers.
+
+#ifndef RPS_EXTRAS_GAME_HPP
+#define RPS_EXTRAS_GAME_HPP
+
+#include <cstddef>
+#include <ctime>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/random.hpp>
+
+#include "player_state.hpp"
+
+/* Rock, paper, scissors, using the Move enumeration's numbering. */
+struct RockPaperScissors
+{
+    static constexpr std::size_t num_moves = 3;
+    static constexpr int payoff[3][3] = {
+        { 0, -1,  1},
+        { 1,  0, -1},
+        {-1,  1,  0},
+    };
+    static const char* name() { return "rps"; }
+};
+
+/* Rock, paper, scissors, lizard, Spock, with the moves numbered rock,
+ * paper, scissors, Spock, lizard. Each move then beats the moves one
+ * and three places before it, modulo five, and the first three moves
+ * play exactly as in rock-paper-scissors. */
+struct RockPaperScissorsLizardSpock
+{
+    static constexpr std::size_t num_moves = 5;
+    static constexpr int payoff[5][5] = {
+        { 0, -1,  1, -1,  1},
+        { 1,  0, -1,  1, -1},
+        {-1,  1,  0, -1,  1},
+        { 1, -1,  1,  0, -1},
+        {-1,  1, -1,  1,  0},
+    };
+    static const char* name() { return "rpsls"; }
+};
+
+/* The prisoner's dilemma: move 0 cooperates, move 1 defects. */
+struct PrisonersDilemma
+{
+    static constexpr std::size_t num_moves = 2;
+    static constexpr int payoff[2][2] = {
+        {3, 0},
+        {5, 1},
+    };
+    static const char* name() { return "prisoners_dilemma"; }
+};
+
+/* The payoff for playing `a` against `b` in Game. */
+template <typename Game, std::size_t... I>
+inline int unrolledPayoff(unsigned a, unsigned b, std::index_sequence<I...>)
+{
+    // Compares (a, b) against every cell so that no gather is needed.
+    const std::size_t n = Game::num_moves;
+    unsigned cell = a * n + b;
+    int rslt = 0;
+    ((rslt += (cell == I) ? Game::payoff[I / n][I % n] : 0), ...);
+    return rslt;
+}
+
+template <typename Game>
+inline int gamePayoff(unsigned a, unsigned b)
+{
+    return unrolledPayoff<Game>(
+        a, b, std::make_index_sequence<Game::num_moves * Game::num_moves>());
+}
+
+/* Scores `n` rounds of Game given each player's moves. `p1_out` and
+   `p2_out` receive each player's payoff per round.
+*/
+template <typename Game, typename T>
+void scoreGame(const unsigned char* m1,
+               const unsigned char* m2,
+               std::size_t n,
+               T* p1_out,
+               T* p2_out)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        p1_out[i] = gamePayoff<Game>(m1[i], m2[i]);
+        p2_out[i] = gamePayoff<Game>(m2[i], m1[i]);
+    }
+}
+
+/* The moves made by two players in a single round of a matrix game. */
+struct GameRound
+{
+    GameRound(unsigned char p1_move, unsigned char p2_move) :
+        p1(p1_move),
+        p2(p2_move)
+        {}
+
+    unsigned char p1,  // The move made by player 1
+        p2;  // The move made by player 2
+};
+
+/* The Player interface for matrix games. Moves are numbered from 0 to
+ * `num_moves` - 1.
+ */
+class GamePlayer
+{
+public:
+    GamePlayer(const std::string& name) : name_(name) {}
+    virtual ~GamePlayer() {}
+
+    virtual unsigned nextMove(const std::vector<GameRound>& history,
+                              unsigned char my_pos,
+                              unsigned num_moves) const = 0;
+
+    /* The move in a match, where `slot` holds this player's state for
+     * its seat in that match. Players that learn during a match
+     * override this to keep their state there; the default asks
+     * `nextMove`. */
+    virtual unsigned choose(const std::vector<GameRound>& history,
+                            unsigned char my_pos,
+                            unsigned num_moves,
+                            PlayerStateSlot*) const
+        {
+            return nextMove(history, my_pos, num_moves);
+        }
+
+    std::string name() const { return name_; }
+    void setName(const std::string& n) { name_ = n; }
+
+private:
+    std::string name_;
+};
+
+/* A GamePlayer which plays uniformly at random. */
+class UniformGamePlayer : public GamePlayer
+{
+public:
+    UniformGamePlayer(const std::string& name) : GamePlayer(name) {}
+
+    unsigned nextMove(const std::vector<GameRound>&,
+                      unsigned char,
+                      unsigned num_moves) const
+        {
+            static thread_local boost::random::mt19937 rng(
+                static_cast<unsigned>(std::time(0) ^
+                                      std::hash<std::thread::id>()(std::this_thread::get_id())));
+            return boost::random::uniform_int_distribution<unsigned>(0, num_moves - 1)(rng);
+        }
+};
+
+/* A GamePlayer which always plays the same move. */
+class FixedGamePlayer : public GamePlayer
+{
+public:
+    FixedGamePlayer(const std::string& name, unsigned move) :
+        GamePlayer(name),
+        move_(move)
+        {}
+
+    unsigned nextMove(const std::vector<GameRound>&,
+                      unsigned char,
+                      unsigned num_moves) const
+        {
+            if (move_ >= num_moves)
+                throw std::out_of_range("move is not valid in this game");
+            return move_;
+        }
+
+private:
+    unsigned move_;
+};
+
+/* A GamePlayer which copies its opponent's previous move, starting with
+ * move 0. */
+class CopyGamePlayer : public GamePlayer
+{
+public:
+    CopyGamePlayer(const std::string& name) : GamePlayer(name) {}
+
+    unsigned nextMove(const std::vector<GameRound>& history,
+                      unsigned char my_pos,
+                      unsigned) const
+        {
+            if (history.empty())
+                return 0;
+            const GameRound& r = *history.rbegin();
+            return (my_pos == 0) ? r.p2 : r.p1;
+        }
+};
+
+/* Plays two GamePlayers against each other, returning the history.
+ * The match keeps each seat's player state. */
+inline std::vector<GameRound> playRounds(const GamePlayer& p1,
+                                         const GamePlayer& p2,
+                                         unsigned num_moves,
+                                         std::size_t num_rounds)
+{
+    std::vector<GameRound> history;
+    history.reserve(num_rounds);
+    PlayerStateSlot states[2];
+    for (std::size_t i = 0; i < num_rounds; ++i) {
+        unsigned m1 = p1.choose(history, 0, num_moves, &states[0]);
+        unsigned m2 = p2.choose(history, 1, num_moves, &states[1]);
+        if (m1 >= num_moves || m2 >= num_moves)
+            throw std::out_of_range("player made an invalid move");
+        history.push_back(GameRound(m1, m2));
+    }
+    return history;
+}
+
+/* A symmetric two-player matrix game configured at runtime.
+
+   `payoff` is row-major, num_moves x num_moves, and gives the payoff
+   for playing the row move against the column move. Games created with
+   `named` score with the compile-time kernels of their descriptor.
+   Moves are stored as bytes, so only games of up to 256 moves can be
+   scored or played, although larger ones can still be analysed.
+*/
+class MatrixGame
+{
+public:
+    MatrixGame(const std::vector<double>& payoff,
+               std::size_t num_moves) :
+        name_("custom"),
+        num_moves_(num_moves),
+        payoff_(payoff),
+        kind_(Custom)
+        {
+            if (num_moves == 0)
+                throw std::invalid_argument("a game needs at least one move");
+            if (payoff.size() != num_moves * num_moves)
+                throw std::invalid_argument("payoff matrix must be square");
+        }
+
+    static MatrixGame named(const std::string& name)
+        {
+            if (name == RockPaperScissors::name())
+                return fromDescriptor<RockPaperScissors>(Rps);
+            if (name == RockPaperScissorsLizardSpock::name())
+                return fromDescriptor<RockPaperScissorsLizardSpock>(Rpsls);
+            if (name == PrisonersDilemma::name())
+                return fromDescriptor<PrisonersDilemma>(Pd);
+            throw std::invalid_argument("unknown game: " + name);
+        }
+
+    std::string name() const { return name_; }
+    std::size_t numMoves() const { return num_moves_; }
+    const std::vector<double>& payoffMatrix() const { return payoff_; }
+
+    double payoff(std::size_t a, std::size_t b) const
+        {
+            if (a >= num_moves_ || b >= num_moves_)
+                throw std::out_of_range("move out of range");
+            return payoff_[a * num_moves_ + b];
+        }
+
+    /* Scores `n` rounds; see `scoreGame`. */
+    void score(const unsigned char* m1,
+               const unsigned char* m2,
+               std::size_t n,
+               double* p1_out,
+               double* p2_out) const
+        {
+            checkPlayable();
+            for (std::size_t i = 0; i < n; ++i)
+                if (m1[i] >= num_moves_ || m2[i] >= num_moves_)
+                    throw std::out_of_range("move out of range");
+
+            switch (kind_) {
+                case Rps:
+                    scoreGame<RockPaperScissors>(m1, m2, n, p1_out, p2_out);
+                    break;
+
+                case Rpsls:
+                    scoreGame<RockPaperScissorsLizardSpock>(m1, m2, n, p1_out, p2_out);
+                    break;
+
+                case Pd:
+                    scoreGame<PrisonersDilemma>(m1, m2, n, p1_out, p2_out);
+                    break;
+
+                case Custom:
+                default:
+                    const double* table = &payoff_[0];
+                    for (std::size_t i = 0; i < n; ++i) {
+                        p1_out[i] = table[m1[i] * num_moves_ + m2[i]];
+                        p2_out[i] = table[m2[i] * num_moves_ + m1[i]];
+                    }
+                    break;
+            }
+        }
+
+    /* Plays a match, filling `moves` with the (p1, p2) move of each
+     * round and `payoffs` with the (p1, p2) payoffs. */
+    void play(const GamePlayer& p1,
+              const GamePlayer& p2,
+              std::size_t num_rounds,
+              std::vector<unsigned char>& moves,
+              std::vector<double>& payoffs) const
+        {
+            checkPlayable();
+            std::vector<GameRound> history =
+                playRounds(p1, p2, num_moves_, num_rounds);
+
+            std::vector<unsigned char> m1(num_rounds), m2(num_rounds);
+            for (std::size_t i = 0; i < num_rounds; ++i) {
+                m1[i] = history[i].p1;
+                m2[i] = history[i].p2;
+            }
+            std::vector<double> s1(num_rounds), s2(num_rounds);
+            if (num_rounds)
+                score(&m1[0], &m2[0], num_rounds, &s1[0], &s2[0]);
+
+            moves.resize(2 * num_rounds);
+            payoffs.resize(2 * num_rounds);
+            for (std::size_t i = 0; i < num_rounds; ++i) {
+                moves[2 * i] = m1[i];
+                moves[2 * i + 1] = m2[i];
+                payoffs[2 * i] = s1[i];
+                payoffs[2 * i + 1] = s2[i];
+            }
+        }
+
+private:
+    enum Kind { Custom, Rps, Rpsls, Pd };
+
+    void checkPlayable() const
+        {
+            if (num_moves_ > 256)
+                throw std::invalid_argument("games with more than 256 moves cannot be played");
+        }
+
+    template <typename Game>
+    static MatrixGame fromDescriptor(Kind kind)
+        {
+            std::vector<double> payoff;
+            for (std::size_t a = 0; a < Game::num_moves; ++a)
+                for (std::size_t b = 0; b < Game::num_moves; ++b)
+                    payoff.push_back(Game::payoff[a][b]);
+            MatrixGame g(payoff, Game::num_moves);
+            g.name_ = Game::name();
+            g.kind_ = kind;
+            return g;
+        }
+
+    std::string name_;
+    std::size_t num_moves_;
+    std::vector<double> payoff_;
+    Kind kind_;
+};
+
+#endif
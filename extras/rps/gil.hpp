@@ -0,0 +1,110 @@
+// Helpers for running native code alongside the Python interpreter.
+
+#ifndef RPS_EXTRAS_GIL_HPP
+#define RPS_EXTRAS_GIL_HPP
+
+#include <exception>
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+#include <boost/python.hpp>
+
+namespace bp=boost::python;
+
+/* True once the interpreter has started shutting down. A thread which
+ * asks for the GIL after this point is terminated by Python, which must
+ * not happen inside a destructor. */
+inline bool pythonFinalizing()
+{
+#if PY_VERSION_HEX >= 0x030D0000
+    return Py_IsFinalizing();
+#else
+    return _Py_IsFinalizing();
+#endif
+}
+
+/* Holds the GIL for its lifetime. Safe to nest, and safe on threads
+ * which Python did not create (e.g. pool workers). */
+class ScopedGIL : private boost::noncopyable
+{
+public:
+    ScopedGIL() : state_(PyGILState_Ensure()) {}
+    ~ScopedGIL() { PyGILState_Release(state_); }
+
+private:
+    PyGILState_STATE state_;
+};
+
+/* Releases the GIL for its lifetime so other Python threads can run
+ * while native code works. */
+class ReleaseGIL : private boost::noncopyable
+{
+public:
+    ReleaseGIL() : state_(PyEval_SaveThread()) {}
+    ~ReleaseGIL() { PyEval_RestoreThread(state_); }
+
+private:
+    PyThreadState* state_;
+};
+
+/* A Python exception captured so that it can cross native code,
+   including a hop between threads. Rethrowing it into Python (see
+   `translatePythonError`) restores the original exception.
+*/
+class PythonError : public std::exception
+{
+public:
+    /* Takes the currently set Python exception. The GIL must be held. */
+    static PythonError fetch()
+        {
+            PyObject *type, *value, *traceback;
+            PyErr_Fetch(&type, &value, &traceback);
+            return PythonError(type, value, traceback);
+        }
+
+    const char* what() const throw() { return "Python exception"; }
+
+    /* Sets this exception as the current Python exception. The GIL must
+     * be held. */
+    void restore() const
+        {
+            Py_XINCREF(error_->type);
+            Py_XINCREF(error_->value);
+            Py_XINCREF(error_->traceback);
+            PyErr_Restore(error_->type, error_->value, error_->traceback);
+        }
+
+private:
+    struct Error
+    {
+        // Leaks the objects if the interpreter is already going away.
+        ~Error()
+            {
+                if (pythonFinalizing())
+                    return;
+                ScopedGIL gil;
+                Py_XDECREF(type);
+                Py_XDECREF(value);
+                Py_XDECREF(traceback);
+            }
+
+        PyObject *type, *value, *traceback;
+    };
+
+    PythonError(PyObject* type, PyObject* value, PyObject* traceback) :
+        error_(new Error)
+        {
+            error_->type = type;
+            error_->value = value;
+            error_->traceback = traceback;
+        }
+
+    std::shared_ptr<Error> error_;
+};
+
+inline void translatePythonError(const PythonError& e)
+{
+    e.restore();
+}
+
+#endif
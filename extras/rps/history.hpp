@@ -0,0 +1,112 @@
+// Structure-of-arrays match history and the scans strategies run on it.
+//
+// SplitHistory keeps each seat's moves in its own byte array, so a
+// strategy interested only in its opponent reads only the opponent's
+// bytes. The move histogram compares 32 moves per instruction with
+// AVX2 when the CPU has it and fall back to plain loops otherwise.
+
+#ifndef RPS_EXTRAS_HISTORY_HPP
+#define RPS_EXTRAS_HISTORY_HPP
+
+#include <cstddef>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RPS_HAVE_AVX2_KERNELS 1
+#endif
+
+/* The moves of a two-player match, one byte array per seat. */
+class SplitHistory
+{
+public:
+    void reserve(std::size_t n)
+        {
+            p1_.reserve(n);
+            p2_.reserve(n);
+        }
+
+    void append(unsigned char m1, unsigned char m2)
+        {
+            p1_.push_back(m1);
+            p2_.push_back(m2);
+        }
+
+    void clear()
+        {
+            p1_.clear();
+            p2_.clear();
+        }
+
+    std::size_t size() const { return p1_.size(); }
+
+    /* The moves of seat `pos` (0 or 1). */
+    const unsigned char* seat(unsigned char pos) const
+        {
+            const std::vector<unsigned char>& v = pos ? p2_ : p1_;
+            return v.empty() ? 0 : &v[0];
+        }
+
+private:
+    std::vector<unsigned char> p1_, p2_;
+};
+
+namespace detail {
+
+inline void histogramScalar(const unsigned char* moves, std::size_t n, std::size_t* counts)
+{
+    std::size_t c0 = 0, c1 = 0, c2 = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        c0 += (moves[i] == 0);
+        c1 += (moves[i] == 1);
+        c2 += (moves[i] == 2);
+    }
+    counts[0] += c0;
+    counts[1] += c1;
+    counts[2] += c2;
+}
+
+#ifdef RPS_HAVE_AVX2_KERNELS
+
+__attribute__((target("avx2,popcnt")))
+inline void histogramAvx2(const unsigned char* moves, std::size_t n, std::size_t* counts)
+{
+    // Bytes other than 0, 1 and 2 are not counted at all.
+    const __m256i rock = _mm256_set1_epi8(0);
+    const __m256i paper = _mm256_set1_epi8(1);
+    const __m256i scissors = _mm256_set1_epi8(2);
+    std::size_t c0 = 0, c1 = 0, c2 = 0, i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(moves + i));
+        c0 += _mm_popcnt_u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, rock)));
+        c1 += _mm_popcnt_u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, paper)));
+        c2 += _mm_popcnt_u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, scissors)));
+    }
+    counts[0] += c0;
+    counts[1] += c1;
+    counts[2] += c2;
+    histogramScalar(moves + i, n - i, counts);
+}
+
+inline bool cpuHasAvx2()
+{
+    static const bool has = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    return has;
+}
+
+#endif
+
+}  // namespace detail
+
+/* Adds the number of Rock (0), Paper (1) and Scissors (2) moves among
+ * the first `n` to `counts[0..2]`. Other byte values are ignored. */
+inline void histogram(const unsigned char* moves, std::size_t n, std::size_t counts[3])
+{
+#ifdef RPS_HAVE_AVX2_KERNELS
+    if (detail::cpuHasAvx2())
+        return detail::histogramAvx2(moves, n, counts);
+#endif
+    detail::histogramScalar(moves, n, counts);
+}
+
+#endif
@@ -0,0 +1,227 @@
+// A match engine which plays many memory-one matches side by side.
+//
+// Matches are processed in blocks of LANE_COUNT, one byte lane each.
+// The state of a block (last moves, random streams, win counters) is
+// kept as structure-of-arrays vectors, and a round is a few vector
+// operations across the block: the table entry for each lane is picked
+// by comparing the lane's (mine, theirs) index against all nine and
+// blending, random entries are blended with a vectorized xorshift, and
+// the outcome is counted with byte compares. No branch depends on a
+// lane's moves. Like the scans in history.hpp, the block kernel is also
+// built for AVX2, where a block is one register, and picked at run time.
+
+#ifndef RPS_EXTRAS_LANES_HPP
+#define RPS_EXTRAS_LANES_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "history.hpp"
+#include "memory_one.hpp"
+#include "rng.hpp"
+#include "thread_pool.hpp"
+
+const std::size_t LANE_COUNT = 32;
+
+typedef unsigned char ByteLanes __attribute__((vector_size(LANE_COUNT)));
+typedef std::uint32_t WordLanes __attribute__((vector_size(4 * LANE_COUNT)));
+
+/* The per-match results of a lane run. */
+struct LaneResults
+{
+    std::vector<std::uint32_t> p1_wins, p2_wins, ties;
+};
+
+namespace detail {
+
+/* One block's strategies, transposed so that entry k of every lane's
+ * table is one vector. */
+struct LaneTables
+{
+    ByteLanes first;
+    ByteLanes table[9];
+};
+
+inline bool transposeTables(const std::vector<MemoryOne>& strategies,
+                            const std::uint32_t* which,
+                            std::size_t lanes,
+                            LaneTables& t)
+{
+    bool random = false;
+    for (std::size_t l = 0; l < LANE_COUNT; ++l) {
+        const MemoryOne& s = strategies[which[std::min(l, lanes - 1)]];
+        t.first[l] = s.first;
+        random |= s.first == RANDOM_ENTRY;
+        for (int k = 0; k < 9; ++k) {
+            t.table[k][l] = s.table[k];
+            random |= s.table[k] == RANDOM_ENTRY;
+        }
+    }
+    return random;
+}
+
+/* Plays one block for `num_rounds` rounds and adds each lane's wins to
+   `wins1` and `wins2`. Kept to byte-wide operations with no multiplies
+   (the index mine * 3 + theirs is mine + mine + mine + theirs), which
+   every SIMD instruction set has; the win counters are bytes too, and
+   are flushed to 32-bit totals before they can overflow.
+
+   Random moves are drawn every round, used or not, so each lane's
+   stream advances independently of the strategies; blocks without a
+   random entry skip the streams altogether.
+*/
+template <bool Random>
+__attribute__((always_inline))
+inline void playBlock(const LaneTables& t1,
+                      const LaneTables& t2,
+                      const WordLanes& rng1_state,
+                      const WordLanes& rng2_state,
+                      std::size_t num_rounds,
+                      std::uint32_t* wins1,
+                      std::uint32_t* wins2)
+{
+    const ByteLanes three = ByteLanes() + RANDOM_ENTRY;
+    WordLanes rng1 = rng1_state, rng2 = rng2_state;
+    ByteLanes m1 = t1.first, m2 = t2.first;
+    for (std::size_t done = 0; done < num_rounds; ) {
+        const std::size_t chunk = std::min<std::size_t>(num_rounds - done, 255);
+        ByteLanes c1 = ByteLanes(), c2 = ByteLanes();
+        for (std::size_t r = done; r < done + chunk; ++r) {
+            if (r > 0) {
+                ByteLanes i1 = m1 + m1 + m1 + m2, i2 = m2 + m2 + m2 + m1;
+                ByteLanes e1 = t1.table[0], e2 = t2.table[0];
+                for (unsigned char k = 1; k < 9; ++k) {
+                    e1 = (i1 == k) ? t1.table[k] : e1;
+                    e2 = (i2 == k) ? t2.table[k] : e2;
+                }
+                m1 = e1;
+                m2 = e2;
+            }
+            if (Random) {
+                // xorshift32 per lane; the top 16 bits times three,
+                // over 2^16, are a move.
+                rng1 ^= rng1 << 13;
+                rng1 ^= rng1 >> 17;
+                rng1 ^= rng1 << 5;
+                rng2 ^= rng2 << 13;
+                rng2 ^= rng2 >> 17;
+                rng2 ^= rng2 << 5;
+                WordLanes h1 = rng1 >> 16, h2 = rng2 >> 16;
+                m1 = (m1 == three) ? __builtin_convertvector((h1 + h1 + h1) >> 16, ByteLanes) : m1;
+                m2 = (m2 == three) ? __builtin_convertvector((h2 + h2 + h2) >> 16, ByteLanes) : m2;
+            }
+
+            // (m1 - m2) mod 3 is 1 when player 1 wins, 2 when player 2
+            // does. A true comparison is all ones, i.e. -1.
+            ByteLanes d = m1 - m2 + three;
+            d = (d >= three) ? d - three : d;
+            c1 -= (d == 1);
+            c2 -= (d == 2);
+        }
+        for (std::size_t l = 0; l < LANE_COUNT; ++l) {
+            wins1[l] += c1[l];
+            wins2[l] += c2[l];
+        }
+        done += chunk;
+    }
+}
+
+template <bool Random>
+inline void playBlockGeneric(const LaneTables& t1, const LaneTables& t2,
+                             const WordLanes& rng1, const WordLanes& rng2,
+                             std::size_t num_rounds,
+                             std::uint32_t* wins1, std::uint32_t* wins2)
+{
+    playBlock<Random>(t1, t2, rng1, rng2, num_rounds, wins1, wins2);
+}
+
+#ifdef RPS_HAVE_AVX2_KERNELS
+
+template <bool Random>
+__attribute__((target("avx2")))
+inline void playBlockAvx2(const LaneTables& t1, const LaneTables& t2,
+                          const WordLanes& rng1, const WordLanes& rng2,
+                          std::size_t num_rounds,
+                          std::uint32_t* wins1, std::uint32_t* wins2)
+{
+    playBlock<Random>(t1, t2, rng1, rng2, num_rounds, wins1, wins2);
+}
+
+#endif
+
+}  // namespace detail
+
+/* Plays `pairs` of `strategies` against each other for `num_rounds`
+   rounds each. Every match draws its random moves from its own stream,
+   derived from `seed` and the match's index, so results do not depend
+   on how blocks are scheduled over the pool.
+*/
+inline LaneResults playLanes(const std::vector<MemoryOne>& strategies,
+                             const std::vector<std::pair<std::uint32_t, std::uint32_t> >& pairs,
+                             std::size_t num_rounds,
+                             std::uint64_t seed,
+                             ThreadPool& pool)
+{
+    BOOST_FOREACH(const MemoryOne& s, strategies) {
+        if (!s.valid())
+            throw std::invalid_argument("invalid memory-one strategy");
+    }
+    const std::size_t n = pairs.size();
+    std::vector<std::uint32_t> which1(n), which2(n);
+    for (std::size_t m = 0; m < n; ++m) {
+        if (pairs[m].first >= strategies.size() || pairs[m].second >= strategies.size())
+            throw std::out_of_range("strategy index out of range");
+        which1[m] = pairs[m].first;
+        which2[m] = pairs[m].second;
+    }
+
+    LaneResults rslt;
+    rslt.p1_wins.resize(n);
+    rslt.p2_wins.resize(n);
+    rslt.ties.resize(n);
+
+    parallelFor(pool, (n + LANE_COUNT - 1) / LANE_COUNT, [&](std::size_t b) {
+            const std::size_t start = b * LANE_COUNT;
+            const std::size_t lanes = std::min(LANE_COUNT, n - start);
+
+            detail::LaneTables t1, t2;
+            bool random = detail::transposeTables(strategies, &which1[start], lanes, t1);
+            random |= detail::transposeTables(strategies, &which2[start], lanes, t2);
+
+            WordLanes rng1, rng2;
+            for (std::size_t l = 0; l < LANE_COUNT; ++l) {
+                std::uint64_t v = streamValue(seed, start + l);
+                rng1[l] = static_cast<std::uint32_t>(v) | 1;
+                rng2[l] = static_cast<std::uint32_t>(v >> 32) | 1;
+            }
+
+            std::uint32_t wins1[LANE_COUNT] = {}, wins2[LANE_COUNT] = {};
+#ifdef RPS_HAVE_AVX2_KERNELS
+            if (detail::cpuHasAvx2()) {
+                if (random)
+                    detail::playBlockAvx2<true>(t1, t2, rng1, rng2, num_rounds, wins1, wins2);
+                else
+                    detail::playBlockAvx2<false>(t1, t2, rng1, rng2, num_rounds, wins1, wins2);
+            } else
+#endif
+            if (random)
+                detail::playBlockGeneric<true>(t1, t2, rng1, rng2, num_rounds, wins1, wins2);
+            else
+                detail::playBlockGeneric<false>(t1, t2, rng1, rng2, num_rounds, wins1, wins2);
+
+            for (std::size_t l = 0; l < lanes; ++l) {
+                rslt.p1_wins[start + l] = wins1[l];
+                rslt.p2_wins[start + l] = wins2[l];
+                rslt.ties[start + l] = num_rounds - wins1[l] - wins2[l];
+            }
+        });
+    return rslt;
+}
+
+#endif
@@ -0,0 +1,278 @@
+// Spatial rock-paper-scissors: cyclic dominance on a lattice.
+//
+// The lattice is a torus of Move bytes, each cell invaded by the moves
+// that beat it. Two update schemes are provided:
+//
+//  - step() is synchronous: every cell with at least `threshold`
+//    neighbours playing the move that beats it becomes that move. Rows
+//    are updated in place, in bands spread over the pool, comparing 16
+//    cells per vector operation.
+//  - sweep() is asynchronous, the lattice form of the Gillespie
+//    process: random cells in turn pick a random neighbour, and are
+//    invaded if it beats them. Tiles of the lattice are updated in
+//    parallel, four checkerboard phases a sweep, so that no two tiles
+//    in flight touch; each tile draws from its own stream.
+
+#ifndef RPS_EXTRAS_LATTICE_HPP
+#define RPS_EXTRAS_LATTICE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "history.hpp"
+#include "rng.hpp"
+#include "thread_pool.hpp"
+
+namespace detail {
+
+typedef unsigned char CellVector __attribute__((vector_size(16)));
+
+inline CellVector loadCells(const unsigned char* p)
+{
+    CellVector v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* The next state of one row, from the old row and its neighbours.
+   `left` and `right` are `row` shifted by one cell with wraparound,
+   which the caller provides so that every input is a plain array. If
+   `diagonals` is given, its four rows (the shifted rows above and
+   below) count as neighbours too.
+*/
+inline void updateRow(const unsigned char* row,
+                      const unsigned char* up,
+                      const unsigned char* down,
+                      const unsigned char* left,
+                      const unsigned char* right,
+                      const unsigned char* const* diagonals,
+                      std::size_t width,
+                      unsigned threshold,
+                      unsigned char* out)
+{
+    const CellVector one = CellVector() + 1, two = CellVector() + 2;
+    const CellVector min_count = CellVector() + static_cast<unsigned char>(threshold);
+    std::size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        CellVector c = loadCells(row + x);
+        CellVector p = (c == two) ? CellVector() : c + one;
+        CellVector count = -(loadCells(up + x) == p) - (loadCells(down + x) == p)
+            - (loadCells(left + x) == p) - (loadCells(right + x) == p);
+        if (diagonals)
+            for (int d = 0; d < 4; ++d)
+                count -= (loadCells(diagonals[d] + x) == p);
+        CellVector next = (count >= min_count) ? p : c;
+        std::memcpy(out + x, &next, sizeof(next));
+    }
+    for (; x < width; ++x) {
+        unsigned char p = (row[x] + 1) % 3;
+        unsigned count = (up[x] == p) + (down[x] == p) + (left[x] == p) + (right[x] == p);
+        if (diagonals)
+            for (int d = 0; d < 4; ++d)
+                count += diagonals[d][x] == p;
+        out[x] = (count >= threshold) ? p : row[x];
+    }
+}
+
+/* `row` rotated by one cell each way. */
+inline void shiftRow(const unsigned char* row,
+                     std::size_t width,
+                     unsigned char* left,
+                     unsigned char* right)
+{
+    left[0] = row[width - 1];
+    std::memcpy(left + 1, row, width - 1);
+    std::memcpy(right, row + 1, width - 1);
+    right[width - 1] = row[0];
+}
+
+}  // namespace detail
+
+class Lattice : private boost::noncopyable
+{
+public:
+    /* A width x height torus of uniformly random moves. */
+    Lattice(std::size_t width, std::size_t height, std::uint64_t seed) :
+        width_(width),
+        height_(height),
+        cells_(width * height),
+        generation_(0),
+        sweeps_(0)
+        {
+            if (width < 4 || height < 4)
+                throw std::invalid_argument("a lattice is at least 4 x 4");
+            randomize(seed);
+        }
+
+    std::size_t width() const { return width_; }
+    std::size_t height() const { return height_; }
+    std::size_t generation() const { return generation_; }
+    std::size_t sweeps() const { return sweeps_; }
+
+    /* The cells, row by row. They stay in place for the lifetime of
+     * the lattice. Cells written through this must stay 0, 1 or 2;
+     * `step`, `sweep` and `counts` refuse a lattice where they do not. */
+    unsigned char* cells() { return &cells_[0]; }
+
+    void randomize(std::uint64_t seed)
+        {
+            for (std::size_t i = 0; i < cells_.size(); ++i)
+                cells_[i] = boundedValue(streamValue(seed, i), 3);
+        }
+
+    /* The number of Rock, Paper and Scissors cells. */
+    std::vector<std::size_t> counts() const
+        {
+            check();
+            std::size_t c[3] = { 0, 0, 0 };
+            histogram(&cells_[0], cells_.size(), c);
+            return std::vector<std::size_t>(c, c + 3);
+        }
+
+    /* Runs `generations` synchronous updates with the von Neumann
+       neighbourhood (four neighbours), or the Moore neighbourhood
+       (eight) if `moore` is set.
+
+       Each band keeps a copy of the old row it has just overwritten,
+       and the rows bordering other bands are copied before the update
+       starts, so the update is in place and reads only old states.
+    */
+    void step(std::size_t generations, unsigned threshold, bool moore, ThreadPool& pool)
+        {
+            if (threshold == 0 || threshold > (moore ? 8u : 4u))
+                throw std::invalid_argument("threshold must be between 1 and the neighbourhood size");
+            check();
+
+            const std::size_t w = width_;
+            const std::size_t num_bands = std::min<std::size_t>(height_, std::max<std::size_t>(1, pool.size() * 4));
+            std::vector<unsigned char> firsts(num_bands * w), lasts(num_bands * w);
+
+            for (std::size_t g = 0; g < generations; ++g) {
+                for (std::size_t b = 0; b < num_bands; ++b) {
+                    std::memcpy(&firsts[b * w], row(bandStart(b, num_bands)), w);
+                    std::memcpy(&lasts[b * w], row(bandStart(b + 1, num_bands) - 1), w);
+                }
+
+                parallelFor(pool, num_bands, [&](std::size_t b) {
+                        std::vector<unsigned char> buffers(10 * w);
+                        unsigned char* prev = &buffers[0];
+                        unsigned char* old = &buffers[w];
+                        unsigned char* shifted[8];
+                        for (int s = 0; s < 8; ++s)
+                            shifted[s] = &buffers[(2 + s) * w];
+
+                        const std::size_t y0 = bandStart(b, num_bands);
+                        const std::size_t y1 = bandStart(b + 1, num_bands);
+                        std::memcpy(prev, &lasts[((b + num_bands - 1) % num_bands) * w], w);
+                        for (std::size_t y = y0; y < y1; ++y) {
+                            std::memcpy(old, row(y), w);
+                            const unsigned char* below =
+                                (y + 1 < y1) ? row(y + 1) : &firsts[((b + 1) % num_bands) * w];
+
+                            // shifted: old left/right, then above and
+                            // below left/right for the diagonals.
+                            detail::shiftRow(old, w, shifted[0], shifted[1]);
+                            const unsigned char* diagonals[4];
+                            if (moore) {
+                                detail::shiftRow(prev, w, shifted[2], shifted[3]);
+                                detail::shiftRow(below, w, shifted[4], shifted[5]);
+                                for (int d = 0; d < 4; ++d)
+                                    diagonals[d] = shifted[2 + d];
+                            }
+                            detail::updateRow(old, prev, below, shifted[0], shifted[1],
+                                              moore ? diagonals : 0, w, threshold, row(y));
+                            std::swap(prev, old);
+                        }
+                    });
+                ++generation_;
+            }
+        }
+
+    /* Runs `num_sweeps` asynchronous sweeps of width x height
+       invasion attempts each. Reproducible from `seed` whatever the
+       number of threads.
+    */
+    void sweep(std::size_t num_sweeps, std::uint64_t seed, ThreadPool& pool)
+        {
+            // An even number of tiles each way, so that the checkerboard
+            // colouring holds across the wraparound too.
+            const std::size_t tiles_x = std::max<std::size_t>(2, width_ / TILE & ~std::size_t(1));
+            const std::size_t tiles_y = std::max<std::size_t>(2, height_ / TILE & ~std::size_t(1));
+            check();
+
+            for (std::size_t s = 0; s < num_sweeps; ++s) {
+                std::uint64_t sweep_seed = mix64(seed ^ mix64(sweeps_));
+                for (unsigned phase = 0; phase < 4; ++phase) {
+                    const std::size_t half_x = tiles_x / 2, half_y = tiles_y / 2;
+                    parallelFor(pool, half_x * half_y, [&](std::size_t t) {
+                            std::size_t tx = (t % half_x) * 2 + (phase & 1);
+                            std::size_t ty = (t / half_x) * 2 + (phase >> 1);
+                            invadeTile(streamValue(sweep_seed, (ty * tiles_x + tx) * 4 + phase),
+                                       tx * width_ / tiles_x, (tx + 1) * width_ / tiles_x,
+                                       ty * height_ / tiles_y, (ty + 1) * height_ / tiles_y);
+                        });
+                }
+                ++sweeps_;
+            }
+        }
+
+private:
+    static const std::size_t TILE = 64;
+
+    unsigned char* row(std::size_t y) { return &cells_[y * width_]; }
+
+    // Throws unless every cell is a move.
+    void check() const
+        {
+            unsigned char highest = 0;
+            for (std::size_t i = 0; i < cells_.size(); ++i)
+                highest = std::max(highest, cells_[i]);
+            if (highest > 2)
+                throw std::invalid_argument("lattice cells must be 0, 1 or 2");
+        }
+
+    std::size_t bandStart(std::size_t b, std::size_t num_bands) const
+        {
+            return b * height_ / num_bands;
+        }
+
+    // As many invasion attempts as the tile has cells, at uniformly
+    // random cells of the tile towards uniformly random neighbours,
+    // which may lie in the tiles around it.
+    void invadeTile(std::uint64_t stream,
+                    std::size_t x0, std::size_t x1,
+                    std::size_t y0, std::size_t y1)
+        {
+            static const int STEP_X[4] = { 1, -1, 0, 0 };
+            static const int STEP_Y[4] = { 0, 0, 1, -1 };
+            const std::size_t tw = x1 - x0, th = y1 - y0;
+            const std::size_t w = width_, h = height_;
+            unsigned char* cells = &cells_[0];
+            for (std::size_t k = 0, n = tw * th; k < n; ++k) {
+                std::uint64_t v = streamValue(stream, k);
+                std::size_t x = x0 + boundedValue(v, tw);
+                std::size_t y = y0 + (((v >> 8) & 0xffffff) * th >> 24);
+                // Branch-free, as the directions and invasions are too
+                // random to predict.
+                std::ptrdiff_t nx = x + STEP_X[v & 3], ny = y + STEP_Y[v & 3];
+                nx += (nx < 0) ? std::ptrdiff_t(w) : 0;
+                nx -= (nx == std::ptrdiff_t(w)) ? std::ptrdiff_t(w) : 0;
+                ny += (ny < 0) ? std::ptrdiff_t(h) : 0;
+                ny -= (ny == std::ptrdiff_t(h)) ? std::ptrdiff_t(h) : 0;
+                unsigned char c = cells[y * w + x], n_move = cells[ny * w + nx];
+                cells[y * w + x] = (n_move == (c == 2 ? 0 : c + 1)) ? n_move : c;
+            }
+        }
+
+    std::size_t width_, height_;
+    std::vector<unsigned char> cells_;
+    std::size_t generation_, sweeps_;
+};
+
+#endif
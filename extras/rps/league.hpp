@@ -0,0 +1,332 @@
+// A round-robin league whose pool of players changes over time.
+//
+// The result of every pairing is kept in an append-only file, keyed by
+// each player's name and Fingerprint, so a player rejoining under its
+// name with a different strategy or seed does not inherit the old
+// results. Adding a player to a league of N therefore only plays its N
+// new pairings (fewer if the file already has some of them), and
+// removing one only subtracts its results; standings, head-to-head
+// tables and ratings are derived from the stored results without
+// replaying anything.
+//
+// Players without a fingerprint can join, but nothing shows that a
+// later player of the same name plays the same way, so their results
+// count only while they are members and are not written to the file.
+
+#ifndef RPS_EXTRAS_LEAGUE_HPP
+#define RPS_EXTRAS_LEAGUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "ratings.hpp"
+#include "rps.hpp"
+#include "thread_pool.hpp"
+#include "tournament.hpp"
+
+/* A member's record over the matches it has played against the
+ * current members. A match is won by winning more of its rounds. */
+struct Standing
+{
+    Standing() : matches(0), wins(0), losses(0), draws(0),
+                 round_wins(0), round_losses(0), round_ties(0) {}
+
+    std::string name;
+    std::size_t matches, wins, losses, draws;
+    std::size_t round_wins, round_losses, round_ties;
+};
+
+/* The result of one pairing, from the point of view of the member
+ * whose key sorts first. */
+struct PairResult
+{
+    std::size_t first_wins, second_wins, ties;
+};
+
+class League : private boost::noncopyable
+{
+public:
+    /* Opens the league stored in `path`, creating the file if needed.
+     * Every match lasts `num_rounds` rounds, and a file written with a
+     * different number is refused. */
+    League(const std::string& path, std::size_t num_rounds) :
+        path_(path),
+        num_rounds_(num_rounds),
+        transient_(0)
+        {
+            load();
+        }
+
+    std::size_t numRounds() const { return num_rounds_; }
+    std::size_t size() const { return members_.size(); }
+
+    /* The number of pairings among the members without a result. */
+    std::size_t pending() const { return pending_.size(); }
+
+    /* Adds a player under its name, which must be unique in the league
+       and free of tabs and newlines. Stored results against current
+       members count at once; the rest become pending.
+
+       The player must outlive its membership.
+    */
+    void add(const Player& player)
+        {
+            std::string name = player.name();
+            if (name.empty() || name.find_first_of("\t\n") != std::string::npos)
+                throw std::invalid_argument("league names must be non-empty without tabs or newlines");
+            if (index_.count(name))
+                throw std::invalid_argument("already in the league: " + name);
+
+            Member m;
+            m.player = &player;
+            m.standing.name = name;
+            m.persistent = memberKey(player, m.key);
+            members_.push_back(m);
+            index_[name] = members_.size() - 1;
+
+            for (std::size_t i = 0; i + 1 < members_.size(); ++i) {
+                const std::string& other = members_[i].standing.name;
+                std::unordered_map<std::string, PairResult>::const_iterator it =
+                    results_.find(pairKey(m.key, members_[i].key));
+                if (it == results_.end())
+                    pending_.push_back(std::make_pair(other, name));
+                else
+                    apply(name, other, it->second, 1);
+            }
+        }
+
+    /* Removes a member and its results from the standings. The results
+     * of a fingerprinted member stay in the file, ready for its return;
+     * those of others are forgotten. */
+    void remove(const std::string& name)
+        {
+            std::map<std::string, std::size_t>::iterator found = index_.find(name);
+            if (found == index_.end())
+                throw std::invalid_argument("not in the league: " + name);
+
+            const Member leaving = members_[found->second];
+            BOOST_FOREACH(const Member& m, members_) {
+                std::unordered_map<std::string, PairResult>::iterator it =
+                    results_.find(pairKey(leaving.key, m.key));
+                if (m.standing.name == name || it == results_.end())
+                    continue;
+                apply(name, m.standing.name, it->second, -1);
+                if (!leaving.persistent)
+                    results_.erase(it);
+            }
+
+            members_.erase(members_.begin() + found->second);
+            index_.clear();
+            for (std::size_t i = 0; i < members_.size(); ++i)
+                index_[members_[i].standing.name] = i;
+
+            std::vector<std::pair<std::string, std::string> > still_pending;
+            for (std::size_t p = 0; p < pending_.size(); ++p)
+                if (pending_[p].first != name && pending_[p].second != name)
+                    still_pending.push_back(pending_[p]);
+            pending_.swap(still_pending);
+        }
+
+    /* Plays the pending pairings in parallel and records them. Returns
+     * the number of matches played. */
+    std::size_t update(ThreadPool& pool, std::atomic<bool>& stop)
+        {
+            std::vector<const Player*> players;
+            BOOST_FOREACH(const Member& m, members_) {
+                players.push_back(m.player);
+            }
+            std::vector<std::pair<std::size_t, std::size_t> > pairings;
+            for (std::size_t p = 0; p < pending_.size(); ++p)
+                pairings.push_back(std::make_pair(index_[pending_[p].first],
+                                                  index_[pending_[p].second]));
+
+            std::vector<MatchSummary> played =
+                playPairings(players, pairings, num_rounds_, pool, stop);
+
+            std::ofstream out(path_.c_str(), std::ios::app);
+            BOOST_FOREACH(const MatchSummary& s, played) {
+                const Member& a = members_[s.p1];
+                const Member& b = members_[s.p2];
+                PairResult r = (a.key < b.key) ? PairResult{s.p1_wins, s.p2_wins, s.ties}
+                                               : PairResult{s.p2_wins, s.p1_wins, s.ties};
+                const std::string& first = (a.key < b.key) ? a.key : b.key;
+                const std::string& second = (a.key < b.key) ? b.key : a.key;
+                results_[pairKey(a.key, b.key)] = r;
+                if (a.persistent && b.persistent)
+                    out << first << '\t' << second << '\t'
+                        << r.first_wins << '\t' << r.second_wins << '\t' << r.ties << '\n';
+                apply(a.standing.name, b.standing.name, r, 1);
+            }
+            out.flush();
+            if (!out)
+                throw std::runtime_error("cannot write league file " + path_);
+
+            pending_.clear();
+            return played.size();
+        }
+
+    std::vector<Standing> standings() const
+        {
+            std::vector<Standing> rslt;
+            BOOST_FOREACH(const Member& m, members_) {
+                rslt.push_back(m.standing);
+            }
+            return rslt;
+        }
+
+    /* The known results among the members, as MatchSummary values over
+     * member indices. */
+    std::vector<MatchSummary> results() const
+        {
+            std::vector<MatchSummary> rslt;
+            for (std::size_t i = 0; i < members_.size(); ++i)
+                for (std::size_t j = i + 1; j < members_.size(); ++j) {
+                    const std::string& a = members_[i].key;
+                    const std::string& b = members_[j].key;
+                    std::unordered_map<std::string, PairResult>::const_iterator it =
+                        results_.find(pairKey(a, b));
+                    if (it == results_.end())
+                        continue;
+                    MatchSummary s;
+                    s.p1 = i;
+                    s.p2 = j;
+                    s.p1_wins = (a < b) ? it->second.first_wins : it->second.second_wins;
+                    s.p2_wins = (a < b) ? it->second.second_wins : it->second.first_wins;
+                    s.ties = it->second.ties;
+                    rslt.push_back(s);
+                }
+            return rslt;
+        }
+
+    /* The members x members matrix of rounds won by each row member
+     * against each column member. */
+    std::vector<std::int64_t> headToHead() const
+        {
+            const std::size_t n = members_.size();
+            std::vector<std::int64_t> table(n * n, 0);
+            BOOST_FOREACH(const MatchSummary& s, results()) {
+                table[s.p1 * n + s.p2] = s.p1_wins;
+                table[s.p2 * n + s.p1] = s.p2_wins;
+            }
+            return table;
+        }
+
+    /* Rates the members from the known results as one rating period. */
+    Ratings ratings(RatingSystem system, ThreadPool& pool) const
+        {
+            Ratings r(members_.size(), system);
+            r.updateBatch(results(), pool);
+            return r;
+        }
+
+private:
+    struct Member
+    {
+        const Player* player;
+        Standing standing;
+        std::string key;   // The name and fingerprint, as results are keyed
+        bool persistent;   // Whether the player has a fingerprint
+    };
+
+    /* Sets `key` to the member's name followed by its fingerprint, or
+     * by a number unique to this league if it has none. Returns whether
+     * it has one. */
+    bool memberKey(const Player& player, std::string& key)
+        {
+            Fingerprint fp;
+            std::ostringstream out;
+            out << player.name() << '\t';
+            bool persistent = player.fingerprint(fp);
+            if (persistent)
+                out << std::hex << std::setw(16) << std::setfill('0') << fp.value();
+            else
+                out << '~' << transient_++;
+            key = out.str();
+            return persistent;
+        }
+
+    static std::string pairKey(const std::string& a, const std::string& b)
+        {
+            return (a < b) ? a + '\t' + b : b + '\t' + a;
+        }
+
+    /* Adds (sign 1) or subtracts (sign -1) a result between the members
+     * named `a` and `b`. */
+    void apply(const std::string& a, const std::string& b, const PairResult& r, int sign)
+        {
+            bool a_first = members_[index_[a]].key < members_[index_[b]].key;
+            std::size_t a_wins = a_first ? r.first_wins : r.second_wins;
+            std::size_t b_wins = a_first ? r.second_wins : r.first_wins;
+            tally(members_[index_[a]].standing, a_wins, b_wins, r.ties, sign);
+            tally(members_[index_[b]].standing, b_wins, a_wins, r.ties, sign);
+        }
+
+    static void tally(Standing& s, std::size_t won, std::size_t lost, std::size_t tied, int sign)
+        {
+            s.matches += sign;
+            s.wins += (won > lost) * sign;
+            s.losses += (won < lost) * sign;
+            s.draws += (won == lost) * sign;
+            s.round_wins += won * sign;
+            s.round_losses += lost * sign;
+            s.round_ties += tied * sign;
+        }
+
+    // The file starts with a "# rps league <num_rounds>" line, followed
+    // by one "first second first_wins second_wins ties" line per
+    // result, tab separated, where each player is its name and its
+    // fingerprint in hex. Later lines win.
+    void load()
+        {
+            std::ifstream in(path_.c_str());
+            if (!in) {
+                std::ofstream out(path_.c_str());
+                out << "# rps league " << num_rounds_ << '\n';
+                if (!out)
+                    throw std::runtime_error("cannot create league file " + path_);
+                return;
+            }
+
+            std::string line;
+            std::size_t rounds = 0;
+            if (!std::getline(in, line) ||
+                !(std::istringstream(line.substr(std::min<std::size_t>(line.size(), 13))) >> rounds) ||
+                line.compare(0, 13, "# rps league ") != 0)
+                throw std::runtime_error("not a league file: " + path_);
+            if (rounds != num_rounds_)
+                throw std::invalid_argument("league file was played with a different number of rounds");
+
+            while (std::getline(in, line)) {
+                std::istringstream fields(line);
+                std::string a_name, a_fp, b_name, b_fp;
+                PairResult r;
+                if (std::getline(fields, a_name, '\t') && std::getline(fields, a_fp, '\t') &&
+                    std::getline(fields, b_name, '\t') && std::getline(fields, b_fp, '\t') &&
+                    fields >> r.first_wins >> r.second_wins >> r.ties)
+                    results_[pairKey(a_name + '\t' + a_fp, b_name + '\t' + b_fp)] = r;
+            }
+        }
+
+    std::string path_;
+    std::size_t num_rounds_;
+    std::vector<Member> members_;
+    std::map<std::string, std::size_t> index_;
+    std::unordered_map<std::string, PairResult> results_;
+    std::vector<std::pair<std::string, std::string> > pending_;
+    std::size_t transient_;
+};
+
+#endif
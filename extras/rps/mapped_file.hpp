@@ -0,0 +1,113 @@
+// Read-only memory mapping of a whole file, and replacing files safely
+// while they are mapped.
+//
+// Mappings are shared with the page cache, so any number of readers,
+// in this process or others, share one copy of the file. Files that
+// may be mapped are written with `replaceFile` rather than truncated
+// in place, which would fault readers on pages past the new end.
+
+#ifndef RPS_EXTRAS_MAPPED_FILE_HPP
+#define RPS_EXTRAS_MAPPED_FILE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/noncopyable.hpp>
+
+class MappedFile : private boost::noncopyable
+{
+public:
+    explicit MappedFile(const std::string& path) :
+        data_(0),
+        size_(0)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("cannot read " + path + ": " + std::strerror(errno));
+            }
+            size_ = st.st_size;
+            // An empty file cannot be mapped, and needs no mapping.
+            if (size_ == 0) {
+                ::close(fd);
+                return;
+            }
+            void* p = ::mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED)
+                throw std::runtime_error("cannot map " + path + ": " + std::strerror(errno));
+            data_ = p;
+        }
+
+    ~MappedFile()
+        {
+            if (data_)
+                ::munmap(data_, size_);
+        }
+
+    const unsigned char* data() const { return static_cast<const unsigned char*>(data_); }
+    std::size_t size() const { return size_; }
+
+    /* Hints that the file will be read from start to end. */
+    void adviseSequential() const
+        {
+            if (data_)
+                ::madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+
+private:
+    void* data_;
+    std::size_t size_;
+};
+
+/* Writes the `parts` (pointer and length pairs) in order to a file
+   under a temporary name and renames it over `path`, so that readers
+   in other processes, and mappings of the old file, never see a
+   partial one. Returns false, leaving `path` alone, if it fails.
+*/
+inline bool replaceFile(const std::string& path,
+                        std::initializer_list<std::pair<const void*, std::size_t> > parts)
+{
+    std::string tmp_path = path + "." + std::to_string(::getpid()) + "." +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return false;
+    bool ok = true;
+    for (auto part = parts.begin(); ok && part != parts.end(); ++part) {
+        const char* p = static_cast<const char*>(part->first);
+        for (std::size_t left = part->second; ok && left > 0; ) {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            ok = n > 0;
+            if (ok) {
+                p += n;
+                left -= n;
+            }
+        }
+    }
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || ::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+#endif
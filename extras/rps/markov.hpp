@@ -0,0 +1,245 @@
+// Exact analysis of matches between finite-state strategies.
+//
+// A strategy whose move depends only on a finite state, updated from
+// each round's moves, is an Automaton. Two of them playing each other
+// form a Markov chain on pairs of states, whose distribution after r
+// rounds gives the exact expected outcome of round r. The chain is
+// sparse (at most nine successors per state), so both the finite-
+// horizon expectation and the long-run average cost a few passes over
+// its transitions rather than a simulation.
+
+#ifndef RPS_EXTRAS_MARKOV_HPP
+#define RPS_EXTRAS_MARKOV_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "memory_one.hpp"
+#include "rps.hpp"
+
+/* A state of an Automaton: the probabilities of playing Rock, Paper
+ * and Scissors in it, and the state that follows each round, at
+ * next[mine * 3 + theirs]. */
+struct AutomatonState
+{
+    double moves[3];
+    std::uint32_t next[9];
+};
+
+/* A finite-state strategy starting in state 0. */
+struct Automaton
+{
+    std::vector<AutomatonState> states;
+
+    void check() const
+        {
+            if (states.empty())
+                throw std::invalid_argument("an automaton needs at least one state");
+            BOOST_FOREACH(const AutomatonState& s, states) {
+                double total = 0;
+                for (int m = 0; m < 3; ++m) {
+                    if (!(s.moves[m] >= 0))
+                        throw std::invalid_argument("move probabilities must be non-negative");
+                    total += s.moves[m];
+                }
+                if (std::fabs(total - 1) > 1e-9)
+                    throw std::invalid_argument("move probabilities must sum to one");
+                for (int k = 0; k < 9; ++k)
+                    if (s.next[k] >= states.size())
+                        throw std::invalid_argument("automaton transition out of range");
+            }
+        }
+
+    /* A memory-one strategy as ten states: the start, and one for each
+     * (mine, theirs) of the previous round. */
+    static Automaton fromMemoryOne(const MemoryOne& strategy)
+        {
+            Automaton a;
+            a.states.resize(10);
+            for (std::size_t i = 0; i < 10; ++i) {
+                unsigned char e = (i == 0) ? strategy.first : strategy.table[i - 1];
+                for (int m = 0; m < 3; ++m)
+                    a.states[i].moves[m] = (e == RANDOM_ENTRY) ? 1.0 / 3 : (e == m);
+                for (int k = 0; k < 9; ++k)
+                    a.states[i].next[k] = k + 1;
+            }
+            return a;
+        }
+};
+
+/* The automaton a player is known to follow: Random, TitForTat and
+ * MemoryOnePlayer are finite-state. Returns false for other players. */
+inline bool playerAutomaton(const Player& p, Automaton& a)
+{
+    if (const MemoryOnePlayer* m = dynamic_cast<const MemoryOnePlayer*>(&p))
+        a = Automaton::fromMemoryOne(m->strategy());
+    else if (dynamic_cast<const Random*>(&p))
+        a = Automaton::fromMemoryOne(MemoryOne::named("random"));
+    else if (dynamic_cast<const TitForTat*>(&p))
+        a = Automaton::fromMemoryOne(MemoryOne::named("tit_for_tat"));
+    else
+        return false;
+    return true;
+}
+
+/* Expected rounds won by each player and tied, over some number of
+ * rounds or (from longRun) per round. */
+struct Expectation
+{
+    double p1_wins, p2_wins, ties;
+};
+
+/* The Markov chain of two automata playing each other. Only the pairs
+   of states reachable from the start are built; transitions are kept
+   row-compressed, with the probability of each successor summed over
+   the rounds leading to it.
+*/
+class ProductChain
+{
+public:
+    ProductChain(const Automaton& a1, const Automaton& a2)
+        {
+            a1.check();
+            a2.check();
+
+            std::unordered_map<std::uint64_t, std::uint32_t> index;
+            std::vector<std::uint64_t> pairs;
+            index[0] = 0;
+            pairs.push_back(0);
+            row_start_.push_back(0);
+
+            // States are numbered in the order they are first reached,
+            // so the loop below finishes once no new pair turns up.
+            for (std::size_t i = 0; i < pairs.size(); ++i) {
+                const AutomatonState& s1 = a1.states[pairs[i] >> 32];
+                const AutomatonState& s2 = a2.states[pairs[i] & 0xffffffff];
+
+                Expectation e = {0, 0, 0};
+                std::size_t row = targets_.size();
+                for (unsigned m1 = 0; m1 < 3; ++m1)
+                    for (unsigned m2 = 0; m2 < 3; ++m2) {
+                        double p = s1.moves[m1] * s2.moves[m2];
+                        if (p == 0)
+                            continue;
+                        if (m1 == m2)
+                            e.ties += p;
+                        else if (m1 == (m2 + 1) % 3)
+                            e.p1_wins += p;
+                        else
+                            e.p2_wins += p;
+
+                        std::uint64_t key = std::uint64_t(s1.next[m1 * 3 + m2]) << 32 |
+                            s2.next[m2 * 3 + m1];
+                        std::unordered_map<std::uint64_t, std::uint32_t>::const_iterator it =
+                            index.find(key);
+                        std::uint32_t target;
+                        if (it == index.end()) {
+                            target = pairs.size();
+                            index[key] = target;
+                            pairs.push_back(key);
+                        } else {
+                            target = it->second;
+                        }
+                        addTransition(row, target, p);
+                    }
+                outcomes_.push_back(e);
+                row_start_.push_back(targets_.size());
+            }
+        }
+
+    std::size_t size() const { return outcomes_.size(); }
+    std::size_t numTransitions() const { return targets_.size(); }
+
+    /* The exact expected outcome of the first `num_rounds` rounds. */
+    Expectation expected(std::size_t num_rounds) const
+        {
+            std::vector<double> dist(size(), 0.0), next(size());
+            dist[0] = 1;
+            Expectation total = {0, 0, 0};
+            for (std::size_t r = 0; r < num_rounds; ++r) {
+                accumulate(dist, total);
+                step(dist, next);
+                dist.swap(next);
+            }
+            return total;
+        }
+
+    /* The expected outcome per round in the long run, i.e. under the
+       limiting average distribution of the chain started from the
+       start state. This is the stationary distribution when the chain
+       has a single recurrent class, and the mixture over classes that
+       the start leads to otherwise.
+
+       Found by power iteration on the lazy chain (I + P) / 2, which has
+       the same stationary distributions but converges for periodic
+       chains too (Rock against Cycle, say), until the distribution
+       moves by less than `tolerance` in one step.
+    */
+    Expectation longRun(double tolerance=1e-12, std::size_t max_iterations=1000000) const
+        {
+            std::vector<double> dist(size(), 0.0), next(size());
+            dist[0] = 1;
+            for (std::size_t it = 0; it < max_iterations; ++it) {
+                step(dist, next);
+                double change = 0;
+                for (std::size_t i = 0; i < size(); ++i) {
+                    double lazy = 0.5 * (dist[i] + next[i]);
+                    change += std::fabs(lazy - dist[i]);
+                    next[i] = lazy;
+                }
+                dist.swap(next);
+                if (change < tolerance)
+                    break;
+            }
+            Expectation rate = {0, 0, 0};
+            accumulate(dist, rate);
+            return rate;
+        }
+
+private:
+    void addTransition(std::size_t row, std::uint32_t target, double p)
+        {
+            for (std::size_t t = row; t < targets_.size(); ++t)
+                if (targets_[t] == target) {
+                    probabilities_[t] += p;
+                    return;
+                }
+            targets_.push_back(target);
+            probabilities_.push_back(p);
+        }
+
+    void accumulate(const std::vector<double>& dist, Expectation& e) const
+        {
+            for (std::size_t i = 0; i < size(); ++i) {
+                e.p1_wins += dist[i] * outcomes_[i].p1_wins;
+                e.p2_wins += dist[i] * outcomes_[i].p2_wins;
+                e.ties += dist[i] * outcomes_[i].ties;
+            }
+        }
+
+    // next = dist * P
+    void step(const std::vector<double>& dist, std::vector<double>& next) const
+        {
+            std::fill(next.begin(), next.end(), 0.0);
+            for (std::size_t i = 0; i < size(); ++i) {
+                if (dist[i] == 0)
+                    continue;
+                for (std::size_t t = row_start_[i]; t < row_start_[i + 1]; ++t)
+                    next[targets_[t]] += dist[i] * probabilities_[t];
+            }
+        }
+
+    std::vector<Expectation> outcomes_;       // Outcome of a round played from each state
+    std::vector<std::size_t> row_start_;
+    std::vector<std::uint32_t> targets_;
+    std::vector<double> probabilities_;
+};
+
+#endif
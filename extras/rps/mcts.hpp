@@ -0,0 +1,522 @@
+// A player which searches the next few rounds with Monte Carlo tree
+// search against a model of its opponent.
+//
+// The opponent model predicts the opponent's next move from the rounds
+// before it: counts of the opponent's moves after each kind of round in
+// the match so far, on top of a prior from an n-gram model if one is
+// given, or a uniform one. Because the prediction depends on the
+// player's own moves, searching ahead pays: a move that loses now can
+// set up the rounds after it.
+//
+// Each tree node is one point in the rounds ahead, with UCT statistics
+// for the player's three moves and a child for each of the nine rounds
+// that can follow. Workers search the one tree concurrently: nodes come
+// from a pool by bumping an atomic index, children are published with a
+// compare-and-swap, statistics are atomics, and every move selected
+// takes a virtual loss until its result is backed up, steering the
+// other workers elsewhere. After each round the child for the round
+// actually played becomes the root, so its statistics carry over.
+//
+// The tree and the opponent model belong to the match: they live in
+// the match's MatchContext, so one player can search in any number of
+// matches at once.
+
+#ifndef RPS_EXTRAS_MCTS_HPP
+#define RPS_EXTRAS_MCTS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "ngram.hpp"
+#include "rng.hpp"
+#include "rps.hpp"
+#include "thread_pool.hpp"
+
+struct MctsConfig
+{
+    MctsConfig() :
+        depth(4),
+        budget_us(2000),
+        max_iterations(0),
+        threads(1),
+        exploration(1.0),
+        max_nodes(1 << 15),
+        prior_weight(10.0),
+        seed(0)
+        {}
+
+    std::size_t depth;            // Rounds searched ahead, at most 16
+    std::size_t budget_us;        // Search time per move, 0 for no limit
+    std::size_t max_iterations;   // Search iterations per move, 0 for no limit
+    std::size_t threads;          // Workers searching each move
+    double exploration;           // The UCT exploration constant
+    std::size_t max_nodes;        // Tree size limit per seat
+    double prior_weight;          // Pseudo-counts for the n-gram prior
+    std::uint64_t seed;
+};
+
+/* The last search in a seat. */
+struct MctsStats
+{
+    std::size_t iterations;
+    std::size_t nodes;            // In the tree after the search
+    std::size_t reused;           // Root visits carried over from earlier moves
+};
+
+namespace detail {
+
+struct MctsNode
+{
+    std::atomic<std::uint32_t> visits[3];
+    std::atomic<std::int64_t> value[3];      // Net score over the rounds searched from here
+    std::atomic<std::uint32_t> children[9];  // By mine * 3 + theirs; 0 for none
+    std::uint32_t thresholds[2];             // The opponent model's cumulative probabilities
+};
+
+/* Nodes handed out by bumping an atomic index. Index 0 is never handed
+ * out, and stands for no node. */
+class MctsPool : private boost::noncopyable
+{
+public:
+    explicit MctsPool(std::size_t capacity) :
+        nodes_(capacity),
+        used_(1)
+        {}
+
+    std::size_t capacity() const { return nodes_.size(); }
+    std::size_t used() const { return std::min<std::size_t>(used_.load(), nodes_.size()); }
+    MctsNode& operator[](std::uint32_t i) { return nodes_[i]; }
+
+    void clear() { used_ = 1; }
+
+    /* A zeroed node, or 0 if the pool is full. */
+    std::uint32_t allocate()
+        {
+            if (used_.load(std::memory_order_relaxed) >= nodes_.size())
+                return 0;
+            std::uint32_t i = used_.fetch_add(1, std::memory_order_relaxed);
+            if (i >= nodes_.size())
+                return 0;
+            MctsNode& n = nodes_[i];
+            for (int a = 0; a < 3; ++a) {
+                n.visits[a].store(0, std::memory_order_relaxed);
+                n.value[a].store(0, std::memory_order_relaxed);
+            }
+            for (int c = 0; c < 9; ++c)
+                n.children[c].store(0, std::memory_order_relaxed);
+            return i;
+        }
+
+private:
+    std::vector<MctsNode> nodes_;
+    std::atomic<std::uint32_t> used_;
+};
+
+/* The search state of one seat in one match: the tree, and what the
+ * opponent model has learned from the match so far. */
+struct MctsSeat : public PlayerState
+{
+    MctsSeat() :
+        root(0),
+        seen(0),
+        last(0)
+        {}
+
+    std::unique_ptr<MctsPool> pool, spare;
+    std::uint32_t root;
+    std::size_t seen;                   // Rounds learned from
+    unsigned last;                      // The last of them, theirs * 3 + mine
+    std::uint32_t frequencies[3];       // Of the opponent's moves
+    std::uint32_t transitions[9][3];    // Opponent's move after each round
+};
+
+}  // namespace detail
+
+class MctsPlayer : public Player
+{
+public:
+    MctsPlayer(const std::string& name,
+               const MctsConfig& config,
+               ThreadPool& pool,
+               const std::shared_ptr<const NGramModel>& model=std::shared_ptr<const NGramModel>()) :
+        Player(name),
+        config_(config),
+        pool_(&pool),
+        model_(model)
+        {
+            if (config.depth == 0 || config.depth > MAX_DEPTH)
+                throw std::invalid_argument("search depth must be between 1 and 16");
+            if (config.budget_us == 0 && config.max_iterations == 0)
+                throw std::invalid_argument("a search needs a time budget or an iteration limit");
+            if (config.threads == 0 || config.max_nodes < 2 || config.max_nodes > 0xffffffffu)
+                throw std::invalid_argument("invalid search settings");
+            if (!(config.prior_weight > 0) || !std::isfinite(config.prior_weight) ||
+                !(config.exploration >= 0))
+                throw std::invalid_argument("the prior weight must be positive and exploration non-negative");
+            std::memset(stats_, 0, sizeof(stats_));
+        }
+
+    /* Direct calls share one search state per seat, which follows one
+       match at a time: a history shorter than the one it has learned
+       from, or whose last learned round differs, starts it afresh.
+    */
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            return chooseFromRounds(*this, history, my_pos);
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            return seats_.apply(*this, view.stateSlot(), view.position(), [&](detail::MctsSeat& seat) {
+                    sync(seat, view);
+                    search(seat, view);
+                    return bestMove(seat);
+                });
+        }
+
+    /* Searches under a time budget, or with several workers, are not
+     * reproducible. */
+    bool fingerprint(Fingerprint&) const { return false; }
+
+    const MctsConfig& config() const { return config_; }
+    const std::shared_ptr<const NGramModel>& model() const { return model_; }
+
+    /* The last search in seat `my_pos`, in whichever match. */
+    MctsStats stats(unsigned char my_pos) const
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            return stats_[my_pos & 1];
+        }
+
+private:
+    static const std::size_t MAX_DEPTH = 16;
+    static const std::size_t MAX_CONTEXT = NGRAM_MAX_ORDER + MAX_DEPTH;
+
+    void reset(detail::MctsSeat& seat) const
+        {
+            seat.root = 0;
+            seat.seen = 0;
+            seat.last = 0;
+            std::memset(seat.frequencies, 0, sizeof(seat.frequencies));
+            std::memset(seat.transitions, 0, sizeof(seat.transitions));
+        }
+
+    // Learns from the rounds played since the last move, and moves the
+    // root down the tree along them. A new match, or a state last used
+    // by a player with another pool size, starts afresh.
+    void sync(detail::MctsSeat& seat, const HistoryView& view) const
+        {
+            const std::size_t n = view.size();
+            const unsigned char* mine = view.mine();
+            const unsigned char* theirs = view.theirs();
+            if (!seat.pool || seat.pool->capacity() != config_.max_nodes) {
+                seat.pool.reset(new detail::MctsPool(config_.max_nodes));
+                seat.spare.reset(new detail::MctsPool(config_.max_nodes));
+                reset(seat);
+            }
+
+            if (n == 0 || n < seat.seen ||
+                (seat.seen > 0 && theirs[seat.seen - 1] * 3u + mine[seat.seen - 1] != seat.last))
+                reset(seat);
+
+            detail::MctsPool& pool = *seat.pool;
+            for (std::size_t i = seat.seen; i < n; ++i) {
+                const unsigned code = theirs[i] * 3 + mine[i];
+                ++seat.frequencies[theirs[i]];
+                if (i > 0)
+                    ++seat.transitions[theirs[i - 1] * 3 + mine[i - 1]][theirs[i]];
+                seat.last = code;
+                if (seat.root)
+                    seat.root = pool[seat.root].children[mine[i] * 3 + theirs[i]].load();
+            }
+            seat.seen = n;
+
+            if (seat.root && 2 * pool.used() > pool.capacity())
+                prune(seat);
+            if (!seat.root) {
+                pool.clear();
+                unsigned char context[MAX_CONTEXT];
+                std::size_t len = rootContext(view, context);
+                seat.root = newNode(seat, pool, context, len);
+            }
+        }
+
+    // The last rounds, as many as the opponent model looks at, coded
+    // opponent first.
+    std::size_t rootContext(const HistoryView& view, unsigned char* context) const
+        {
+            const std::size_t n = view.size();
+            const std::size_t len = std::min<std::size_t>(n, model_ ? std::max(model_->order(), 1u) : 1);
+            for (std::size_t i = 0; i < len; ++i)
+                context[i] = view.theirs()[n - len + i] * 3 + view.mine()[n - len + i];
+            return len;
+        }
+
+    // Copies the tree under the root to the spare pool, dropping the
+    // branches not taken.
+    void prune(detail::MctsSeat& seat) const
+        {
+            detail::MctsPool& from = *seat.pool;
+            detail::MctsPool& to = *seat.spare;
+            to.clear();
+            std::vector<std::pair<std::uint32_t, std::uint32_t> > queue;
+            queue.push_back(std::make_pair(seat.root, copyNode(from[seat.root], to)));
+            for (std::size_t q = 0; q < queue.size(); ++q) {
+                detail::MctsNode& old_node = from[queue[q].first];
+                for (int c = 0; c < 9; ++c) {
+                    std::uint32_t child = old_node.children[c].load(std::memory_order_relaxed);
+                    if (!child)
+                        continue;
+                    std::uint32_t copy = copyNode(from[child], to);
+                    to[queue[q].second].children[c].store(copy, std::memory_order_relaxed);
+                    queue.push_back(std::make_pair(child, copy));
+                }
+            }
+            seat.root = queue[0].second;
+            seat.pool.swap(seat.spare);
+        }
+
+    static std::uint32_t copyNode(detail::MctsNode& node, detail::MctsPool& to)
+        {
+            std::uint32_t i = to.allocate();
+            for (int a = 0; a < 3; ++a) {
+                to[i].visits[a].store(node.visits[a].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                to[i].value[a].store(node.value[a].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            to[i].thresholds[0] = node.thresholds[0];
+            to[i].thresholds[1] = node.thresholds[1];
+            return i;
+        }
+
+    // The opponent model's prediction after `context`, as cumulative
+    // probabilities of Rock and Paper scaled to 2^32.
+    void predict(const detail::MctsSeat& seat,
+                 const unsigned char* context,
+                 std::size_t len,
+                 std::uint32_t* thresholds) const
+        {
+            double p[3] = { 1.0 / 3, 1.0 / 3, 1.0 / 3 };
+            if (model_) {
+                const std::uint32_t* c = model_->longest(context, len, 1);
+                if (c) {
+                    double total = double(c[0]) + c[1] + c[2];
+                    for (int m = 0; m < 3; ++m)
+                        p[m] = config_.prior_weight * c[m] / total;
+                }
+            }
+            const std::uint32_t* online = seat.frequencies;
+            if (len > 0) {
+                const std::uint32_t* t = seat.transitions[context[len - 1]];
+                if (t[0] + t[1] + t[2] > 0)
+                    online = t;
+            }
+            for (int m = 0; m < 3; ++m)
+                p[m] += online[m];
+            const double scale = 4294967295.0 / (p[0] + p[1] + p[2]);
+            thresholds[0] = std::uint32_t(p[0] * scale);
+            thresholds[1] = std::uint32_t(std::min(4294967295.0, (p[0] + p[1]) * scale));
+        }
+
+    std::uint32_t newNode(const detail::MctsSeat& seat,
+                          detail::MctsPool& pool,
+                          const unsigned char* context,
+                          std::size_t len) const
+        {
+            std::uint32_t i = pool.allocate();
+            if (i)
+                predict(seat, context, len, pool[i].thresholds);
+            return i;
+        }
+
+    static unsigned sampleMove(const std::uint32_t* thresholds, std::uint64_t bits)
+        {
+            std::uint32_t r = bits >> 32;
+            return (r >= thresholds[0]) + (r >= thresholds[1]);
+        }
+
+    // +1 if `mine` beats `theirs`, -1 if it loses.
+    static int payoff(unsigned mine, unsigned theirs)
+        {
+            return (mine == (theirs + 1) % 3) - (theirs == (mine + 1) % 3);
+        }
+
+    // UCT over the node's moves, with net scores per round mapped to
+    // [-1, 1]. Takes a virtual loss of every remaining round on the
+    // move selected.
+    unsigned selectMove(detail::MctsNode& node, unsigned remaining) const
+        {
+            std::uint32_t visits[3];
+            std::int64_t value[3];
+            std::uint64_t total = 0;
+            for (int a = 0; a < 3; ++a) {
+                visits[a] = node.visits[a].load(std::memory_order_relaxed);
+                value[a] = node.value[a].load(std::memory_order_relaxed);
+                total += visits[a];
+            }
+            unsigned best = 0;
+            double best_score = -1e300;
+            const double log_total = std::log(double(std::max<std::uint64_t>(total, 1)));
+            for (unsigned a = 0; a < 3; ++a) {
+                if (visits[a] == 0) {
+                    best = a;
+                    break;
+                }
+                double score = double(value[a]) / (double(visits[a]) * remaining)
+                    + config_.exploration * std::sqrt(log_total / visits[a]);
+                if (score > best_score) {
+                    best_score = score;
+                    best = a;
+                }
+            }
+            node.visits[best].fetch_add(1, std::memory_order_relaxed);
+            node.value[best].fetch_sub(remaining, std::memory_order_relaxed);
+            return best;
+        }
+
+    // One iteration: selection down the tree, expansion of one node, a
+    // random playout to the search depth, and backup.
+    void iterate(detail::MctsSeat& seat,
+                 const unsigned char* root_context,
+                 std::size_t root_len,
+                 std::uint64_t stream,
+                 std::uint64_t& pos) const
+        {
+            detail::MctsPool& pool = *seat.pool;
+            const unsigned depth = config_.depth;
+            unsigned char context[MAX_CONTEXT];
+            std::memcpy(context, root_context, root_len);
+            std::size_t len = root_len;
+
+            std::uint32_t path[MAX_DEPTH];
+            unsigned char moves[MAX_DEPTH];
+            int rewards[MAX_DEPTH];
+            unsigned levels = 0;
+            std::uint32_t node = seat.root;
+            int tail = 0;
+            while (levels < depth) {
+                detail::MctsNode& current = pool[node];
+                unsigned a = selectMove(current, depth - levels);
+                unsigned o = sampleMove(current.thresholds, streamValue(stream, pos++));
+                path[levels] = node;
+                moves[levels] = a;
+                rewards[levels] = payoff(a, o);
+                context[len++] = o * 3 + a;
+                ++levels;
+                if (levels == depth)
+                    break;
+
+                std::atomic<std::uint32_t>& slot = current.children[a * 3 + o];
+                std::uint32_t child = slot.load(std::memory_order_acquire);
+                if (child) {
+                    node = child;
+                    continue;
+                }
+                // Expand, unless the pool is full or another worker
+                // gets there first; either way, play out from here.
+                child = newNode(seat, pool, context, len);
+                if (child) {
+                    std::uint32_t expected = 0;
+                    slot.compare_exchange_strong(expected, child, std::memory_order_acq_rel);
+                }
+                std::uint32_t thresholds[2];
+                for (unsigned d = levels; d < depth; ++d) {
+                    std::uint64_t bits = streamValue(stream, pos++);
+                    predict(seat, context, len, thresholds);
+                    unsigned mine = boundedValue(bits, 3);
+                    unsigned theirs = sampleMove(thresholds, bits << 32);
+                    tail += payoff(mine, theirs);
+                    context[len++] = theirs * 3 + mine;
+                }
+                break;
+            }
+
+            int ret = tail;
+            for (unsigned k = levels; k-- > 0; ) {
+                ret += rewards[k];
+                pool[path[k]].value[moves[k]].fetch_add(ret + int(depth - k), std::memory_order_relaxed);
+            }
+        }
+
+    void search(detail::MctsSeat& seat, const HistoryView& view) const
+        {
+            unsigned char context[MAX_CONTEXT];
+            const std::size_t len = rootContext(view, context);
+            detail::MctsNode& root = (*seat.pool)[seat.root];
+            std::size_t reused = 0;
+            for (int a = 0; a < 3; ++a)
+                reused += root.visits[a].load();
+
+            typedef std::chrono::steady_clock Clock;
+            const Clock::time_point deadline = Clock::now() + std::chrono::microseconds(config_.budget_us);
+            const std::uint64_t base = streamValue(config_.seed ^ view.position(), view.size());
+            std::atomic<std::size_t> claimed(0), completed(0);
+            parallelFor(*pool_, config_.threads, [&](std::size_t w) {
+                    std::uint64_t stream = streamValue(base, w), pos = 0;
+                    std::size_t done = 0;
+                    for (;;) {
+                        if (config_.max_iterations && claimed.fetch_add(1) >= config_.max_iterations)
+                            break;
+                        // Reading the clock costs about as much as a
+                        // shallow iteration.
+                        if (config_.budget_us && done % 16 == 0 && Clock::now() >= deadline)
+                            break;
+                        iterate(seat, context, len, stream, pos);
+                        ++done;
+                    }
+                    completed += done;
+                });
+
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            MctsStats& stats = stats_[view.position() & 1];
+            stats.iterations = completed;
+            stats.nodes = seat.pool->used() - 1;
+            stats.reused = reused;
+        }
+
+    // The most visited move at the root; without visits, the move that
+    // beats the likeliest prediction.
+    Move bestMove(detail::MctsSeat& seat) const
+        {
+            detail::MctsNode& root = (*seat.pool)[seat.root];
+            std::uint32_t visits[3];
+            for (int a = 0; a < 3; ++a)
+                visits[a] = root.visits[a].load();
+            if (visits[0] + visits[1] + visits[2] == 0) {
+                const std::uint32_t* t = root.thresholds;
+                std::uint64_t p[3] = { t[0], std::uint64_t(t[1]) - t[0], 4294967296ull - t[1] };
+                unsigned predicted = (p[1] > p[0]) ? 1 : 0;
+                if (p[2] > p[predicted])
+                    predicted = 2;
+                return static_cast<Move>((predicted + 1) % 3);
+            }
+            unsigned best = 0;
+            for (unsigned a = 1; a < 3; ++a)
+                if (visits[a] > visits[best] ||
+                    (visits[a] == visits[best] && root.value[a].load() > root.value[best].load()))
+                    best = a;
+            return static_cast<Move>(best);
+        }
+
+    MctsConfig config_;
+    ThreadPool* pool_;
+    std::shared_ptr<const NGramModel> model_;
+    SeatStates<detail::MctsSeat> seats_;
+    mutable std::mutex stats_mutex_;
+    mutable MctsStats stats_[2];
+};
+
+#endif
@@ -0,0 +1,160 @@
+// Memory-one strategies: players whose move depends only on the
+// previous round.
+//
+// A memory-one strategy is a table of ten entries: the first move, and
+// a move for each of the nine combinations of (my last move, their last
+// move). An entry is a Move, or RANDOM_ENTRY to choose uniformly. Small
+// as they are, these cover Random, TitForTat, win-stay-lose-shift and
+// the like, and being plain tables they can be played in bulk
+// (lanes.hpp) and analysed exactly (markov.hpp).
+
+#ifndef RPS_EXTRAS_MEMORY_ONE_HPP
+#define RPS_EXTRAS_MEMORY_ONE_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rng.hpp"
+#include "rps.hpp"
+
+const unsigned char RANDOM_ENTRY = 3;
+
+struct MemoryOne
+{
+    /* The number of deterministic memory-one strategies, 3^10. */
+    static const std::uint32_t NUM_DETERMINISTIC = 59049;
+
+    unsigned char first;     // The first move
+    unsigned char table[9];  // The move after (mine, theirs), at mine * 3 + theirs
+
+    /* The move entry after a round in which this player played `mine`
+     * and its opponent `theirs`. */
+    unsigned char after(unsigned mine, unsigned theirs) const
+        {
+            return table[mine * 3 + theirs];
+        }
+
+    /* Whether every entry is a move or RANDOM_ENTRY. */
+    bool valid() const
+        {
+            if (first > RANDOM_ENTRY)
+                return false;
+            for (int k = 0; k < 9; ++k)
+                if (table[k] > RANDOM_ENTRY)
+                    return false;
+            return true;
+        }
+
+    bool deterministic() const
+        {
+            if (first == RANDOM_ENTRY)
+                return false;
+            for (int k = 0; k < 9; ++k)
+                if (table[k] == RANDOM_ENTRY)
+                    return false;
+            return true;
+        }
+
+    /* The deterministic strategy numbered `code`: its base-3 digits,
+     * least significant first, are the first move and the table. */
+    static MemoryOne fromCode(std::uint32_t code)
+        {
+            if (code >= NUM_DETERMINISTIC)
+                throw std::out_of_range("memory-one code out of range");
+            MemoryOne s;
+            s.first = code % 3;
+            for (int k = 0; k < 9; ++k) {
+                code /= 3;
+                s.table[k] = code % 3;
+            }
+            return s;
+        }
+
+    std::uint32_t code() const
+        {
+            if (!deterministic())
+                throw std::invalid_argument("only deterministic strategies have codes");
+            std::uint32_t c = 0;
+            for (int k = 8; k >= 0; --k)
+                c = c * 3 + table[k];
+            return c * 3 + first;
+        }
+
+    /* The named strategies: "random", "rock", "paper", "scissors",
+     * "tit_for_tat", "win_stay_lose_shift", "cycle" and "beat_last". */
+    static MemoryOne named(const std::string& name)
+        {
+            MemoryOne s;
+            for (unsigned mine = 0; mine < 3; ++mine)
+                for (unsigned theirs = 0; theirs < 3; ++theirs) {
+                    unsigned char& e = s.table[mine * 3 + theirs];
+                    if (name == "random")
+                        e = RANDOM_ENTRY;
+                    else if (name == "rock" || name == "paper" || name == "scissors")
+                        e = (name == "rock") ? Rock : (name == "paper") ? Paper : Scissors;
+                    else if (name == "tit_for_tat")
+                        e = theirs;
+                    else if (name == "win_stay_lose_shift")
+                        e = (mine == (theirs + 1) % 3) ? mine : (theirs + 1) % 3;
+                    else if (name == "cycle")
+                        e = (mine + 1) % 3;
+                    else if (name == "beat_last")
+                        e = (theirs + 1) % 3;
+                    else
+                        throw std::invalid_argument("unknown memory-one strategy: " + name);
+                }
+            s.first = (name == "cycle") ? static_cast<unsigned char>(Rock) : s.table[0];
+            if (name == "tit_for_tat" || name == "win_stay_lose_shift" || name == "beat_last")
+                s.first = RANDOM_ENTRY;
+            return s;
+        }
+};
+
+/* Plays a memory-one strategy. Random entries are drawn from a
+ * counter-based stream, so a seeded player is repeatable and
+ * fingerprinted for the result cache. */
+class MemoryOnePlayer : public Player
+{
+public:
+    MemoryOnePlayer(const std::string& name,
+                    const MemoryOne& strategy,
+                    std::uint64_t seed=0) :
+        Player(name),
+        strategy_(strategy),
+        seed_(seed)
+        {}
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            return chooseFromRounds(*this, history, my_pos);
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            std::size_t r = view.size();
+            unsigned char e = (r == 0) ? strategy_.first
+                : strategy_.after(view.mine()[r - 1], view.theirs()[r - 1]);
+            if (e == RANDOM_ENTRY)
+                e = boundedValue(streamValue(seed_ ^ view.position(), r), 3);
+            return static_cast<Move>(e);
+        }
+
+    bool fingerprint(Fingerprint& fp) const
+        {
+            fp.add("MemoryOne").add(seed_).add(strategy_.first);
+            for (int k = 0; k < 9; ++k)
+                fp.add(strategy_.table[k]);
+            return true;
+        }
+
+    const MemoryOne& strategy() const { return strategy_; }
+
+private:
+    MemoryOne strategy_;
+    std::uint64_t seed_;
+};
+
+#endif
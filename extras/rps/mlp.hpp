@@ -0,0 +1,435 @@
+// A small quantized neural network which predicts the opponent's next
+// move from a window of recent rounds.
+//
+// The network is a multilayer perceptron trained offline and written
+// with writeMlpModel, which quantizes each weight row to int8 with a
+// float scale. Its input is the last `window` rounds, one-hot: slot k
+// holds the round k + 1 rounds ago, as opponent * 3 + own move. So the
+// first layer is a sum of `window` int8 weight columns, one per round,
+// and the later layers are int8 dot products with the activations
+// quantized to 0..127 after each ReLU. Inference uses fixed-size
+// buffers on the stack and allocates nothing.
+
+#ifndef RPS_EXTRAS_MLP_HPP
+#define RPS_EXTRAS_MLP_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "history.hpp"
+#include "rng.hpp"
+#include "rps.hpp"
+#include "simd.hpp"
+
+/* One layer in floats, as trained: weights[out][in] row by row. */
+struct MlpLayer
+{
+    std::size_t inputs, outputs;
+    std::vector<float> weights;
+    std::vector<float> bias;
+};
+
+static const std::size_t MLP_MAX_WINDOW = 32;
+static const std::size_t MLP_MAX_WIDTH = 256;
+static const std::size_t MLP_MAX_LAYERS = 5;
+
+/* Writes a model file: "RPSMLP01", uint32 window and layer count, the
+   uint32 layer sizes (9 * window inputs first, 3 outputs last), then
+   for each layer its float row scales, float biases and int8 weights
+   row by row. A weight row is scaled so that its largest magnitude
+   becomes 127.
+*/
+inline void writeMlpModel(const std::string& path,
+                          std::size_t window,
+                          const std::vector<MlpLayer>& layers)
+{
+    if (window == 0 || window > MLP_MAX_WINDOW)
+        throw std::invalid_argument("window must be between 1 and 32 rounds");
+    if (layers.empty() || layers.size() > MLP_MAX_LAYERS)
+        throw std::invalid_argument("a model has between 1 and 5 layers");
+    std::vector<std::uint32_t> header;
+    header.push_back(window);
+    header.push_back(layers.size());
+    header.push_back(9 * window);
+    for (std::size_t l = 0; l < layers.size(); ++l) {
+        const MlpLayer& layer = layers[l];
+        bool last = l + 1 == layers.size();
+        if (layer.inputs != header.back() || layer.outputs == 0 ||
+            layer.outputs > MLP_MAX_WIDTH || (last && layer.outputs != 3) ||
+            layer.weights.size() != layer.inputs * layer.outputs ||
+            layer.bias.size() != layer.outputs)
+            throw std::invalid_argument("layer sizes do not match");
+        header.push_back(layer.outputs);
+    }
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out.write("RPSMLP01", 8);
+    out.write(reinterpret_cast<const char*>(header.data()), header.size() * sizeof(std::uint32_t));
+    BOOST_FOREACH(const MlpLayer& layer, layers) {
+        std::vector<float> scales(layer.outputs);
+        std::vector<signed char> q(layer.weights.size());
+        for (std::size_t j = 0; j < layer.outputs; ++j) {
+            const float* row = &layer.weights[j * layer.inputs];
+            float largest = 0;
+            for (std::size_t i = 0; i < layer.inputs; ++i)
+                largest = std::max(largest, std::fabs(row[i]));
+            scales[j] = largest > 0 ? largest / 127 : 1;
+            for (std::size_t i = 0; i < layer.inputs; ++i)
+                q[j * layer.inputs + i] = static_cast<signed char>(std::lround(row[i] / scales[j]));
+        }
+        out.write(reinterpret_cast<const char*>(scales.data()), scales.size() * sizeof(float));
+        out.write(reinterpret_cast<const char*>(layer.bias.data()), layer.bias.size() * sizeof(float));
+        out.write(reinterpret_cast<const char*>(q.data()), q.size());
+    }
+    out.flush();
+    if (!out)
+        throw std::runtime_error("cannot write model " + path);
+}
+
+namespace detail {
+
+typedef short ShortLanes __attribute__((vector_size(32)));
+typedef short ShortHalf __attribute__((vector_size(16)));
+
+/* A layer in the padded layout inference runs on. Widths are padded
+   with zero weights, scales and biases, so every loop runs over whole
+   vectors and the padding computes to zero.
+
+   The first layer is kept by column, as int16, for summing one column
+   per round. The others are kept by row, as int8 for the AVX2 kernel,
+   or as floats holding the same integers for the generic one.
+*/
+struct MlpLayerData
+{
+    std::size_t inputs, outputs;
+    std::size_t stride;           // Padded row (or, first, column) length
+    std::vector<float> scales, bias;
+    std::vector<short> columns;
+    std::vector<signed char> rows;
+    std::vector<float> float_rows;
+};
+
+/* Padded widths: vectors of 32 activations, blocks of 4 rows. */
+inline std::size_t mlpPadded(std::size_t n, std::size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+/* ReLU, then the quantization of the activations to 0..127 by their
+ * largest one. Both kernels compute the same steps and the same
+ * integer sums, so they agree exactly. */
+inline float mlpStep(float largest)
+{
+    return largest > 0 ? largest / 127 : 1;
+}
+
+/* out[j] = dense layer j of the quantized, rectified `h` (padded to
+ * the layer's stride), for the padded outputs, which come to zero. */
+struct MlpDenseGeneric
+{
+    static void run(const float* h, const MlpLayerData& layer, float* out)
+        {
+            alignas(32) float act[MLP_MAX_WIDTH];
+            float largest = 0;
+            for (std::size_t i = 0; i < layer.stride; ++i)
+                largest = std::max(largest, h[i]);
+            const float step = mlpStep(largest), inverse = 1 / step;
+            for (std::size_t i = 0; i < layer.stride; ++i)
+                act[i] = std::int32_t(std::max(h[i], 0.0f) * inverse + 0.5f);
+            for (std::size_t j = 0; j < mlpPadded(layer.outputs, 32); ++j) {
+                // Integers below 2^24, so the float sum is exact.
+                float acc = j < layer.outputs ? dot(act, &layer.float_rows[j * layer.stride], layer.stride) : 0;
+                out[j] = acc * step * layer.scales[j] + layer.bias[j];
+            }
+        }
+};
+
+#ifdef RPS_HAVE_AVX2_KERNELS
+
+/* As MlpDenseGeneric, multiplying 32 activations by int8 weights per
+ * instruction, four rows at a time; no pair of products can saturate
+ * the 16-bit sums, as both factors are at most 127 in magnitude. */
+struct MlpDenseAvx2
+{
+    __attribute__((target("avx2")))
+    static void run(const float* h, const MlpLayerData& layer, float* out)
+        {
+            alignas(32) unsigned char act[MLP_MAX_WIDTH];
+            alignas(32) std::int32_t acc[MLP_MAX_WIDTH + 4];
+            const std::size_t stride = layer.stride;
+
+            __m256 top = _mm256_setzero_ps();
+            for (std::size_t i = 0; i < stride; i += 8)
+                top = _mm256_max_ps(top, _mm256_load_ps(h + i));
+            __m128 t = _mm_max_ps(_mm256_castps256_ps128(top), _mm256_extractf128_ps(top, 1));
+            t = _mm_max_ps(t, _mm_movehl_ps(t, t));
+            t = _mm_max_ss(t, _mm_shuffle_ps(t, t, 1));
+            const float step = mlpStep(_mm_cvtss_f32(t)), inverse = 1 / step;
+
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 scale = _mm256_set1_ps(inverse), half = _mm256_set1_ps(0.5f);
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            for (std::size_t i = 0; i < stride; i += 32) {
+                __m256i q[4];
+                for (int k = 0; k < 4; ++k) {
+                    __m256 v = _mm256_max_ps(_mm256_load_ps(h + i + 8 * k), zero);
+                    q[k] = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+                }
+                __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(q[0], q[1]),
+                                                     _mm256_packus_epi32(q[2], q[3]));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(act + i),
+                                   _mm256_permutevar8x32_epi32(packed, order));
+            }
+
+            const __m256i ones = _mm256_set1_epi16(1);
+            for (std::size_t j = 0; j < layer.outputs; j += 4) {
+                const signed char* row = &layer.rows[j * stride];
+                __m256i s[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(),
+                                 _mm256_setzero_si256(), _mm256_setzero_si256() };
+                for (std::size_t i = 0; i < stride; i += 32) {
+                    __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(act + i));
+                    for (int k = 0; k < 4; ++k) {
+                        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + k * stride + i));
+                        s[k] = _mm256_add_epi32(s[k], _mm256_madd_epi16(_mm256_maddubs_epi16(a, w), ones));
+                    }
+                }
+                __m256i sums = _mm256_hadd_epi32(_mm256_hadd_epi32(s[0], s[1]), _mm256_hadd_epi32(s[2], s[3]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + j),
+                                 _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1)));
+            }
+            for (std::size_t j = 0; j < mlpPadded(layer.outputs, 32); ++j)
+                out[j] = j < layer.outputs ? float(acc[j]) * step * layer.scales[j] + layer.bias[j] : 0;
+        }
+};
+
+#endif
+
+/* The forward pass, compiled once per kernel so that its vector code
+   is built for the instruction set the kernel runs on.
+*/
+template <typename Dense>
+__attribute__((always_inline))
+inline void mlpForward(const std::vector<MlpLayerData>& layers,
+                       std::size_t window,
+                       const unsigned char* mine,
+                       const unsigned char* theirs,
+                       std::size_t n,
+                       float* logits)
+{
+    alignas(32) short sums[MLP_MAX_WIDTH];
+    alignas(32) float h[MLP_MAX_WIDTH], next[MLP_MAX_WIDTH];
+
+    const MlpLayerData& first = layers[0];
+    const std::size_t width = first.stride;
+    for (std::size_t j = 0; j < width; j += 16)
+        storeLanes(sums + j, ShortLanes());
+    for (std::size_t k = 0; k < window && k < n; ++k) {
+        const std::size_t r = n - 1 - k;
+        const short* column = &first.columns[(k * 9 + theirs[r] * 3 + mine[r]) * width];
+        for (std::size_t j = 0; j < width; j += 16) {
+            ShortLanes s, c;
+            loadLanes(s, sums + j);
+            loadLanes(c, column + j);
+            storeLanes(sums + j, ShortLanes(s + c));
+        }
+    }
+    for (std::size_t j = 0; j < width; j += 8) {
+        ShortHalf half;
+        FloatLanes scale, bias;
+        loadLanes(half, sums + j);
+        loadLanes(scale, &first.scales[j]);
+        loadLanes(bias, &first.bias[j]);
+        FloatLanes s = __builtin_convertvector(half, FloatLanes);
+        storeLanes(h + j, FloatLanes(s * scale + bias));
+    }
+
+    float* in = h;
+    float* out = next;
+    for (std::size_t l = 1; l < layers.size(); ++l) {
+        Dense::run(in, layers[l], out);
+        std::swap(in, out);
+    }
+    std::copy(in, in + 3, logits);
+}
+
+inline void mlpForwardGeneric(const std::vector<MlpLayerData>& layers, std::size_t window,
+                              const unsigned char* mine, const unsigned char* theirs,
+                              std::size_t n, float* logits)
+{
+    mlpForward<MlpDenseGeneric>(layers, window, mine, theirs, n, logits);
+}
+
+#ifdef RPS_HAVE_AVX2_KERNELS
+
+__attribute__((target("avx2")))
+inline void mlpForwardAvx2(const std::vector<MlpLayerData>& layers, std::size_t window,
+                           const unsigned char* mine, const unsigned char* theirs,
+                           std::size_t n, float* logits)
+{
+    mlpForward<MlpDenseAvx2>(layers, window, mine, theirs, n, logits);
+}
+
+#endif
+
+}  // namespace detail
+
+/* A model file, loaded into the padded layout inference runs on. */
+class MlpModel : private boost::noncopyable
+{
+public:
+    explicit MlpModel(const std::string& path) :
+        avx2_(false)
+        {
+#ifdef RPS_HAVE_AVX2_KERNELS
+            avx2_ = detail::cpuHasAvx2();
+#endif
+            std::ifstream in(path.c_str(), std::ios::binary);
+            if (!in)
+                throw std::runtime_error("cannot open model " + path);
+            std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            Fingerprint fp;
+            BOOST_FOREACH(char c, bytes) {
+                fp.add(static_cast<unsigned char>(c));
+            }
+            digest_ = fp.value();
+
+            std::size_t pos = 8;
+            std::uint32_t window = 0, num_layers = 0;
+            if (bytes.size() < 16 || std::memcmp(&bytes[0], "RPSMLP01", 8) != 0 ||
+                !read(bytes, pos, &window, 1) || !read(bytes, pos, &num_layers, 1) ||
+                window == 0 || window > MLP_MAX_WINDOW || num_layers == 0 || num_layers > MLP_MAX_LAYERS)
+                throw std::runtime_error("not a model file: " + path);
+            window_ = window;
+            std::uint32_t sizes[MLP_MAX_LAYERS + 1];
+            if (!read(bytes, pos, sizes, num_layers + 1) || sizes[0] != 9 * window || sizes[num_layers] != 3)
+                throw std::runtime_error("not a model file: " + path);
+
+            layers_.resize(num_layers);
+            for (std::size_t l = 0; l < num_layers; ++l) {
+                detail::MlpLayerData& layer = layers_[l];
+                layer.inputs = sizes[l];
+                layer.outputs = sizes[l + 1];
+                if (layer.outputs == 0 || layer.outputs > MLP_MAX_WIDTH)
+                    throw std::runtime_error("not a model file: " + path);
+                const std::size_t padded_outputs = detail::mlpPadded(layer.outputs, 32);
+                layer.scales.assign(padded_outputs, 0);
+                layer.bias.assign(padded_outputs, 0);
+                std::vector<signed char> q(layer.inputs * layer.outputs);
+                if (!read(bytes, pos, &layer.scales[0], layer.outputs) ||
+                    !read(bytes, pos, &layer.bias[0], layer.outputs) ||
+                    !read(bytes, pos, &q[0], q.size()))
+                    throw std::runtime_error("truncated model file: " + path);
+
+                if (l == 0) {
+                    layer.stride = padded_outputs;
+                    layer.columns.assign(layer.inputs * layer.stride, 0);
+                    for (std::size_t j = 0; j < layer.outputs; ++j)
+                        for (std::size_t i = 0; i < layer.inputs; ++i)
+                            layer.columns[i * layer.stride + j] = q[j * layer.inputs + i];
+                    continue;
+                }
+                layer.stride = detail::mlpPadded(layer.inputs, 32);
+                if (avx2_)
+                    layer.rows.assign(detail::mlpPadded(layer.outputs, 4) * layer.stride, 0);
+                else
+                    layer.float_rows.assign(layer.outputs * layer.stride, 0);
+                for (std::size_t j = 0; j < layer.outputs; ++j)
+                    for (std::size_t i = 0; i < layer.inputs; ++i) {
+                        if (avx2_)
+                            layer.rows[j * layer.stride + i] = q[j * layer.inputs + i];
+                        else
+                            layer.float_rows[j * layer.stride + i] = q[j * layer.inputs + i];
+                    }
+            }
+            if (pos != bytes.size())
+                throw std::runtime_error("not a model file: " + path);
+        }
+
+    std::size_t window() const { return window_; }
+    std::size_t numLayers() const { return layers_.size(); }
+    std::uint64_t digest() const { return digest_; }
+
+    /* The logits of the opponent's next move after the `n` rounds of
+     * `mine` and `theirs`. */
+    void logits(const unsigned char* mine,
+                const unsigned char* theirs,
+                std::size_t n,
+                float* out) const
+        {
+#ifdef RPS_HAVE_AVX2_KERNELS
+            if (avx2_)
+                return detail::mlpForwardAvx2(layers_, window_, mine, theirs, n, out);
+#endif
+            detail::mlpForwardGeneric(layers_, window_, mine, theirs, n, out);
+        }
+
+private:
+    template <typename T>
+    static bool read(const std::vector<char>& bytes, std::size_t& pos, T* out, std::size_t n)
+        {
+            if (bytes.size() - pos < n * sizeof(T))
+                return false;
+            std::memcpy(out, &bytes[pos], n * sizeof(T));
+            pos += n * sizeof(T);
+            return true;
+        }
+
+    bool avx2_;
+    std::size_t window_;
+    std::vector<detail::MlpLayerData> layers_;
+    std::uint64_t digest_;
+};
+
+/* Plays the move that beats the model's likeliest prediction. */
+class MlpPlayer : public Player
+{
+public:
+    MlpPlayer(const std::string& name, const std::shared_ptr<const MlpModel>& model) :
+        Player(name),
+        model_(model)
+        {
+            if (!model)
+                throw std::invalid_argument("an MLP player needs a model");
+        }
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            return chooseFromRounds(*this, history, my_pos);
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            float logits[3];
+            model_->logits(view.mine(), view.theirs(), view.size(), logits);
+            unsigned predicted = (logits[1] > logits[0]) ? 1 : 0;
+            if (logits[2] > logits[predicted])
+                predicted = 2;
+            return static_cast<Move>((predicted + 1) % 3);
+        }
+
+    bool fingerprint(Fingerprint& fp) const
+        {
+            fp.add("Mlp").add(model_->digest());
+            return true;
+        }
+
+    const std::shared_ptr<const MlpModel>& model() const { return model_; }
+
+private:
+    std::shared_ptr<const MlpModel> model_;
+};
+
+#endif
@@ -0,0 +1,242 @@
+// Free-for-all rock-paper-scissors with more than two players.
+//
+// Every round all seats move simultaneously, and a seat scores one
+// point for each other seat it beats and loses one for each seat that
+// beats it. The history is stored column-wise, one contiguous byte
+// array of moves per seat, so a player scanning one seat's moves reads
+// only that seat's bytes, and scoring runs across rounds with byte
+// compares that vectorize.
+
+#ifndef RPS_EXTRAS_MULTIPLAYER_HPP
+#define RPS_EXTRAS_MULTIPLAYER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rng.hpp"
+#include "rps.hpp"
+
+/* The moves of all seats, one column per seat. Storage for all rounds
+ * is reserved up front, so columns never move during a match. */
+class SeatHistory
+{
+public:
+    SeatHistory(std::size_t num_seats, std::size_t capacity) :
+        num_seats_(num_seats),
+        capacity_(capacity),
+        rounds_(0),
+        moves_(num_seats * capacity)
+        {}
+
+    std::size_t numSeats() const { return num_seats_; }
+    std::size_t rounds() const { return rounds_; }
+    std::size_t capacity() const { return capacity_; }
+
+    /* The moves of `seat`, one byte per round played so far. */
+    const unsigned char* column(std::size_t seat) const
+        {
+            return moves_.empty() ? 0 : &moves_[seat * capacity_];
+        }
+
+    /* Records one round; `moves` holds a move per seat. */
+    void append(const unsigned char* moves)
+        {
+            if (rounds_ == capacity_)
+                throw std::length_error("seat history is full");
+            for (std::size_t s = 0; s < num_seats_; ++s)
+                moves_[s * capacity_ + rounds_] = moves[s];
+            ++rounds_;
+        }
+
+    /* Hands over the underlying seats x capacity block. */
+    std::vector<unsigned char>& data() { return moves_; }
+
+private:
+    std::size_t num_seats_, capacity_, rounds_;
+    std::vector<unsigned char> moves_;
+};
+
+/* A seat's view of the history: its own column and its opponents'
+   columns, numbered from the seat after it. Nothing is copied.
+*/
+class SeatView
+{
+public:
+    SeatView(const SeatHistory& history, std::size_t seat) :
+        history_(&history),
+        seat_(seat)
+        {}
+
+    std::size_t seat() const { return seat_; }
+    std::size_t numSeats() const { return history_->numSeats(); }
+    std::size_t rounds() const { return history_->rounds(); }
+
+    const unsigned char* mine() const { return history_->column(seat_); }
+
+    /* The k-th opponent, 0 <= k < numSeats() - 1. */
+    const unsigned char* opponent(std::size_t k) const
+        {
+            return history_->column((seat_ + 1 + k) % numSeats());
+        }
+
+    std::size_t opponentSeat(std::size_t k) const
+        {
+            return (seat_ + 1 + k) % numSeats();
+        }
+
+private:
+    const SeatHistory* history_;
+    std::size_t seat_;
+};
+
+/* The Player interface for free-for-all games. */
+class SeatPlayer
+{
+public:
+    SeatPlayer(const std::string& name) : name_(name) {}
+    virtual ~SeatPlayer() {}
+
+    virtual Move nextMove(const SeatView& view) const = 0;
+
+    std::string name() const { return name_; }
+    void setName(const std::string& n) { name_ = n; }
+
+private:
+    std::string name_;
+};
+
+/* Plays uniformly at random from a seeded stream. */
+class SeatRandom : public SeatPlayer
+{
+public:
+    SeatRandom(const std::string& name, std::uint64_t seed=0) :
+        SeatPlayer(name),
+        seed_(seed)
+        {}
+
+    Move nextMove(const SeatView& view) const
+        {
+            return static_cast<Move>(
+                boundedValue(streamValue(seed_ ^ view.seat(), view.rounds()), 3));
+        }
+
+private:
+    std::uint64_t seed_;
+};
+
+/* Plays whatever beats the move most opponents made last round. */
+class BeatPlurality : public SeatPlayer
+{
+public:
+    BeatPlurality(const std::string& name) : SeatPlayer(name) {}
+
+    Move nextMove(const SeatView& view) const
+        {
+            std::size_t r = view.rounds();
+            if (r == 0)
+                return Rock;
+
+            std::size_t counts[3] = {0, 0, 0};
+            for (std::size_t k = 0; k + 1 < view.numSeats(); ++k)
+                ++counts[view.opponent(k)[r - 1]];
+            Move plurality = Rock;
+            for (int m = Paper; m <= Scissors; ++m)
+                if (counts[m] > counts[plurality])
+                    plurality = static_cast<Move>(m);
+            return static_cast<Move>((plurality + 1) % 3);
+        }
+};
+
+/* Always plays the same move. */
+class FixedSeat : public SeatPlayer
+{
+public:
+    FixedSeat(const std::string& name, Move move) :
+        SeatPlayer(name),
+        move_(move)
+        {}
+
+    Move nextMove(const SeatView&) const { return move_; }
+
+private:
+    Move move_;
+};
+
+/* Scores a free-for-all history. Returns each seat's total of
+   (seats beaten - seats beaten by) over all rounds.
+
+   Per round, the number of seats playing each move is counted with
+   byte compares down the columns; a seat playing m then scores
+   count[(m + 2) % 3] - count[(m + 1) % 3]. Both passes run across
+   rounds, so they vectorize.
+*/
+inline std::vector<std::int64_t> scoreSeats(const SeatHistory& history)
+{
+    const std::size_t n = history.numSeats();
+    const std::size_t rounds = history.rounds();
+    const std::size_t BLOCK = 4096;
+
+    std::vector<std::int64_t> totals(n, 0);
+    std::vector<std::int16_t> counts(3 * BLOCK);
+    std::int16_t* rock = &counts[0];
+    std::int16_t* paper = &counts[BLOCK];
+    std::int16_t* scissors = &counts[2 * BLOCK];
+
+    for (std::size_t start = 0; start < rounds; start += BLOCK) {
+        const std::size_t len = std::min(BLOCK, rounds - start);
+        std::fill(counts.begin(), counts.end(), 0);
+
+        for (std::size_t s = 0; s < n; ++s) {
+            const unsigned char* col = history.column(s) + start;
+            for (std::size_t r = 0; r < len; ++r) {
+                rock[r] += (col[r] == Rock);
+                paper[r] += (col[r] == Paper);
+                scissors[r] += (col[r] == Scissors);
+            }
+        }
+
+        for (std::size_t s = 0; s < n; ++s) {
+            const unsigned char* col = history.column(s) + start;
+            std::int64_t total = 0;
+            for (std::size_t r = 0; r < len; ++r) {
+                int m = col[r];
+                int beaten = (m == Rock) ? scissors[r] : (m == Paper) ? rock[r] : paper[r];
+                int beating = (m == Rock) ? paper[r] : (m == Paper) ? scissors[r] : rock[r];
+                total += beaten - beating;
+            }
+            totals[s] = totals[s] + total;
+        }
+    }
+    return totals;
+}
+
+/* Plays a free-for-all match, filling `history` (which must have room
+   for `num_rounds` rounds) and returning each seat's score.
+*/
+inline std::vector<std::int64_t> playSeats(const std::vector<const SeatPlayer*>& players,
+                                           std::size_t num_rounds,
+                                           SeatHistory& history)
+{
+    const std::size_t n = players.size();
+    if (n < 2)
+        throw std::invalid_argument("a free-for-all needs at least two players");
+    if (history.numSeats() != n || history.capacity() < num_rounds)
+        throw std::invalid_argument("history does not fit the match");
+
+    std::vector<unsigned char> moves(n);
+    for (std::size_t r = 0; r < num_rounds; ++r) {
+        for (std::size_t s = 0; s < n; ++s) {
+            Move m = players[s]->nextMove(SeatView(history, s));
+            if (m < Rock || m > Scissors)
+                throw std::out_of_range("player made an invalid move");
+            moves[s] = static_cast<unsigned char>(m);
+        }
+        history.append(&moves[0]);
+    }
+    return scoreSeats(history);
+}
+
+#endif
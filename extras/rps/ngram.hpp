@@ -0,0 +1,458 @@
+// N-gram models of play, trained offline on recorded rounds.
+//
+// A round log is one byte per round, p1 * 3 + p2, with ROUND_BREAK
+// between matches; logs have no header, so concatenated logs are a log.
+// An NGramTrainer counts, for every context of up to `order` rounds
+// (never reaching back past the start of a match), the next move of the
+// player the context is seen from, the "subject". Each worker counts a
+// slice of the log into its own tables, split into shards by key hash,
+// and the shards are merged in parallel when the model is written.
+//
+// The model file is an open-addressing hash table laid out to be used
+// in place: an NGramModel maps it and is ready at once, and any number
+// of NGramPlayers, in any number of processes, share the one mapping.
+
+#ifndef RPS_EXTRAS_NGRAM_HPP
+#define RPS_EXTRAS_NGRAM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "mapped_file.hpp"
+#include "rng.hpp"
+#include "rps.hpp"
+#include "thread_pool.hpp"
+
+// Separates matches in a round log.
+static const unsigned char ROUND_BREAK = 0xff;
+
+// Contexts of up to this many rounds fit a key.
+static const unsigned NGRAM_MAX_ORDER = 16;
+
+inline unsigned char packRound(Move p1, Move p2)
+{
+    return static_cast<unsigned char>(p1 * 3 + p2);
+}
+
+namespace detail {
+
+/* Contexts are base-9 numbers of rounds, oldest first, each round
+ * subject * 3 + other; the key adds the context length, so that keys
+ * of different orders differ and no key is 0, which marks a free
+ * slot. */
+inline std::uint64_t ngramKey(std::uint64_t context, unsigned order)
+{
+    return context << 5 | (order + 1);
+}
+
+inline std::uint64_t power9(unsigned n)
+{
+    std::uint64_t p = 1;
+    while (n--)
+        p *= 9;
+    return p;
+}
+
+/* Next-move counts by key, with linear probing. */
+class NGramCounts
+{
+public:
+    NGramCounts() :
+        keys_(16, 0),
+        counts_(16 * 3, 0),
+        size_(0)
+        {}
+
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return keys_.size(); }
+    std::uint64_t keyAt(std::size_t slot) const { return keys_[slot]; }
+    const std::uint64_t* countsAt(std::size_t slot) const { return &counts_[slot * 3]; }
+
+    void add(std::uint64_t key, std::uint64_t hash, unsigned move, std::uint64_t n)
+        {
+            slotFor(key, hash)[move] += n;
+        }
+
+    void merge(const NGramCounts& other)
+        {
+            for (std::size_t s = 0; s < other.capacity(); ++s) {
+                std::uint64_t key = other.keys_[s];
+                if (key == 0)
+                    continue;
+                std::uint64_t* c = slotFor(key, mix64(key));
+                for (int m = 0; m < 3; ++m)
+                    c[m] += other.counts_[s * 3 + m];
+            }
+        }
+
+private:
+    std::uint64_t* slotFor(std::uint64_t key, std::uint64_t hash)
+        {
+            std::size_t mask = keys_.size() - 1;
+            for (std::size_t s = hash & mask; ; s = (s + 1) & mask) {
+                if (keys_[s] == key)
+                    return &counts_[s * 3];
+                if (keys_[s] == 0) {
+                    // Keep the load at most a half.
+                    if (2 * (size_ + 1) > keys_.size()) {
+                        grow();
+                        return slotFor(key, hash);
+                    }
+                    keys_[s] = key;
+                    ++size_;
+                    return &counts_[s * 3];
+                }
+            }
+        }
+
+    void grow()
+        {
+            std::vector<std::uint64_t> keys(keys_.size() * 2, 0), counts(counts_.size() * 2, 0);
+            keys.swap(keys_);
+            counts.swap(counts_);
+            size_ = 0;
+            for (std::size_t s = 0; s < keys.size(); ++s) {
+                if (keys[s] == 0)
+                    continue;
+                std::uint64_t* c = slotFor(keys[s], mix64(keys[s]));
+                std::copy(&counts[s * 3], &counts[s * 3] + 3, c);
+            }
+        }
+
+    std::vector<std::uint64_t> keys_;
+    std::vector<std::uint64_t> counts_;
+    std::size_t size_;
+};
+
+}  // namespace detail
+
+/* Written by NGramTrainer::write. */
+struct NGramSummary
+{
+    std::size_t contexts;         // Distinct contexts in the model
+    std::uint64_t rounds;         // Rounds trained on
+    std::uint64_t digest;
+};
+
+class NGramTrainer : private boost::noncopyable
+{
+public:
+    /* Counts contexts of up to `order` rounds. With `both_seats`, each
+     * round is counted from both players' side; otherwise only from
+     * player 1's. */
+    NGramTrainer(unsigned order, bool both_seats) :
+        order_(order),
+        both_seats_(both_seats),
+        rounds_(0)
+        {
+            if (order > NGRAM_MAX_ORDER)
+                throw std::invalid_argument("n-gram order is at most 16");
+        }
+
+    unsigned order() const { return order_; }
+    bool bothSeats() const { return both_seats_; }
+    std::uint64_t rounds() const { return rounds_; }
+
+    /* Counts the `n` rounds of a log. A log that holds anything but
+       rounds and breaks is rejected before any of it is counted.
+
+       Each slice of the log reads back from its start, up to the last
+       break, for the context of its first rounds, so the counts do not
+       depend on where the slices fall.
+    */
+    void add(const unsigned char* log, std::size_t n, ThreadPool& pool)
+        {
+            const std::size_t num_slices = std::max<std::size_t>(1, std::min(pool.size() + 1, n / MIN_SLICE));
+            std::atomic<bool> bad(false);
+            parallelFor(pool, num_slices, [&](std::size_t t) {
+                    for (std::size_t i = t * n / num_slices, end = (t + 1) * n / num_slices; i < end; ++i)
+                        if (log[i] > 8 && log[i] != ROUND_BREAK) {
+                            bad = true;
+                            return;
+                        }
+                });
+            if (bad)
+                throw std::invalid_argument("round log holds a byte that is neither a round nor a break");
+
+            if (tables_.size() < num_slices)
+                tables_.resize(num_slices, std::vector<detail::NGramCounts>(NUM_SHARDS));
+            std::vector<std::uint64_t> counted(num_slices, 0);
+            parallelFor(pool, num_slices, [&](std::size_t t) {
+                    counted[t] = countSlice(log, t * n / num_slices, (t + 1) * n / num_slices,
+                                            tables_[t]);
+                });
+            for (std::size_t t = 0; t < num_slices; ++t)
+                rounds_ += counted[t];
+        }
+
+    /* Merges the counts and writes them as a model file: "RPSNGRAM",
+       six uint64s (order, both seats, capacity, contexts, rounds and a
+       digest of the counts), then `capacity` uint64 keys, 0 for a free
+       slot, then three uint32 counts per slot. A context's slot is the
+       first free or matching one from mix64(key) modulo the capacity,
+       a power of two. Entries whose counts overflow a uint32 are scaled
+       down together.
+
+       The file is the same whatever the number of threads, as each
+       merged shard is sorted before it is laid out. It replaces any old
+       file at `path` with `replaceFile`, so that models mapping the old
+       one keep reading it whole.
+    */
+    NGramSummary write(const std::string& path, ThreadPool& pool) const
+        {
+            typedef std::pair<std::uint64_t, const std::uint64_t*> Entry;
+            std::vector<detail::NGramCounts> merged(NUM_SHARDS);
+            std::vector<std::vector<Entry> > entries(NUM_SHARDS);
+            parallelFor(pool, NUM_SHARDS, [&](std::size_t s) {
+                    for (std::size_t t = 0; t < tables_.size(); ++t)
+                        merged[s].merge(tables_[t][s]);
+                    for (std::size_t slot = 0; slot < merged[s].capacity(); ++slot)
+                        if (merged[s].keyAt(slot))
+                            entries[s].push_back(Entry(merged[s].keyAt(slot), merged[s].countsAt(slot)));
+                    std::sort(entries[s].begin(), entries[s].end());
+                });
+
+            std::size_t num_entries = 0;
+            for (std::size_t s = 0; s < NUM_SHARDS; ++s)
+                num_entries += entries[s].size();
+            std::size_t capacity = 16;
+            while (capacity < 2 * num_entries)
+                capacity *= 2;
+
+            std::vector<std::uint64_t> keys(capacity, 0);
+            std::vector<std::uint32_t> counts(capacity * 3, 0);
+            std::uint64_t digest = mix64(order_ * 2 + both_seats_);
+            for (std::size_t s = 0; s < NUM_SHARDS; ++s) {
+                for (std::size_t e = 0; e < entries[s].size(); ++e) {
+                    std::uint64_t key = entries[s][e].first;
+                    const std::uint64_t* c = entries[s][e].second;
+                    std::uint64_t largest = std::max(c[0], std::max(c[1], c[2]));
+                    std::uint64_t divisor = largest / std::numeric_limits<std::uint32_t>::max() + 1;
+                    std::size_t slot = mix64(key) & (capacity - 1);
+                    while (keys[slot])
+                        slot = (slot + 1) & (capacity - 1);
+                    keys[slot] = key;
+                    digest = mix64(digest ^ key);
+                    for (int m = 0; m < 3; ++m) {
+                        counts[slot * 3 + m] = std::uint32_t(c[m] / divisor);
+                        digest = mix64(digest ^ counts[slot * 3 + m]);
+                    }
+                }
+            }
+
+            std::uint64_t header[6] = { order_, both_seats_, capacity, num_entries, rounds_, digest };
+            if (!replaceFile(path, { {"RPSNGRAM", 8},
+                                     {header, sizeof(header)},
+                                     {keys.data(), keys.size() * sizeof(std::uint64_t)},
+                                     {counts.data(), counts.size() * sizeof(std::uint32_t)} }))
+                throw std::runtime_error("cannot write n-gram model " + path);
+
+            NGramSummary rslt = { num_entries, rounds_, digest };
+            return rslt;
+        }
+
+private:
+    static const std::size_t NUM_SHARDS = 64;
+    static const std::size_t MIN_SLICE = 1 << 16;
+
+    // Counts the rounds in [begin, end), returning how many there were.
+    std::uint64_t countSlice(const unsigned char* log,
+                             std::size_t begin,
+                             std::size_t end,
+                             std::vector<detail::NGramCounts>& shards) const
+        {
+            const std::uint64_t top = detail::power9(order_);
+            std::uint64_t context = 0, swapped = 0;
+            unsigned len = 0;
+            std::size_t start = begin;
+            while (start > 0 && begin - start < order_ && log[start - 1] != ROUND_BREAK)
+                --start;
+            for (std::size_t i = start; i < begin; ++i) {
+                context = context * 9 + log[i];
+                swapped = swapped * 9 + (log[i] % 3) * 3 + log[i] / 3;
+                ++len;
+            }
+
+            std::uint64_t counted = 0;
+            for (std::size_t i = begin; i < end; ++i) {
+                const unsigned r = log[i];
+                if (r == ROUND_BREAK) {
+                    context = swapped = 0;
+                    len = 0;
+                    continue;
+                }
+                const unsigned p1 = r / 3, p2 = r % 3;
+                std::uint64_t p = 1;
+                for (unsigned j = 0; j <= len; ++j, p *= 9) {
+                    count(shards, detail::ngramKey(context % p, j), p1);
+                    if (both_seats_)
+                        count(shards, detail::ngramKey(swapped % p, j), p2);
+                }
+                context = (context * 9 + r) % top;
+                swapped = (swapped * 9 + p2 * 3 + p1) % top;
+                len = std::min(len + 1, order_);
+                ++counted;
+            }
+            return counted;
+        }
+
+    static void count(std::vector<detail::NGramCounts>& shards, std::uint64_t key, unsigned move)
+        {
+            std::uint64_t hash = mix64(key);
+            // The top bits pick the shard, the low ones the slot in it.
+            shards[hash >> 58].add(key, hash, move, 1);
+        }
+
+    unsigned order_;
+    bool both_seats_;
+    std::uint64_t rounds_;
+    std::vector<std::vector<detail::NGramCounts> > tables_;  // By slice, then shard
+};
+
+/* A model file, mapped read-only. */
+class NGramModel : private boost::noncopyable
+{
+public:
+    explicit NGramModel(const std::string& path) :
+        file_(path)
+        {
+            std::uint64_t header[6];
+            if (file_.size() < 8 + sizeof(header) || std::memcmp(file_.data(), "RPSNGRAM", 8) != 0)
+                throw std::runtime_error("not an n-gram model: " + path);
+            std::memcpy(header, file_.data() + 8, sizeof(header));
+            order_ = header[0];
+            both_seats_ = header[1];
+            capacity_ = header[2];
+            size_ = header[3];
+            rounds_ = header[4];
+            digest_ = header[5];
+            if (order_ > NGRAM_MAX_ORDER || capacity_ == 0 || (capacity_ & (capacity_ - 1)) ||
+                size_ >= capacity_ || capacity_ > file_.size() ||
+                file_.size() != 8 + sizeof(header) + capacity_ * (sizeof(std::uint64_t) + 3 * sizeof(std::uint32_t)))
+                throw std::runtime_error("not an n-gram model: " + path);
+            keys_ = reinterpret_cast<const std::uint64_t*>(file_.data() + 8 + sizeof(header));
+            counts_ = reinterpret_cast<const std::uint32_t*>(keys_ + capacity_);
+        }
+
+    unsigned order() const { return order_; }
+    bool bothSeats() const { return both_seats_; }
+    std::size_t size() const { return size_; }
+    std::uint64_t rounds() const { return rounds_; }
+    std::uint64_t digest() const { return digest_; }
+
+    /* The counts of the subject's next move after the `order` rounds
+     * coded in `context`, or null if the context never occurred. The
+     * probe stops after `capacity` slots, in case a damaged file has no
+     * free one. */
+    const std::uint32_t* lookup(std::uint64_t context, unsigned order) const
+        {
+            const std::uint64_t key = detail::ngramKey(context, order);
+            const std::size_t mask = capacity_ - 1;
+            std::size_t s = mix64(key) & mask;
+            for (std::size_t i = 0; i < capacity_ && keys_[s]; ++i, s = (s + 1) & mask)
+                if (keys_[s] == key)
+                    return counts_ + s * 3;
+            return 0;
+        }
+
+    /* The counts after the longest context ending `rounds` (n codes,
+     * subject * 3 + other, oldest first) seen at least `min_count`
+     * times, or null if there is none. */
+    const std::uint32_t* longest(const unsigned char* rounds,
+                                 std::size_t n,
+                                 std::uint32_t min_count) const
+        {
+            const unsigned len = std::min<std::size_t>(n, order_);
+            std::uint64_t context = 0, p = 1;
+            for (std::size_t i = n - len; i < n; ++i, p *= 9)
+                context = context * 9 + rounds[i];
+            for (unsigned j = len; ; --j) {
+                const std::uint32_t* c = lookup(context, j);
+                if (c && std::uint64_t(c[0]) + c[1] + c[2] >= min_count)
+                    return c;
+                if (j == 0)
+                    return 0;
+                p /= 9;
+                context %= p;
+            }
+        }
+
+private:
+    MappedFile file_;
+    unsigned order_;
+    bool both_seats_;
+    std::size_t capacity_, size_;
+    std::uint64_t rounds_, digest_;
+    const std::uint64_t* keys_;
+    const std::uint32_t* counts_;
+};
+
+/* Predicts the opponent's next move from the longest context of recent
+   rounds that the model has seen at least `min_count` times, backing
+   off to shorter ones, and plays the move that beats it. Deterministic
+   and allocation-free.
+*/
+class NGramPlayer : public Player
+{
+public:
+    NGramPlayer(const std::string& name,
+                const std::shared_ptr<const NGramModel>& model,
+                std::uint32_t min_count=1) :
+        Player(name),
+        model_(model),
+        min_count_(std::max<std::uint32_t>(min_count, 1))
+        {
+            if (!model)
+                throw std::invalid_argument("an n-gram player needs a model");
+        }
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            return chooseFromRounds(*this, history, my_pos);
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            const std::size_t n = view.size();
+            const std::size_t len = std::min<std::size_t>(n, model_->order());
+            // The opponent is the subject.
+            unsigned char rounds[NGRAM_MAX_ORDER];
+            for (std::size_t i = 0; i < len; ++i)
+                rounds[i] = view.theirs()[n - len + i] * 3 + view.mine()[n - len + i];
+
+            const std::uint32_t* c = model_->longest(rounds, len, min_count_);
+            if (!c)
+                return Paper;
+            unsigned predicted = (c[1] > c[0]) ? 1 : 0;
+            if (c[2] > c[predicted])
+                predicted = 2;
+            return static_cast<Move>((predicted + 1) % 3);
+        }
+
+    bool fingerprint(Fingerprint& fp) const
+        {
+            fp.add("NGram").add(model_->digest()).add(min_count_);
+            return true;
+        }
+
+    const std::shared_ptr<const NGramModel>& model() const { return model_; }
+    std::uint32_t minCount() const { return min_count_; }
+
+private:
+    std::shared_ptr<const NGramModel> model_;
+    std::uint32_t min_count_;
+};
+
+#endif
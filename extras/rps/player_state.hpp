@@ -0,0 +1,99 @@
+// Per-match state for stateful players.
+//
+// A player that learns during a match keeps what it has learned in a
+// PlayerState held by the match, not by the player, so one player can
+// take part in any number of matches at once.
+
+#ifndef RPS_EXTRAS_PLAYER_STATE_HPP
+#define RPS_EXTRAS_PLAYER_STATE_HPP
+
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+#include <utility>
+
+#include <boost/noncopyable.hpp>
+
+/* The state a stateful player keeps for one seat of one match. */
+class PlayerState
+{
+public:
+    virtual ~PlayerState() {}
+};
+
+/* Holds a stateful player's PlayerState for one seat. A match has one
+   for each seat (a MatchContext's, or playRounds' own), so the state belongs to the match rather than
+   to the player, and one player can take part in many matches at once.
+
+   The state outlives its match so that later matches can reuse it:
+   `get` hands back whatever state of the requested type is in the
+   slot, and players start it afresh when the history is empty. The
+   owner is only compared, so any kind of player can use a slot.
+*/
+class PlayerStateSlot : private boost::noncopyable
+{
+public:
+    PlayerStateSlot() : owner_(0) {}
+
+    template <typename State, typename Owner>
+    State& get(const Owner& owner)
+        {
+            if (!state_ || typeid(*state_) != typeid(State))
+                state_.reset(new State());
+            owner_ = &owner;
+            return static_cast<State&>(*state_);
+        }
+
+    /* The state `owner` used last, or null if another player has used
+     * the slot since. */
+    template <typename State, typename Owner>
+    const State* find(const Owner& owner) const
+        {
+            if (owner_ != static_cast<const void*>(&owner) || !state_ || typeid(*state_) != typeid(State))
+                return 0;
+            return static_cast<const State*>(state_.get());
+        }
+
+private:
+    const void* owner_;
+    std::unique_ptr<PlayerState> state_;
+};
+
+/* Where a stateful player finds its state. Matches carry a slot for
+   each seat; calls without one (`nextMove` called directly) share one
+   slot per seat kept here, and take turns under a lock.
+*/
+template <typename State>
+class SeatStates : private boost::noncopyable
+{
+public:
+    template <typename Owner, typename F>
+    auto apply(const Owner& owner,
+               PlayerStateSlot* slot,
+               unsigned char my_pos,
+               F f) const -> decltype(f(std::declval<State&>()))
+        {
+            if (slot)
+                return f(slot->get<State>(owner));
+            std::lock_guard<std::mutex> lock(mutex_);
+            return f(fallback_[my_pos & 1].template get<State>(owner));
+        }
+
+    /* Calls `f` with the state the direct calls in seat `my_pos` left,
+     * if there is one. Returns whether there was. */
+    template <typename Owner, typename F>
+    bool inspect(const Owner& owner, unsigned char my_pos, F f) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const State* state = fallback_[my_pos & 1].template find<State>(owner);
+            if (state)
+                f(*state);
+            return state != 0;
+        }
+
+private:
+    mutable std::mutex mutex_;
+    mutable PlayerStateSlot fallback_[2];
+};
+
+#endif
@@ -0,0 +1,163 @@
+// Adaptive top-k ranking by racing.
+//
+// A player's strength is its expected score against an opponent drawn
+// uniformly from the rest of the field (its Borda score), which a full
+// round-robin measures exactly. Racing estimates it instead, spending
+// matches only on players whose place relative to the top k is still
+// in doubt, and stops as soon as the top k is known with the requested
+// confidence.
+
+#ifndef RPS_EXTRAS_RACING_HPP
+#define RPS_EXTRAS_RACING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "ratings.hpp"
+#include "rng.hpp"
+#include "rps.hpp"
+#include "thread_pool.hpp"
+#include "tournament.hpp"
+
+/* The outcome of a race. `top` holds the k best players, best first,
+ * and `confident` says whether the race finished before its budget ran
+ * out. */
+struct RaceResult
+{
+    std::vector<std::size_t> top;
+    std::vector<double> score;           // Estimated Borda score per player
+    std::vector<std::size_t> matches;    // Matches played per player
+    std::size_t total_matches;
+    std::size_t round_robin_matches;
+    bool confident;
+};
+
+/* Races `players` for the top `k` places.
+
+   Every batch draws a uniformly random pairing of the whole field, so
+   each player's opponent is a uniform draw, and keeps the matches
+   involving at least one undecided player. A player is decided once
+   its Hoeffding confidence interval lies entirely above or entirely
+   below the boundary between places k and k+1; the bounds hold
+   simultaneously for all players and batches with probability
+   1 - `delta`. Each player plays at most one match per batch, so
+   stateful players are safe, and a batch's matches run in parallel.
+
+   The race stops when every player is decided or after `max_matches`
+   matches (0 meaning as many as a full round-robin).
+*/
+inline RaceResult race(const std::vector<const Player*>& players,
+                       std::size_t k,
+                       std::size_t num_rounds,
+                       double delta,
+                       std::size_t max_matches,
+                       std::uint64_t seed,
+                       ThreadPool& pool,
+                       std::atomic<bool>& stop)
+{
+    const std::size_t n = players.size();
+    if (n < 2 || k == 0 || k >= n)
+        throw std::invalid_argument("racing needs 0 < k < number of players");
+    if (delta <= 0 || delta >= 1)
+        throw std::invalid_argument("delta must be in (0, 1)");
+
+    RaceResult rslt;
+    rslt.round_robin_matches = n * (n - 1) / 2;
+    rslt.total_matches = 0;
+    rslt.confident = false;
+    rslt.matches.assign(n, 0);
+    if (max_matches == 0)
+        max_matches = rslt.round_robin_matches;
+
+    std::vector<double> total(n, 0.0), lower(n), upper(n);
+    std::vector<std::size_t> order(n), by_lower(n), by_upper(n);
+    std::vector<bool> undecided(n, true);
+    const double inf = std::numeric_limits<double>::infinity();
+
+    for (std::uint64_t batch = 0; ; ++batch) {
+        for (std::size_t i = 0; i < n; ++i) {
+            double m = rslt.matches[i];
+            if (m == 0) {
+                lower[i] = -inf;
+                upper[i] = inf;
+            } else {
+                double radius = std::sqrt(std::log(4 * n * m * m / delta) / (2 * m));
+                lower[i] = total[i] / m - radius;
+                upper[i] = total[i] / m + radius;
+            }
+        }
+
+        // Player i is surely in the top k if its lower bound beats the
+        // (k+1)-th highest upper bound of the others, and surely out
+        // if its upper bound is below the k-th highest lower bound.
+        for (std::size_t i = 0; i < n; ++i)
+            by_lower[i] = by_upper[i] = i;
+        std::nth_element(by_upper.begin(), by_upper.begin() + k, by_upper.end(),
+                         [&](std::size_t a, std::size_t b) { return upper[a] > upper[b]; });
+        std::nth_element(by_lower.begin(), by_lower.begin() + (k - 1), by_lower.end(),
+                         [&](std::size_t a, std::size_t b) { return lower[a] > lower[b]; });
+        double upper_k1 = upper[by_upper[k]];
+        double lower_k = lower[by_lower[k - 1]];
+
+        std::size_t num_undecided = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            bool in = lower[i] > upper_k1;
+            bool out = upper[i] < lower_k;
+            undecided[i] = !in && !out;
+            num_undecided += undecided[i];
+        }
+        if (num_undecided == 0) {
+            rslt.confident = true;
+            break;
+        }
+        if (rslt.total_matches >= max_matches || stop.load(std::memory_order_relaxed))
+            break;
+
+        // A uniformly random pairing: shuffle and pair neighbours.
+        for (std::size_t i = 0; i < n; ++i)
+            order[i] = i;
+        for (std::size_t i = n - 1; i > 0; --i)
+            std::swap(order[i], order[boundedValue(streamValue(seed ^ batch, i), i + 1)]);
+
+        std::vector<std::pair<std::size_t, std::size_t> > pairings;
+        for (std::size_t p = 0; p + 1 < n; p += 2) {
+            std::size_t a = order[p], b = order[p + 1];
+            if ((undecided[a] || undecided[b]) && rslt.total_matches + pairings.size() < max_matches)
+                pairings.push_back(std::make_pair(a, b));
+        }
+
+        std::vector<MatchSummary> results =
+            playPairings(players, pairings, num_rounds, pool, stop);
+        BOOST_FOREACH(const MatchSummary& m, results) {
+            if (m.p1_wins + m.p2_wins + m.ties == 0)
+                continue;
+            total[m.p1] += matchScore(m, true);
+            total[m.p2] += matchScore(m, false);
+            ++rslt.matches[m.p1];
+            ++rslt.matches[m.p2];
+        }
+        rslt.total_matches += results.size();
+    }
+
+    rslt.score.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+        rslt.score[i] = rslt.matches[i] ? total[i] / rslt.matches[i] : 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+        order[i] = i;
+    std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](std::size_t a, std::size_t b) {
+            return rslt.score[a] > rslt.score[b] || (rslt.score[a] == rslt.score[b] && a < b);
+        });
+    rslt.top.assign(order.begin(), order.begin() + k);
+    return rslt;
+}
+
+#endif
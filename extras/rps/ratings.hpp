@@ -0,0 +1,314 @@
+// Player ratings computed from match results.
+//
+// Ratings consume MatchSummary values, as produced by `summarize` and
+// the tournament drivers, and support three systems: Elo, Glicko and
+// TrueSkill. Results can be applied one at a time as they arrive, or
+// as a batch (a rating period) in which every player is rated against
+// its opponents' ratings from before the batch. A batch is split by
+// player over the thread pool, and each player's games are put in a
+// canonical order first, so the outcome depends neither on the order
+// of the results nor on the number of threads.
+
+#ifndef RPS_EXTRAS_RATINGS_HPP
+#define RPS_EXTRAS_RATINGS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "thread_pool.hpp"
+#include "tournament.hpp"
+
+enum RatingSystem {
+    Elo,
+    Glicko,
+    TrueSkill
+};
+
+inline RatingSystem ratingSystem(const std::string& name)
+{
+    if (name == "elo")
+        return Elo;
+    if (name == "glicko")
+        return Glicko;
+    if (name == "trueskill")
+        return TrueSkill;
+    throw std::invalid_argument("unknown rating system: " + name);
+}
+
+/* One game as seen by one player: its opponent and its score, 1 for a
+ * win, 0 for a loss and 0.5 for a draw (or the fraction of rounds won,
+ * counting ties as half). */
+struct RatedGame
+{
+    std::uint32_t opponent;
+    double score;
+
+    bool operator<(const RatedGame& other) const
+        {
+            return opponent < other.opponent ||
+                (opponent == other.opponent && score < other.score);
+        }
+};
+
+/* A player's score in a match: the fraction of rounds it won, counting
+ * ties as half. */
+inline double matchScore(const MatchSummary& m, bool first)
+{
+    double rounds = m.p1_wins + m.p2_wins + m.ties;
+    return ((first ? m.p1_wins : m.p2_wins) + 0.5 * m.ties) / rounds;
+}
+
+namespace detail {
+
+const double PI = 3.14159265358979323846;
+
+inline double normalPdf(double x) { return std::exp(-0.5 * x * x) / std::sqrt(2 * PI); }
+inline double normalCdf(double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); }
+
+/* The inverse of normalCdf, by bisection. Only used for constants. */
+inline double normalQuantile(double p)
+{
+    double lo = -40, hi = 40;
+    for (int i = 0; i < 200; ++i) {
+        double mid = 0.5 * (lo + hi);
+        (normalCdf(mid) < p ? lo : hi) = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+}  // namespace detail
+
+/* The ratings of a fixed number of players under one system.
+
+   `mean` is the rating itself (Elo and Glicko points, or TrueSkill's
+   mu) and `deviation` its uncertainty (Glicko's RD or TrueSkill's
+   sigma; constant for Elo). The arrays never move, so views of them
+   stay valid as the ratings change.
+*/
+class Ratings
+{
+public:
+    Ratings(std::size_t num_players, RatingSystem system, double k=32.0) :
+        system_(system),
+        k_(k),
+        mean_(num_players, system == TrueSkill ? TRUESKILL_MU : 1500.0),
+        deviation_(num_players, system == Elo ? 0.0 :
+                   system == Glicko ? 350.0 : TRUESKILL_MU / 3),
+        games_(num_players, 0),
+        draw_margin_(detail::normalQuantile((DRAW_PROBABILITY + 1) / 2)
+                     * std::sqrt(2.0) * TRUESKILL_BETA)
+        {}
+
+    RatingSystem system() const { return system_; }
+    std::size_t numPlayers() const { return mean_.size(); }
+
+    const double* mean() const { return mean_.data(); }
+    const double* deviation() const { return deviation_.data(); }
+    const std::int64_t* games() const { return games_.data(); }
+
+    /* Applies one result immediately. Matches without rounds are
+     * ignored. */
+    void update(const MatchSummary& m)
+        {
+            check(m);
+            if (m.p1_wins + m.p2_wins + m.ties == 0)
+                return;
+
+            RatedGame g1 = {static_cast<std::uint32_t>(m.p2), matchScore(m, true)};
+            RatedGame g2 = {static_cast<std::uint32_t>(m.p1), matchScore(m, false)};
+            double mean1, dev1, mean2, dev2;
+            rate(m.p1, &g1, &g1 + 1, mean_, deviation_, mean1, dev1);
+            rate(m.p2, &g2, &g2 + 1, mean_, deviation_, mean2, dev2);
+            mean_[m.p1] = mean1;
+            deviation_[m.p1] = dev1;
+            mean_[m.p2] = mean2;
+            deviation_[m.p2] = dev2;
+            ++games_[m.p1];
+            ++games_[m.p2];
+        }
+
+    /* Applies a batch of results as one rating period. */
+    void updateBatch(const std::vector<MatchSummary>& results, ThreadPool& pool)
+        {
+            const std::size_t n = numPlayers();
+
+            // Bucket every player's games together, counting sort style.
+            std::vector<std::size_t> offsets(n + 1, 0);
+            BOOST_FOREACH(const MatchSummary& m, results) {
+                check(m);
+                if (m.p1_wins + m.p2_wins + m.ties == 0)
+                    continue;
+                ++offsets[m.p1 + 1];
+                ++offsets[m.p2 + 1];
+            }
+            for (std::size_t i = 0; i < n; ++i)
+                offsets[i + 1] += offsets[i];
+
+            std::vector<RatedGame> games(offsets[n]);
+            std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+            BOOST_FOREACH(const MatchSummary& m, results) {
+                if (m.p1_wins + m.p2_wins + m.ties == 0)
+                    continue;
+                RatedGame g1 = {static_cast<std::uint32_t>(m.p2), matchScore(m, true)};
+                RatedGame g2 = {static_cast<std::uint32_t>(m.p1), matchScore(m, false)};
+                games[fill[m.p1]++] = g1;
+                games[fill[m.p2]++] = g2;
+            }
+
+            std::vector<double> new_mean(n), new_deviation(n);
+            parallelFor(pool, (n + BLOCK - 1) / BLOCK, [&](std::size_t b) {
+                    std::size_t end = std::min(n, (b + 1) * BLOCK);
+                    for (std::size_t i = b * BLOCK; i < end; ++i) {
+                        RatedGame* first = games.data() + offsets[i];
+                        RatedGame* last = games.data() + offsets[i + 1];
+                        std::sort(first, last);
+                        rate(i, first, last, mean_, deviation_,
+                             new_mean[i], new_deviation[i]);
+                    }
+                });
+
+            std::copy(new_mean.begin(), new_mean.end(), mean_.begin());
+            std::copy(new_deviation.begin(), new_deviation.end(), deviation_.begin());
+            for (std::size_t i = 0; i < n; ++i)
+                games_[i] += offsets[i + 1] - offsets[i];
+        }
+
+    /* The probability that player i beats player j. */
+    double expected(std::size_t i, std::size_t j) const
+        {
+            if (i >= numPlayers() || j >= numPlayers())
+                throw std::out_of_range("player index out of range");
+            switch (system_) {
+            case Elo:
+                return eloExpected(mean_[i], mean_[j]);
+            case Glicko:
+                return glickoExpected(mean_[i], mean_[j], deviation_[j]);
+            case TrueSkill:
+            default:
+                double c = std::sqrt(2 * TRUESKILL_BETA * TRUESKILL_BETA
+                                     + deviation_[i] * deviation_[i]
+                                     + deviation_[j] * deviation_[j]);
+                return detail::normalCdf((mean_[i] - mean_[j]) / c);
+            }
+        }
+
+private:
+    static constexpr double TRUESKILL_MU = 25.0;
+    static constexpr double TRUESKILL_BETA = TRUESKILL_MU / 6;
+    static constexpr double TRUESKILL_TAU = TRUESKILL_MU / 300;
+    static constexpr double DRAW_PROBABILITY = 0.1;
+    static constexpr double GLICKO_Q = 0.0057564627324851142;  // ln(10) / 400
+    static const std::size_t BLOCK = 256;
+
+    void check(const MatchSummary& m) const
+        {
+            if (m.p1 >= numPlayers() || m.p2 >= numPlayers() || m.p1 == m.p2)
+                throw std::out_of_range("result refers to an invalid player");
+        }
+
+    static double eloExpected(double r, double opponent)
+        {
+            return 1 / (1 + std::pow(10.0, (opponent - r) / 400));
+        }
+
+    static double glickoG(double rd)
+        {
+            return 1 / std::sqrt(1 + 3 * GLICKO_Q * GLICKO_Q * rd * rd
+                                 / (detail::PI * detail::PI));
+        }
+
+    static double glickoExpected(double r, double opponent, double opponent_rd)
+        {
+            return 1 / (1 + std::pow(10.0, -glickoG(opponent_rd) * (r - opponent) / 400));
+        }
+
+    /* Rates player i on the games [first, last) against the opponents'
+     * ratings in `mean` and `deviation`. */
+    void rate(std::size_t i,
+              const RatedGame* first,
+              const RatedGame* last,
+              const std::vector<double>& mean,
+              const std::vector<double>& deviation,
+              double& out_mean,
+              double& out_deviation) const
+        {
+            out_mean = mean[i];
+            out_deviation = deviation[i];
+            if (first == last)
+                return;
+
+            switch (system_) {
+            case Elo: {
+                double delta = 0;
+                for (const RatedGame* g = first; g != last; ++g)
+                    delta += g->score - eloExpected(mean[i], mean[g->opponent]);
+                out_mean += k_ * delta;
+                break;
+            }
+            case Glicko: {
+                double d_inv = 0, sum = 0;
+                for (const RatedGame* g = first; g != last; ++g) {
+                    double gj = glickoG(deviation[g->opponent]);
+                    double e = glickoExpected(mean[i], mean[g->opponent], deviation[g->opponent]);
+                    d_inv += gj * gj * e * (1 - e);
+                    sum += gj * (g->score - e);
+                }
+                d_inv *= GLICKO_Q * GLICKO_Q;
+                double precision = 1 / (deviation[i] * deviation[i]) + d_inv;
+                out_mean += GLICKO_Q / precision * sum;
+                out_deviation = std::sqrt(1 / precision);
+                break;
+            }
+            case TrueSkill:
+                for (const RatedGame* g = first; g != last; ++g)
+                    trueSkill(out_mean, out_deviation,
+                              mean[g->opponent], deviation[g->opponent], g->score);
+                break;
+            }
+        }
+
+    /* One two-player TrueSkill update of (mu, sigma) against a fixed
+     * opponent. */
+    void trueSkill(double& mu, double& sigma,
+                   double opponent_mu, double opponent_sigma,
+                   double score) const
+        {
+            using detail::normalCdf;
+            using detail::normalPdf;
+
+            double var = sigma * sigma + TRUESKILL_TAU * TRUESKILL_TAU;
+            double c = std::sqrt(2 * TRUESKILL_BETA * TRUESKILL_BETA
+                                 + var + opponent_sigma * opponent_sigma);
+            double t = (mu - opponent_mu) / c, e = draw_margin_ / c;
+            double v, w;
+            if (score == 0.5) {
+                double denom = std::max(normalCdf(e - t) - normalCdf(-e - t), 1e-300);
+                v = (normalPdf(-e - t) - normalPdf(e - t)) / denom;
+                w = v * v + ((e - t) * normalPdf(e - t) + (e + t) * normalPdf(e + t)) / denom;
+            } else {
+                // A loss is a win seen from the other side.
+                double sign = score > 0.5 ? 1 : -1;
+                double x = sign * t - e;
+                v = normalPdf(x) / std::max(normalCdf(x), 1e-300);
+                w = v * (v + x);
+                v *= sign;
+            }
+            mu += var / c * v;
+            sigma = std::sqrt(var * std::max(1 - var / (c * c) * w, 1e-6));
+        }
+
+    RatingSystem system_;
+    double k_;
+    std::vector<double> mean_, deviation_;
+    std::vector<std::int64_t> games_;
+    double draw_margin_;
+};
+
+#endif
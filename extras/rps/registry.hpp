@@ -0,0 +1,228 @@
+// A registry of native player kinds and populations built from it.
+//
+// Each kind of player is registered under an id with a factory which
+// constructs a whole block of players at once, in place, in one
+// contiguous allocation. A Population is a list of such blocks, so a
+// hundred thousand players are a handful of allocations and can be
+// created, played and destroyed without going through Python.
+
+#ifndef RPS_EXTRAS_REGISTRY_HPP
+#define RPS_EXTRAS_REGISTRY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "coroutine_player.hpp"
+#include "regret_matching.hpp"
+#include "rps.hpp"
+
+/* A contiguous block of players of one kind. */
+class PlayerBlock : private boost::noncopyable
+{
+public:
+    virtual ~PlayerBlock() {}
+
+    virtual std::size_t size() const = 0;
+    virtual const Player& at(std::size_t i) const = 0;
+};
+
+/* A block of `count` players of type T, constructed in place by
+   `make(storage, i)` for each index i. T need not be copyable or
+   movable, since the players are never relocated.
+*/
+template <typename T>
+class TypedPlayerBlock : public PlayerBlock
+{
+public:
+    template <typename Make>
+    TypedPlayerBlock(std::size_t count, Make make) :
+        players_(std::allocator<T>().allocate(count)),
+        capacity_(count),
+        size_(0)
+        {
+            try {
+                for (; size_ < count; ++size_)
+                    make(static_cast<void*>(players_ + size_), size_);
+            } catch (...) {
+                destroy();
+                throw;
+            }
+        }
+
+    ~TypedPlayerBlock() { destroy(); }
+
+    std::size_t size() const { return size_; }
+    const Player& at(std::size_t i) const { return players_[i]; }
+
+private:
+    void destroy()
+        {
+            for (std::size_t i = size_; i > 0; --i)
+                players_[i - 1].~T();
+            std::allocator<T>().deallocate(players_, capacity_);
+        }
+
+    T* players_;
+    std::size_t capacity_, size_;
+};
+
+/* Makes `count` players of type T, each named `name`, with
+ * `T(name, args...)`. */
+template <typename T, typename... Args>
+std::unique_ptr<PlayerBlock> makePlayerBlock(const std::string& name,
+                                             std::size_t count,
+                                             const Args&... args)
+{
+    return std::unique_ptr<PlayerBlock>(new TypedPlayerBlock<T>(
+        count, [&](void* storage, std::size_t) { new (storage) T(name, args...); }));
+}
+
+/* Makes `count` players of type T named `name`, player i with
+ * `T(name, seed + i)`. */
+template <typename T>
+std::unique_ptr<PlayerBlock> makeSeededPlayerBlock(const std::string& name,
+                                                   std::size_t count,
+                                                   std::uint64_t seed)
+{
+    return std::unique_ptr<PlayerBlock>(new TypedPlayerBlock<T>(
+        count, [&](void* storage, std::size_t i) { new (storage) T(name, seed + i); }));
+}
+
+/* Builds `count` players named `name`. Seeded kinds give player i the
+ * seed `seed + i`. */
+typedef std::function<std::unique_ptr<PlayerBlock>(const std::string& name,
+                                                   std::size_t count,
+                                                   std::uint64_t seed)> PlayerFactory;
+
+/* Maps player kind ids to their factories. */
+class PlayerRegistry : private boost::noncopyable
+{
+public:
+    void add(const std::string& kind, PlayerFactory factory)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            factories_[kind] = factory;
+        }
+
+    std::vector<std::string> kinds() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<std::string> rslt;
+            for (std::map<std::string, PlayerFactory>::const_iterator it = factories_.begin();
+                 it != factories_.end(); ++it)
+                rslt.push_back(it->first);
+            return rslt;
+        }
+
+    std::unique_ptr<PlayerBlock> create(const std::string& kind,
+                                        const std::string& name,
+                                        std::size_t count,
+                                        std::uint64_t seed) const
+        {
+            PlayerFactory factory;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                std::map<std::string, PlayerFactory>::const_iterator it = factories_.find(kind);
+                if (it == factories_.end())
+                    throw std::invalid_argument("unknown player kind: " + kind);
+                factory = it->second;
+            }
+            return factory(name, count, seed);
+        }
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, PlayerFactory> factories_;
+};
+
+/* The registry of the built-in kinds: "random", "tit_for_tat" and
+   "regret_matcher" (seeded), "frequency_counter" and
+   "coroutine:<strategy>" for each coroutine strategy.
+*/
+inline PlayerRegistry& playerRegistry()
+{
+    static PlayerRegistry* registry = [] {
+        PlayerRegistry* r = new PlayerRegistry;
+        r->add("random", [](const std::string& name, std::size_t count, std::uint64_t seed) {
+                return makeSeededPlayerBlock<Random>(name, count, seed);
+            });
+        r->add("tit_for_tat", [](const std::string& name, std::size_t count, std::uint64_t seed) {
+                return makeSeededPlayerBlock<TitForTat>(name, count, seed);
+            });
+        r->add("frequency_counter", [](const std::string& name, std::size_t count, std::uint64_t) {
+                return makePlayerBlock<FrequencyCounter>(name, count);
+            });
+        r->add("regret_matcher", [](const std::string& name, std::size_t count, std::uint64_t seed) {
+                return makeSeededPlayerBlock<RegretMatcher>(name, count, seed);
+            });
+        for (std::map<std::string, StrategyFn>::const_iterator it = strategies().begin();
+             it != strategies().end(); ++it) {
+            std::string strategy = it->first;
+            r->add("coroutine:" + strategy,
+                   [strategy](const std::string& name, std::size_t count, std::uint64_t) {
+                       return makePlayerBlock<CoroutinePlayer>(name, count, strategy);
+                   });
+        }
+        return r;
+    }();
+    return *registry;
+}
+
+/* A collection of natively created players, indexed in the order they
+   were added.
+*/
+class Population : private boost::noncopyable
+{
+public:
+    /* Adds `count` players of the given kind, named `name` (the kind
+     * id if empty). Returns the index of the first. */
+    std::size_t add(const std::string& kind,
+                    std::size_t count,
+                    const std::string& name="",
+                    std::uint64_t seed=0)
+        {
+            std::unique_ptr<PlayerBlock> block = playerRegistry().create(
+                kind, name.empty() ? kind : name, count, seed);
+
+            std::size_t first = lineup_.size();
+            lineup_.reserve(first + block->size());
+            for (std::size_t i = 0; i < block->size(); ++i)
+                lineup_.push_back(&block->at(i));
+            blocks_.push_back(std::move(block));
+            return first;
+        }
+
+    std::size_t size() const { return lineup_.size(); }
+
+    const Player& operator[](std::size_t i) const
+        {
+            if (i >= lineup_.size())
+                throw std::out_of_range("player index out of range");
+            return *lineup_[i];
+        }
+
+    /* The players in order, as the tournament drivers take them. */
+    const std::vector<const Player*>& lineup() const { return lineup_; }
+
+    void clear()
+        {
+            lineup_.clear();
+            blocks_.clear();
+        }
+
+private:
+    std::vector<std::unique_ptr<PlayerBlock> > blocks_;
+    std::vector<const Player*> lineup_;
+};
+
+#endif
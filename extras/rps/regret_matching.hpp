@@ -0,0 +1,352 @@
+// Players which learn by regret matching.
+//
+// After every round the learner adds, for each move i, the regret
+// payoff(i, theirs) - payoff(mine, theirs) to a running total, and
+// plays each move with probability proportional to its positive
+// regret. The whole state is one contiguous block of floats (regrets
+// then strategy), updated with vector instructions across the moves.
+// For rock-paper-scissors the block is inline: the regrets and the
+// strategy are each one vector of four lanes, the last one unused.
+
+#ifndef RPS_EXTRAS_REGRET_MATCHING_HPP
+#define RPS_EXTRAS_REGRET_MATCHING_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "game.hpp"
+#include "rng.hpp"
+#include "rps.hpp"
+#include "simd.hpp"
+
+/* The state of one regret-matching learner over `num_moves` moves. */
+class RegretLearner
+{
+public:
+    explicit RegretLearner(std::size_t num_moves=0) :
+        num_moves_(num_moves),
+        block_(2 * num_moves)
+        {
+            reset();
+        }
+
+    void reset()
+        {
+            std::fill(block_.begin(), block_.begin() + num_moves_, 0.0f);
+            if (num_moves_)
+                std::fill(block_.begin() + num_moves_, block_.end(), 1.0f / num_moves_);
+        }
+
+    std::size_t numMoves() const { return num_moves_; }
+    const float* regrets() const { return &block_[0]; }
+    const float* strategy() const { return &block_[num_moves_]; }
+
+    /* Learns from one round. `payoffs[i]` is what move i would have
+     * earned against the opponent's move, and `mine` the move played. */
+    void update(const float* payoffs, unsigned mine)
+        {
+            const std::size_t n = num_moves_;
+            const std::size_t W = sizeof(FloatLanes) / sizeof(float);
+            float* regret = &block_[0];
+            float* strategy = &block_[n];
+            const float baseline = payoffs[mine];
+
+            FloatLanes zero = {0, 0, 0, 0, 0, 0, 0, 0};
+            FloatLanes total_lanes = zero;
+            std::size_t i = 0;
+            for (; i + W <= n; i += W) {
+                FloatLanes r, p;
+                loadLanes(r, regret + i);
+                loadLanes(p, payoffs + i);
+                r += p - baseline;
+                storeLanes(regret + i, r);
+                FloatLanes positive = r > zero ? r : zero;
+                storeLanes(strategy + i, positive);
+                total_lanes += positive;
+            }
+            float total = 0;
+            for (std::size_t l = 0; l < W; ++l)
+                total += total_lanes[l];
+            for (; i < n; ++i) {
+                regret[i] += payoffs[i] - baseline;
+                strategy[i] = std::max(regret[i], 0.0f);
+                total += strategy[i];
+            }
+
+            if (total > 0) {
+                const float scale = 1.0f / total;
+                for (std::size_t k = 0; k < n; ++k)
+                    strategy[k] *= scale;
+            } else {
+                std::fill(strategy, strategy + n, 1.0f / n);
+            }
+        }
+
+    /* Samples a move from the current strategy given a uniform [0, 1)
+     * value. */
+    unsigned sample(double u) const
+        {
+            const float* strategy = &block_[num_moves_];
+            double cumulative = 0;
+            for (std::size_t i = 0; i + 1 < num_moves_; ++i) {
+                cumulative += strategy[i];
+                if (u < cumulative)
+                    return i;
+            }
+            return num_moves_ - 1;
+        }
+
+private:
+    std::size_t num_moves_;
+    std::vector<float> block_;
+};
+
+/* One seat's learner together with how much of the match it has seen,
+   so that it only ever processes the newest round. The stream of
+   random numbers it samples from is derived from the player's seed and
+   the seat.
+*/
+class RegretSeat : public PlayerState
+{
+public:
+    RegretSeat() : seen(0) {}
+
+    /* Starts afresh with a learner over `num_moves` moves. */
+    void start(std::size_t num_moves)
+        {
+            if (learner.numMoves() == num_moves)
+                learner.reset();
+            else
+                learner = RegretLearner(num_moves);
+            seen = 0;
+        }
+
+    RegretLearner learner;
+    std::size_t seen;
+};
+
+/* A rock-paper-scissors regret learner's state in one seat of a match,
+ * kept in the match's context. */
+class RpsRegretState : public PlayerState
+{
+public:
+    typedef float Lanes __attribute__((vector_size(16)));
+
+    RpsRegretState() { reset(); }
+
+    void reset()
+        {
+            const float third = 1.0f / 3;
+            regrets = Lanes{0, 0, 0, 0};
+            strategy = Lanes{third, third, third, 0};
+            seen = 0;
+        }
+
+    /* Learns from one round. */
+    void update(Move mine, Move theirs)
+        {
+            const Lanes& payoffs = payoffsAgainst(theirs);
+            regrets += payoffs - Lanes{1, 1, 1, 0} * payoffs[mine];
+            Lanes positive = regrets > 0 ? regrets : Lanes{0, 0, 0, 0};
+            const float total = positive[0] + positive[1] + positive[2];
+            if (total > 0) {
+                strategy = positive * (1.0f / total);
+            } else {
+                const float third = 1.0f / 3;
+                strategy = Lanes{third, third, third, 0};
+            }
+        }
+
+    /* Samples a move from the strategy given a uniform [0, 1) value. */
+    Move sample(double u) const
+        {
+            if (u < strategy[0])
+                return Rock;
+            if (u < double(strategy[0]) + strategy[1])
+                return Paper;
+            return Scissors;
+        }
+
+    Lanes regrets, strategy;
+    std::size_t seen;  // Rounds learned from
+
+private:
+    // What each move earns against `theirs`. The unused lane is zero,
+    // and `update` leaves it out of the baseline, so the regrets and
+    // the strategy keep it at zero.
+    static const Lanes& payoffsAgainst(Move theirs)
+        {
+            static const struct Table {
+                Table()
+                    {
+                        for (int b = Rock; b <= Scissors; ++b) {
+                            rows[b] = Lanes{0, 0, 0, 0};
+                            for (int a = Rock; a <= Scissors; ++a)
+                                rows[b][a] = RockPaperScissors::payoff[a][b];
+                        }
+                    }
+                Lanes rows[3];
+            } table;
+            return table.rows[theirs];
+        }
+};
+
+/* A rock-paper-scissors Player which adapts to its opponent by regret
+   matching. What it has learned is kept with each match, so one
+   instance may take part in any number of matches at once.
+*/
+class RegretMatcher : public Player
+{
+public:
+    RegretMatcher(const std::string& name, std::uint64_t seed=0) :
+        Player(name),
+        seed_(seed)
+        {}
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            assert(my_pos == 0 || my_pos == 1);
+
+            return states_.apply(*this, 0, my_pos, [&](RpsRegretState& state) {
+                    return step(state, history.size(), my_pos, [&](std::size_t i) {
+                            const Round& r = history[i];
+                            return (my_pos == 0) ? std::make_pair(r.p1, r.p2)
+                                                 : std::make_pair(r.p2, r.p1);
+                        });
+                });
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            return states_.apply(*this, view.stateSlot(), view.position(), [&](RpsRegretState& state) {
+                    return step(state, view.size(), view.position(), [&](std::size_t i) {
+                            return std::make_pair(static_cast<Move>(view.mine()[i]),
+                                                  static_cast<Move>(view.theirs()[i]));
+                        });
+                });
+        }
+
+    std::uint64_t seed() const { return seed_; }
+
+    bool fingerprint(Fingerprint& fp) const
+        {
+            fp.add("RegretMatcher").add(seed_);
+            return true;
+        }
+
+    /* The mixed strategy of the given seat at the end of the last match
+     * played in `context`, or without one, after the last direct call
+     * to `nextMove`. Uniform if the seat has not played. */
+    std::vector<float> strategy(unsigned char my_pos, const MatchContext* context=0) const
+        {
+            std::vector<float> rslt;
+            auto copy = [&](const RpsRegretState& state) {
+                for (int m = Rock; m <= Scissors; ++m)
+                    rslt.push_back(state.strategy[m]);
+            };
+            if (context) {
+                if (const RpsRegretState* state = context->state(my_pos).find<RpsRegretState>(*this))
+                    copy(*state);
+            } else {
+                states_.inspect(*this, my_pos, copy);
+            }
+            if (rslt.empty())
+                copy(RpsRegretState());
+            return rslt;
+        }
+
+private:
+    // Learns from the rounds since the last move and samples the next.
+    template <typename RoundAt>
+    Move step(RpsRegretState& state,
+              std::size_t n,
+              unsigned char my_pos,
+              RoundAt round) const
+        {
+            if (n < state.seen || n == 0)
+                state.reset();
+            for (; state.seen < n; ++state.seen) {
+                std::pair<Move, Move> r = round(state.seen);
+                state.update(r.first, r.second);
+            }
+            return state.sample(unitDouble(streamValue(seed_ ^ my_pos, n)));
+        }
+
+    std::uint64_t seed_;
+    SeatStates<RpsRegretState> states_;
+};
+
+/* The regret-matching learner for arbitrary matrix games. What it has
+   learned is kept with each match, as RegretMatcher's is, so one
+   instance may take part in any number of matches at once. Direct
+   calls to `nextMove` share one learner per seat, which follows one
+   match at a time.
+*/
+class RegretMatchingGamePlayer : public GamePlayer
+{
+public:
+    RegretMatchingGamePlayer(const std::string& name,
+                             const MatrixGame& game,
+                             std::uint64_t seed=0) :
+        GamePlayer(name),
+        num_moves_(game.numMoves()),
+        columns_(num_moves_ * num_moves_),
+        seed_(seed)
+        {
+            // columns_[b * n + i] is the payoff of move i against b.
+            for (std::size_t i = 0; i < num_moves_; ++i)
+                for (std::size_t b = 0; b < num_moves_; ++b)
+                    columns_[b * num_moves_ + i] = game.payoff(i, b);
+        }
+
+    unsigned nextMove(const std::vector<GameRound>& history,
+                      unsigned char my_pos,
+                      unsigned num_moves) const
+        {
+            return choose(history, my_pos, num_moves, 0);
+        }
+
+    unsigned choose(const std::vector<GameRound>& history,
+                    unsigned char my_pos,
+                    unsigned num_moves,
+                    PlayerStateSlot* slot) const
+        {
+            if (num_moves != num_moves_)
+                throw std::invalid_argument("player was built for a different game");
+            return seats_.apply(*this, slot, my_pos, [&](RegretSeat& seat) {
+                    return step(seat, history, my_pos);
+                });
+        }
+
+private:
+    // Learns from the rounds since the last move and samples the next.
+    unsigned step(RegretSeat& seat,
+                  const std::vector<GameRound>& history,
+                  unsigned char my_pos) const
+        {
+            if (history.empty() || history.size() < seat.seen ||
+                seat.learner.numMoves() != num_moves_)
+                seat.start(num_moves_);
+            for (; seat.seen < history.size(); ++seat.seen) {
+                const GameRound& r = history[seat.seen];
+                unsigned mine = (my_pos == 0) ? r.p1 : r.p2;
+                unsigned theirs = (my_pos == 0) ? r.p2 : r.p1;
+                seat.learner.update(&columns_[theirs * num_moves_], mine);
+            }
+
+            double u = unitDouble(streamValue(seed_ ^ my_pos, history.size()));
+            return seat.learner.sample(u);
+        }
+
+    std::size_t num_moves_;
+    std::vector<float> columns_;
+    std::uint64_t seed_;
+    SeatStates<RegretSeat> seats_;
+};
+
+#endif
@@ -0,0 +1,189 @@
+// Replaying recorded moves, e.g. from human play.
+//
+// A MoveRecording is a read-only sequence of moves: a move file mapped
+// into memory, a block of immutable memory owned elsewhere (a Python
+// bytes object, say) or a copy of the moves it owns. A ReplayPlayer plays the recording's moves in order,
+// indexed by the round number, so it keeps no state: any number of
+// players and concurrent matches can share one recording, and so one
+// mapping.
+
+#ifndef RPS_EXTRAS_REPLAY_HPP
+#define RPS_EXTRAS_REPLAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "mapped_file.hpp"
+#include "rng.hpp"
+#include "rps.hpp"
+
+/* Writes `moves` (each 0, 1 or 2) as a move file: "RPSMOVES", the
+ * number of moves as a uint64, then the moves packed four to a byte,
+ * lowest bits first. It replaces any old file at `path` with
+ * `replaceFile`, so that recordings mapping the old one keep reading
+ * it whole. */
+inline void writeMoveFile(const std::string& path, const unsigned char* moves, std::size_t n)
+{
+    std::vector<unsigned char> packed(16 + (n + 3) / 4, 0);
+    std::uint64_t count = n;
+    std::memcpy(&packed[0], "RPSMOVES", 8);
+    std::memcpy(&packed[8], &count, 8);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (moves[i] > 2)
+            throw std::invalid_argument("moves must be 0, 1 or 2");
+        packed[16 + i / 4] |= moves[i] << (2 * (i % 4));
+    }
+
+    if (!replaceFile(path, { {packed.data(), packed.size()} }))
+        throw std::runtime_error("cannot write move file " + path);
+}
+
+class MoveRecording : private boost::noncopyable
+{
+public:
+    /* Maps the move file `path`. */
+    explicit MoveRecording(const std::string& path) :
+        packed_(true),
+        data_(0),
+        size_(0),
+        file_(new MappedFile(path))
+        {
+            const unsigned char* base = file_->data();
+            std::uint64_t count = 0;
+            if (file_->size() >= 16)
+                std::memcpy(&count, base + 8, 8);
+            if (file_->size() < 16 || std::memcmp(base, "RPSMOVES", 8) != 0 ||
+                count > (file_->size() - 16) * 4)
+                throw std::runtime_error("not a move file: " + path);
+            data_ = base + 16;
+            size_ = count;
+            check();
+        }
+
+    /* Uses `n` moves, one per byte, at `data`, which must stay valid
+     * until `release` is called on destruction. */
+    MoveRecording(const unsigned char* data, std::size_t n, std::function<void()> release) :
+        packed_(false),
+        data_(data),
+        size_(n),
+        release_(release)
+        {
+            try {
+                check();
+            } catch (...) {
+                if (release_)
+                    release_();
+                throw;
+            }
+        }
+
+    /* Owns `moves`, one per byte. */
+    explicit MoveRecording(std::vector<unsigned char> moves) :
+        packed_(false),
+        data_(0),
+        size_(moves.size()),
+        owned_(std::move(moves))
+        {
+            data_ = owned_.data();
+            check();
+        }
+
+    ~MoveRecording()
+        {
+            if (release_)
+                release_();
+        }
+
+    std::size_t size() const { return size_; }
+
+    Move at(std::size_t i) const
+        {
+            if (packed_)
+                return static_cast<Move>((data_[i / 4] >> (2 * (i % 4))) & 3);
+            return static_cast<Move>(data_[i]);
+        }
+
+    /* A hash of the moves, for fingerprinting players. */
+    std::uint64_t digest() const { return digest_; }
+
+private:
+    // Rejects values other than moves, which later reads then need not
+    // check, and computes the digest on the same pass.
+    void check()
+        {
+            if (size_ == 0)
+                throw std::invalid_argument("a recording needs at least one move");
+            std::uint64_t h = mix64(size_);
+            for (std::size_t i = 0; i < size_; i += 8) {
+                std::uint64_t word = 0;
+                for (std::size_t j = i; j < i + 8 && j < size_; ++j) {
+                    unsigned m = at(j);
+                    if (m > 2)
+                        throw std::invalid_argument("recording holds a value that is not a move");
+                    word = word << 2 | m;
+                }
+                h = mix64(h ^ word);
+            }
+            digest_ = h;
+        }
+
+    bool packed_;
+    const unsigned char* data_;
+    std::size_t size_;
+    std::unique_ptr<MappedFile> file_;
+    std::vector<unsigned char> owned_;
+    std::function<void()> release_;
+    std::uint64_t digest_;
+};
+
+/* Plays a recording from `offset` onwards, starting again from the
+ * beginning when it runs out. */
+class ReplayPlayer : public Player
+{
+public:
+    ReplayPlayer(const std::string& name,
+                 const std::shared_ptr<const MoveRecording>& recording,
+                 std::size_t offset=0) :
+        Player(name),
+        recording_(recording),
+        offset_(recording ? offset % recording->size() : 0)
+        {
+            if (!recording)
+                throw std::invalid_argument("a replay player needs a recording");
+        }
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            return chooseFromRounds(*this, history, my_pos);
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            std::size_t i = offset_ + view.size() % recording_->size();
+            return recording_->at(i < recording_->size() ? i : i - recording_->size());
+        }
+
+    bool fingerprint(Fingerprint& fp) const
+        {
+            fp.add("Replay").add(recording_->digest()).add(offset_);
+            return true;
+        }
+
+    const std::shared_ptr<const MoveRecording>& recording() const { return recording_; }
+    std::size_t offset() const { return offset_; }
+
+private:
+    std::shared_ptr<const MoveRecording> recording_;
+    std::size_t offset_;
+};
+
+#endif
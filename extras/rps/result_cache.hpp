@@ -0,0 +1,234 @@
+// A two-tier cache of match results.
+//
+// Matches between fingerprinted players are deterministic, so their
+// scores can be looked up instead of replayed. Scores are packed four
+// rounds to a byte and kept in an in-memory LRU, backed optionally by a
+// directory holding one file per match, which outlives the process and
+// can be shared by several.
+
+#ifndef RPS_EXTRAS_RESULT_CACHE_HPP
+#define RPS_EXTRAS_RESULT_CACHE_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "mapped_file.hpp"
+#include "rps.hpp"
+
+/* Packs scores (-1, 0 or 1) two bits each. */
+inline std::vector<std::uint8_t> packScores(const std::vector<int>& scores)
+{
+    std::vector<std::uint8_t> packed((scores.size() + 3) / 4, 0);
+    for (std::size_t r = 0; r < scores.size(); ++r)
+        packed[r / 4] |= static_cast<std::uint8_t>(scores[r] + 1) << (2 * (r % 4));
+    return packed;
+}
+
+inline void unpackScores(const std::uint8_t* packed,
+                         std::size_t num_rounds,
+                         std::vector<int>& scores)
+{
+    scores.resize(num_rounds);
+    for (std::size_t r = 0; r < num_rounds; ++r)
+        scores[r] = ((packed[r / 4] >> (2 * (r % 4))) & 3) - 1;
+}
+
+/* The MatchCache used by `play`. Holds up to `capacity` matches in
+   memory, least recently used first out. If `directory` is given,
+   every stored match is also written there, and matches missing from
+   memory are looked for there before they are replayed.
+*/
+class ResultCache : public MatchCache, private boost::noncopyable
+{
+public:
+    ResultCache(std::size_t capacity, const std::string& directory="") :
+        capacity_(capacity),
+        directory_(directory),
+        hits_(0),
+        disk_hits_(0),
+        misses_(0)
+        {
+            if (!directory_.empty() && ::mkdir(directory_.c_str(), 0777) != 0 && errno != EEXIST)
+                throw std::runtime_error("cannot create cache directory " + directory_ +
+                                         ": " + std::strerror(errno));
+        }
+
+    bool lookup(std::uint64_t key, std::size_t num_rounds, std::vector<int>& scores)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Index::iterator it = index_.find(key);
+                if (it != index_.end() && it->second->num_rounds == num_rounds) {
+                    entries_.splice(entries_.begin(), entries_, it->second);
+                    unpackScores(it->second->packed.data(), num_rounds, scores);
+                    ++hits_;
+                    return true;
+                }
+            }
+
+            std::vector<std::uint8_t> packed;
+            if (!directory_.empty() && readFile(key, num_rounds, packed)) {
+                unpackScores(packed.data(), num_rounds, scores);
+                std::lock_guard<std::mutex> lock(mutex_);
+                insert(key, num_rounds, packed);
+                ++disk_hits_;
+                return true;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++misses_;
+            return false;
+        }
+
+    void store(std::uint64_t key, const std::vector<int>& scores)
+        {
+            std::vector<std::uint8_t> packed = packScores(scores);
+            if (!directory_.empty())
+                writeFile(key, scores.size(), packed);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            insert(key, scores.size(), packed);
+        }
+
+    /* Empties the in-memory tier. */
+    void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.clear();
+            index_.clear();
+        }
+
+    std::size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return entries_.size();
+        }
+
+    std::size_t capacity() const { return capacity_; }
+    std::string directory() const { return directory_; }
+
+    std::size_t hits() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return hits_;
+        }
+
+    std::size_t diskHits() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return disk_hits_;
+        }
+
+    std::size_t misses() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return misses_;
+        }
+
+private:
+    struct Entry
+    {
+        std::uint64_t key;
+        std::size_t num_rounds;
+        std::vector<std::uint8_t> packed;
+    };
+
+    typedef std::list<Entry> Entries;
+    typedef std::unordered_map<std::uint64_t, Entries::iterator> Index;
+
+    static const std::size_t HEADER_SIZE = 24;
+
+    // Called with mutex_ held.
+    void insert(std::uint64_t key, std::size_t num_rounds, std::vector<std::uint8_t>& packed)
+        {
+            if (capacity_ == 0)
+                return;
+            Index::iterator it = index_.find(key);
+            if (it != index_.end()) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                it->second->num_rounds = num_rounds;
+                it->second->packed.swap(packed);
+                return;
+            }
+            if (entries_.size() == capacity_) {
+                index_.erase(entries_.back().key);
+                entries_.pop_back();
+            }
+            entries_.push_front(Entry());
+            entries_.front().key = key;
+            entries_.front().num_rounds = num_rounds;
+            entries_.front().packed.swap(packed);
+            index_[key] = entries_.begin();
+        }
+
+    std::string path(std::uint64_t key) const
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/%016llx.rps",
+                          static_cast<unsigned long long>(key));
+            return directory_ + name;
+        }
+
+    // A file is "RPSCACH1", the key and the number of rounds, followed
+    // by the packed scores.
+    bool readFile(std::uint64_t key,
+                  std::size_t num_rounds,
+                  std::vector<std::uint8_t>& packed) const
+        {
+            int fd = ::open(path(key).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return false;
+
+            char header[HEADER_SIZE];
+            std::uint64_t file_key, file_rounds;
+            packed.resize((num_rounds + 3) / 4);
+            bool ok = ::read(fd, header, HEADER_SIZE) == ssize_t(HEADER_SIZE);
+            if (ok) {
+                std::memcpy(&file_key, header + 8, 8);
+                std::memcpy(&file_rounds, header + 16, 8);
+                ok = std::memcmp(header, "RPSCACH1", 8) == 0 &&
+                    file_key == key && file_rounds == num_rounds &&
+                    ::read(fd, packed.data(), packed.size()) == ssize_t(packed.size());
+            }
+            ::close(fd);
+            return ok;
+        }
+
+    // Readers in other processes never see a partial file (see
+    // replaceFile). Failing to write only loses the disk copy.
+    void writeFile(std::uint64_t key,
+                   std::size_t num_rounds,
+                   const std::vector<std::uint8_t>& packed) const
+        {
+            char header[HEADER_SIZE];
+            std::uint64_t rounds = num_rounds;
+            std::memcpy(header, "RPSCACH1", 8);
+            std::memcpy(header + 8, &key, 8);
+            std::memcpy(header + 16, &rounds, 8);
+            replaceFile(path(key), { {header, HEADER_SIZE}, {packed.data(), packed.size()} });
+        }
+
+    std::size_t capacity_;
+    std::string directory_;
+    mutable std::mutex mutex_;
+    Entries entries_;
+    Index index_;
+    std::size_t hits_, disk_hits_, misses_;
+};
+
+#endif
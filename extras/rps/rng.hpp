@@ -0,0 +1,41 @@
+// Counter-based random streams.
+//
+// A stream is identified by a seed and produces the value for any
+// position directly, without state. Players which draw their moves
+// this way are deterministic for a given seed, do not need to be
+// mutated by `nextMove`, and can play in any number of concurrent
+// matches.
+
+#ifndef RPS_EXTRAS_RNG_HPP
+#define RPS_EXTRAS_RNG_HPP
+
+#include <cstdint>
+
+/* The SplitMix64 finalizer: a fast, well-mixing 64-bit hash. */
+inline std::uint64_t mix64(std::uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/* The value at `position` of the stream `seed`. */
+inline std::uint64_t streamValue(std::uint64_t seed, std::uint64_t position)
+{
+    return mix64(mix64(seed) ^ position);
+}
+
+/* A uniform double in [0, 1) from a 64-bit value. */
+inline double unitDouble(std::uint64_t bits)
+{
+    return (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* A uniform integer in [0, n) from a 64-bit value. */
+inline unsigned boundedValue(std::uint64_t bits, unsigned n)
+{
+    return static_cast<unsigned>(((bits >> 32) * n) >> 32);
+}
+
+#endif
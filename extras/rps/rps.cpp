@@ -0,0 +1,1794 @@
+// The extended rock-paper-scissors module.
+//
+// This exposes the engine in rps.hpp along with the native subsystems
+// built on top of it. The bindings for the core classes are the same
+// as those developed in the rps exercises.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/python.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "async.hpp"
+#include "buffer.hpp"
+#include "coroutine_player.hpp"
+#include "dynamics.hpp"
+#include "equilibrium.hpp"
+#include "evolution.hpp"
+#include "game.hpp"
+#include "gil.hpp"
+#include "history.hpp"
+#include "lanes.hpp"
+#include "lattice.hpp"
+#include "league.hpp"
+#include "markov.hpp"
+#include "mcts.hpp"
+#include "memory_one.hpp"
+#include "mlp.hpp"
+#include "multiplayer.hpp"
+#include "ngram.hpp"
+#include "regret_matching.hpp"
+#include "racing.hpp"
+#include "ratings.hpp"
+#include "registry.hpp"
+#include "replay.hpp"
+#include "result_cache.hpp"
+#include "rps.hpp"
+#include "shared_results.hpp"
+#include "strategy_space.hpp"
+#include "swiss.hpp"
+#include "thread_pool.hpp"
+#include "tournament.hpp"
+
+namespace bp=boost::python;
+
+int (*score2)(Move, Move) = &score;
+
+BOOST_PYTHON_FUNCTION_OVERLOADS(test_overloads, test, 0, 1);
+
+bp::list toList(const std::vector<int>& scores)
+{
+    bp::list results;
+
+    BOOST_FOREACH(int score, scores)
+    {
+        results.append(score);
+    }
+
+    return results;
+}
+
+bp::list toList(const std::vector<MatchSummary>& summaries)
+{
+    bp::list results;
+
+    BOOST_FOREACH(const MatchSummary& s, summaries)
+    {
+        results.append(bp::make_tuple(s.p1, s.p2, s.p1_wins, s.p2_wins, s.ties));
+    }
+
+    return results;
+}
+
+/* Plays a match, in `context` if one is given so that repeated
+ * matches reuse its buffers. */
+bp::list py_play(const Player& p1,
+                 const Player& p2,
+                 std::vector<int>::size_type num_rounds,
+                 bp::object context)
+{
+    if (context.is_none()) {
+        std::vector<int> scores;
+        {
+            ReleaseGIL nogil;
+            scores = play(p1, p2, num_rounds);
+        }
+        return toList(scores);
+    }
+
+    MatchContext& ctx = bp::extract<MatchContext&>(context);
+    static const std::atomic<bool> never(false);
+    const std::vector<int>* scores;
+    {
+        ReleaseGIL nogil;
+        scores = &play(p1, p2, num_rounds, never, ctx);
+    }
+    return toList(*scores);
+}
+
+/* Extracts the Players from a Python sequence. */
+std::vector<const Player*> lineup(bp::object players)
+{
+    std::vector<const Player*> rslt;
+    for (bp::ssize_t i = 0, n = bp::len(players); i < n; ++i) {
+        const Player& p = bp::extract<const Player&>(players[i]);
+        rslt.push_back(&p);
+    }
+    return rslt;
+}
+
+bp::list py_tournament(bp::object players,
+                       std::size_t num_rounds)
+{
+    std::vector<const Player*> ps = lineup(players);
+    std::vector<MatchSummary> results;
+    {
+        ReleaseGIL nogil;
+        std::atomic<bool> stop(false);
+        results = roundRobin(ps, num_rounds, defaultPool(), stop);
+    }
+    return toList(results);
+}
+
+struct Round_to_tuple
+{
+    static PyObject* convert(const Round& r)
+        {
+            return bp::incref<>(
+                bp::make_tuple(r.p1, r.p2).ptr());
+        }
+};
+
+struct Round_from_tuple
+{
+    Round_from_tuple()
+        {
+            bp::converter::registry::push_back(
+                &convertible,
+                &construct,
+                bp::type_id<Round>());
+        }
+
+    static bool checkIsMove(PyObject* obj) {
+        bp::object move_obj = bp::import("rps").attr("Move");
+        return PyObject_IsInstance(obj, move_obj.ptr());
+    }
+
+    // Determine if obj_ptr can be converted in a Round
+    static void* convertible(PyObject* obj_ptr)
+        {
+            if (!PyTuple_Check(obj_ptr)) return 0;
+            if (PyTuple_Size(obj_ptr) != 2) return 0;
+            if (!checkIsMove(PyTuple_GetItem(obj_ptr, 0))) return 0;
+            if (!checkIsMove(PyTuple_GetItem(obj_ptr, 1))) return 0;
+
+            return obj_ptr;
+        }
+
+    // Convert obj_ptr into a Round
+    static void construct(
+        PyObject* obj_ptr,
+        bp::converter::rvalue_from_python_stage1_data* data)
+        {
+            // Extract Move values from tuple
+            Move m1 = bp::extract<Move>(
+                bp::object(
+                    bp::handle<>(
+                        bp::borrowed(
+                            PyTuple_GetItem(obj_ptr, 0)))));
+
+            Move m2 = bp::extract<Move>(
+                bp::object(
+                    bp::handle<>(
+                        bp::borrowed(
+                            PyTuple_GetItem(obj_ptr, 1)))));
+
+            // Grab pointer to memory into which to construct the new Round
+            void* storage = (
+                (bp::converter::rvalue_from_python_storage<Round>*)
+                data)->storage.bytes;
+
+            // in-place construct the new Round using the character data
+            // extraced from the python object
+            new (storage) Round(m1, m2);
+
+            // Stash the memory chunk pointer for later use by boost.python
+            data->convertible = storage;
+        }
+};
+
+class PlayerWrap : public Player,
+                   public bp::wrapper<Player>
+{
+public:
+    PlayerWrap(const std::string& name) :
+        Player(name)
+        {}
+
+    // This may be called from pool threads, so it takes the GIL itself
+    // and carries Python exceptions out as PythonError.
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            ScopedGIL gil;
+            try {
+                bp::list py_hist;
+                BOOST_FOREACH(const Round& r, history) {
+                    py_hist.append(r);
+                }
+
+                return this->get_override("next_move")(py_hist, my_pos);
+            } catch (const bp::error_already_set&) {
+                throw PythonError::fetch();
+            }
+        }
+};
+
+class GamePlayerWrap : public GamePlayer,
+                       public bp::wrapper<GamePlayer>
+{
+public:
+    GamePlayerWrap(const std::string& name) :
+        GamePlayer(name)
+        {}
+
+    unsigned nextMove(const std::vector<GameRound>& history,
+                      unsigned char my_pos,
+                      unsigned num_moves) const
+        {
+            ScopedGIL gil;
+            try {
+                bp::list py_hist;
+                BOOST_FOREACH(const GameRound& r, history) {
+                    py_hist.append(bp::make_tuple(r.p1, r.p2));
+                }
+
+                return this->get_override("next_move")(py_hist, my_pos, num_moves);
+            } catch (const bp::error_already_set&) {
+                throw PythonError::fetch();
+            }
+        }
+};
+
+class SeatPlayerWrap : public SeatPlayer,
+                       public bp::wrapper<SeatPlayer>
+{
+public:
+    SeatPlayerWrap(const std::string& name) :
+        SeatPlayer(name)
+        {}
+
+    // The view passed to Python is only valid during the call.
+    Move nextMove(const SeatView& view) const
+        {
+            ScopedGIL gil;
+            try {
+                return this->get_override("next_move")(view);
+            } catch (const bp::error_already_set&) {
+                throw PythonError::fetch();
+            }
+        }
+};
+
+/* An AsyncResult which keeps the Python objects its work uses alive
+ * until the work is done. */
+template <typename R>
+class PyAsyncResult : public AsyncResult<R>
+{
+public:
+    // The last reference may be dropped on a pool thread, possibly
+    // while the interpreter is exiting, in which case the objects are
+    // simply leaked.
+    ~PyAsyncResult()
+        {
+            if (pythonFinalizing())
+                return;
+            ScopedGIL gil;
+            for (std::size_t i = 0; i < keep_alive_.size(); ++i)
+                Py_DECREF(keep_alive_[i]);
+        }
+
+    void keepAlive(bp::object obj) { keep_alive_.push_back(bp::incref(obj.ptr())); }
+
+private:
+    std::vector<PyObject*> keep_alive_;
+};
+
+typedef PyAsyncResult<std::vector<int> > PlayTask;
+typedef PyAsyncResult<std::vector<MatchSummary> > TournamentTask;
+
+template <typename Task>
+bp::list Task_result(const Task& task)
+{
+    return toList(task.get());
+}
+
+boost::shared_ptr<PlayTask> submit_play(bp::object p1,
+                                        bp::object p2,
+                                        std::size_t num_rounds)
+{
+    const Player* a = bp::extract<const Player*>(p1);
+    const Player* b = bp::extract<const Player*>(p2);
+
+    boost::shared_ptr<PlayTask> task(new PlayTask);
+    task->keepAlive(p1);
+    task->keepAlive(p2);
+    defaultPool().submit([task, a, b, num_rounds] {
+            try {
+                task->set(play(*a, *b, num_rounds, task->stopFlag()));
+            } catch (const std::exception&) {
+                task->fail(std::current_exception());
+            }
+        });
+    return task;
+}
+
+boost::shared_ptr<TournamentTask> submit_tournament(bp::object players,
+                                                    std::size_t num_rounds)
+{
+    std::vector<const Player*> ps = lineup(players);
+
+    boost::shared_ptr<TournamentTask> task(new TournamentTask);
+    task->keepAlive(bp::list(players));
+    defaultPool().submit([task, ps, num_rounds] {
+            try {
+                task->set(roundRobin(ps, num_rounds, defaultPool(), task->stopFlag()));
+            } catch (const std::exception&) {
+                task->fail(std::current_exception());
+            }
+        });
+    return task;
+}
+
+template <typename Task>
+void exposeTask(const char* name)
+{
+    bp::class_<Task, boost::shared_ptr<Task>, boost::noncopyable>(name, bp::no_init)
+        .def("fileno", &Task::fileno)
+        .def("done", &Task::done)
+        .def("cancel", &Task::cancel)
+        .add_property("cancelled", &Task::cancelled)
+        .def("result", Task_result<Task>)
+        ;
+}
+
+// asyncio front-ends for the submit_* functions. A task's self-pipe is
+// watched by the running loop, so awaiting never blocks the loop, and
+// cancelling the returned future cancels the native work.
+const char* ASYNC_SOURCE =
+    "import asyncio as _asyncio\n"
+    "\n"
+    "async def _wait(task):\n"
+    "    loop = _asyncio.get_running_loop()\n"
+    "    ready = loop.create_future()\n"
+    "    fd = task.fileno()\n"
+    "    def on_ready():\n"
+    "        if not ready.done():\n"
+    "            ready.set_result(None)\n"
+    "    loop.add_reader(fd, on_ready)\n"
+    "    try:\n"
+    "        await ready\n"
+    "    except _asyncio.CancelledError:\n"
+    "        task.cancel()\n"
+    "        raise\n"
+    "    finally:\n"
+    "        loop.remove_reader(fd)\n"
+    "    return task.result()\n"
+    "\n"
+    "def play_async(p1, p2, num_rounds):\n"
+    "    '''Plays a match on the native thread pool. Returns a future.'''\n"
+    "    return _asyncio.ensure_future(_wait(submit_play(p1, p2, num_rounds)))\n"
+    "\n"
+    "def tournament_async(players, num_rounds):\n"
+    "    '''Plays a round-robin on the native thread pool. Returns a future.'''\n"
+    "    return _asyncio.ensure_future(_wait(submit_tournament(players, num_rounds)))\n";
+
+bp::list py_play_strategies(const std::string& s1,
+                            const std::string& s2,
+                            std::vector<int>::size_type num_rounds)
+{
+    StrategyFn f1 = findStrategy(s1), f2 = findStrategy(s2);
+    std::vector<int> scores;
+    {
+        ReleaseGIL nogil;
+        scores = playStrategies(f1, f2, num_rounds);
+    }
+    return toList(scores);
+}
+
+bp::list strategy_names()
+{
+    bp::list names;
+    for (std::map<std::string, StrategyFn>::const_iterator it = strategies().begin();
+         it != strategies().end(); ++it)
+        names.append(it->first);
+    return names;
+}
+
+MatrixGame* MatrixGame_init(bp::object payoff)
+{
+    std::size_t n = bp::len(payoff);
+    std::vector<double> table;
+    for (std::size_t a = 0; a < n; ++a) {
+        bp::object row = payoff[a];
+        if (std::size_t(bp::len(row)) != n)
+            throw std::invalid_argument("payoff matrix must be square");
+        for (std::size_t b = 0; b < n; ++b)
+            table.push_back(bp::extract<double>(row[b]));
+    }
+    return new MatrixGame(table, n);
+}
+
+bp::object MatrixGame_payoffMatrix(const MatrixGame& g)
+{
+    std::vector<double> table = g.payoffMatrix();
+    return ownedArrayView(table, g.numMoves(), g.numMoves());
+}
+
+/* Scores two equally long buffers of uint8 moves. Returns a pair of
+ * float64 arrays with each player's payoffs. */
+bp::tuple MatrixGame_score(const MatrixGame& g, bp::object moves1, bp::object moves2)
+{
+    InputBuffer<unsigned char> m1(moves1), m2(moves2);
+    if (m1.size() != m2.size())
+        throw std::invalid_argument("move sequences differ in length");
+
+    std::size_t n = m1.size();
+    std::vector<double> s1(n), s2(n);
+    if (n) {
+        ReleaseGIL nogil;
+        g.score(m1.data(), m2.data(), n, &s1[0], &s2[0]);
+    }
+    return bp::make_tuple(ownedArrayView(s1, n), ownedArrayView(s2, n));
+}
+
+/* Plays a match. Returns (moves, payoffs), each a num_rounds x 2 array. */
+bp::tuple MatrixGame_play(const MatrixGame& g,
+                          const GamePlayer& p1,
+                          const GamePlayer& p2,
+                          std::size_t num_rounds)
+{
+    std::vector<unsigned char> moves;
+    std::vector<double> payoffs;
+    {
+        ReleaseGIL nogil;
+        g.play(p1, p2, num_rounds, moves, payoffs);
+    }
+    return bp::make_tuple(ownedArrayView(moves, num_rounds, 2),
+                          ownedArrayView(payoffs, num_rounds, 2));
+}
+
+bp::object py_solve_equilibrium(const MatrixGame& game,
+                                const std::string& method,
+                                std::size_t iterations)
+{
+    std::vector<double> x;
+    {
+        ReleaseGIL nogil;
+        x = solveEquilibrium(game, method, iterations);
+    }
+    return ownedArrayView(x, x.size());
+}
+
+double py_exploitability(const MatrixGame& game, bp::object strategy)
+{
+    std::vector<double> x;
+    for (bp::ssize_t i = 0, n = bp::len(strategy); i < n; ++i)
+        x.push_back(bp::extract<double>(strategy[i]));
+    return exploitability(game, x);
+}
+
+bp::list RegretMatcher_strategy(const RegretMatcher& p,
+                                unsigned char my_pos,
+                                bp::object context)
+{
+    const MatchContext* ctx = 0;
+    if (!context.is_none())
+        ctx = &bp::extract<const MatchContext&>(context)();
+    bp::list rslt;
+    BOOST_FOREACH(float f, p.strategy(my_pos, ctx)) {
+        rslt.append(f);
+    }
+    return rslt;
+}
+
+bp::object columnBytes(const unsigned char* col, std::size_t rounds)
+{
+    return bp::object(bp::handle<>(PyBytes_FromStringAndSize(
+        reinterpret_cast<const char*>(col), rounds)));
+}
+
+bp::object SeatView_mine(const SeatView& v)
+{
+    return columnBytes(v.mine(), v.rounds());
+}
+
+bp::object SeatView_opponent(const SeatView& v, std::size_t k)
+{
+    if (k + 1 >= v.numSeats())
+        throw std::out_of_range("opponent index out of range");
+    return columnBytes(v.opponent(k), v.rounds());
+}
+
+/* Plays a free-for-all. Returns (scores, history) where history is a
+ * num_seats x num_rounds uint8 array of moves. */
+bp::tuple py_play_multi(bp::object players, std::size_t num_rounds)
+{
+    std::vector<const SeatPlayer*> seats;
+    for (bp::ssize_t i = 0, n = bp::len(players); i < n; ++i) {
+        const SeatPlayer& p = bp::extract<const SeatPlayer&>(players[i]);
+        seats.push_back(&p);
+    }
+
+    SeatHistory history(seats.size(), num_rounds);
+    std::vector<std::int64_t> totals;
+    {
+        ReleaseGIL nogil;
+        totals = playSeats(seats, num_rounds, history);
+    }
+
+    bp::list scores;
+    BOOST_FOREACH(std::int64_t t, totals) {
+        scores.append(t);
+    }
+    return bp::make_tuple(scores,
+                          ownedArrayView(history.data(), seats.size(), num_rounds));
+}
+
+/* Counts the Rock, Paper and Scissors moves in a buffer of uint8
+ * moves. */
+bp::list py_histogram(bp::object moves)
+{
+    InputBuffer<unsigned char> m(moves);
+    std::size_t counts[3] = {0, 0, 0};
+    {
+        ReleaseGIL nogil;
+        histogram(m.data(), m.size(), counts);
+    }
+    bp::list rslt;
+    for (int i = 0; i < 3; ++i)
+        rslt.append(counts[i]);
+    return rslt;
+}
+
+/* Runs a Swiss tournament. Returns (ranking, points, results) where
+ * points count a match won as 1 and a draw or bye as 0.5. */
+bp::tuple runSwiss(const std::vector<const Player*>& ps,
+                   std::size_t num_rounds,
+                   std::size_t swiss_rounds)
+{
+    SwissResult r;
+    {
+        ReleaseGIL nogil;
+        std::atomic<bool> stop(false);
+        r = swiss(ps, num_rounds, swiss_rounds, defaultPool(), stop);
+    }
+
+    bp::list ranking, points;
+    BOOST_FOREACH(std::size_t i, r.ranking) {
+        ranking.append(i);
+    }
+    BOOST_FOREACH(unsigned h, r.half_points) {
+        points.append(h / 2.0);
+    }
+    return bp::make_tuple(ranking, points, toList(r.matches));
+}
+
+bp::tuple py_swiss(bp::object players, std::size_t num_rounds, std::size_t swiss_rounds)
+{
+    return runSwiss(lineup(players), num_rounds, swiss_rounds);
+}
+
+/* Races for the top k. Returns a dict with the top players, the
+ * estimated scores, matches per player, the matches played against a
+ * full round-robin's, and whether the race was conclusive. */
+bp::dict runRace(const std::vector<const Player*>& ps,
+                 std::size_t k,
+                 std::size_t num_rounds,
+                 double delta,
+                 std::size_t max_matches,
+                 std::uint64_t seed)
+{
+    RaceResult r;
+    {
+        ReleaseGIL nogil;
+        std::atomic<bool> stop(false);
+        r = race(ps, k, num_rounds, delta, max_matches, seed, defaultPool(), stop);
+    }
+
+    bp::list top, matches;
+    BOOST_FOREACH(std::size_t i, r.top) {
+        top.append(i);
+    }
+    BOOST_FOREACH(std::size_t m, r.matches) {
+        matches.append(m);
+    }
+    bp::dict rslt;
+    rslt["top"] = top;
+    rslt["scores"] = ownedArrayView(r.score, ps.size());
+    rslt["matches"] = matches;
+    rslt["total_matches"] = r.total_matches;
+    rslt["round_robin_matches"] = r.round_robin_matches;
+    rslt["saved"] = 1.0 - double(r.total_matches) / r.round_robin_matches;
+    rslt["confident"] = r.confident;
+    return rslt;
+}
+
+bp::dict py_race(bp::object players,
+                 std::size_t k,
+                 std::size_t num_rounds,
+                 double delta,
+                 std::size_t max_matches,
+                 std::uint64_t seed)
+{
+    return runRace(lineup(players), k, num_rounds, delta, max_matches, seed);
+}
+
+/* Installs `cache` (a ResultCache, or None to remove it) for all
+ * matches. */
+void set_result_cache(bp::object cache)
+{
+    if (cache.is_none())
+        setMatchCache(std::shared_ptr<MatchCache>());
+    else
+        setMatchCache(bp::extract<std::shared_ptr<ResultCache> >(cache)());
+}
+
+std::size_t League_update(League& league)
+{
+    ReleaseGIL nogil;
+    std::atomic<bool> stop(false);
+    return league.update(defaultPool(), stop);
+}
+
+/* Standings as (name, matches, wins, losses, draws, round_wins,
+ * round_losses, round_ties) tuples, in the order members joined. */
+bp::list League_standings(const League& league)
+{
+    bp::list rslt;
+    BOOST_FOREACH(const Standing& s, league.standings()) {
+        rslt.append(bp::make_tuple(s.name, s.matches, s.wins, s.losses, s.draws,
+                                   s.round_wins, s.round_losses, s.round_ties));
+    }
+    return rslt;
+}
+
+bp::list League_results(const League& league)
+{
+    return toList(league.results());
+}
+
+bp::object League_headToHead(const League& league)
+{
+    std::vector<std::int64_t> table = league.headToHead();
+    return ownedArrayView(table, league.size(), league.size());
+}
+
+Ratings League_ratings(const League& league, const std::string& system)
+{
+    RatingSystem s = ratingSystem(system);
+    ReleaseGIL nogil;
+    return league.ratings(s, defaultPool());
+}
+
+MemoryOne* MemoryOne_init(unsigned char first, bp::object table)
+{
+    if (bp::len(table) != 9)
+        throw std::invalid_argument("a memory-one table has nine entries");
+    std::unique_ptr<MemoryOne> s(new MemoryOne);
+    s->first = first;
+    for (int k = 0; k < 9; ++k)
+        s->table[k] = bp::extract<unsigned char>(table[k]);
+    if (!s->valid())
+        throw std::invalid_argument("memory-one entries are moves or RANDOM_ENTRY (3)");
+    return s.release();
+}
+
+bp::list MemoryOne_table(const MemoryOne& s)
+{
+    bp::list rslt;
+    for (int k = 0; k < 9; ++k)
+        rslt.append(s.table[k]);
+    return rslt;
+}
+
+unsigned MemoryOne_first(const MemoryOne& s)
+{
+    return s.first;
+}
+
+/* Plays memory-one matches in lanes. `pairs` is a sequence of (i, j)
+ * strategy index pairs, or a buffer of uint32 holding them flattened.
+ * Returns (p1_wins, p2_wins, ties) as uint32 arrays. */
+bp::tuple py_play_lanes(bp::object strategies,
+                        bp::object pairs,
+                        std::size_t num_rounds,
+                        std::uint64_t seed)
+{
+    std::vector<MemoryOne> ss;
+    for (bp::ssize_t i = 0, n = bp::len(strategies); i < n; ++i)
+        ss.push_back(bp::extract<const MemoryOne&>(strategies[i]));
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t> > ps;
+    if (PyObject_CheckBuffer(pairs.ptr())) {
+        InputBuffer<std::uint32_t> flat(pairs);
+        if (flat.size() % 2)
+            throw std::invalid_argument("pair buffer has an odd length");
+        for (std::size_t i = 0; i < flat.size(); i += 2)
+            ps.push_back(std::make_pair(flat.data()[i], flat.data()[i + 1]));
+    } else {
+        for (bp::ssize_t i = 0, n = bp::len(pairs); i < n; ++i)
+            ps.push_back(std::make_pair(bp::extract<std::uint32_t>(pairs[i][0])(),
+                                        bp::extract<std::uint32_t>(pairs[i][1])()));
+    }
+
+    LaneResults r;
+    {
+        ReleaseGIL nogil;
+        r = playLanes(ss, ps, num_rounds, seed, defaultPool());
+    }
+    return bp::make_tuple(ownedArrayView(r.p1_wins, ps.size()),
+                          ownedArrayView(r.p2_wins, ps.size()),
+                          ownedArrayView(r.ties, ps.size()));
+}
+
+/* A list of (moves, next) state descriptions: three probabilities and
+ * nine successor states each. */
+Automaton* Automaton_init(bp::object states)
+{
+    std::unique_ptr<Automaton> a(new Automaton);
+    for (bp::ssize_t i = 0, n = bp::len(states); i < n; ++i) {
+        bp::object moves = states[i][0], next = states[i][1];
+        if (bp::len(moves) != 3 || bp::len(next) != 9)
+            throw std::invalid_argument("an automaton state is (three probabilities, nine successors)");
+        AutomatonState s;
+        for (int m = 0; m < 3; ++m)
+            s.moves[m] = bp::extract<double>(moves[m]);
+        for (int k = 0; k < 9; ++k)
+            s.next[k] = bp::extract<std::uint32_t>(next[k]);
+        a->states.push_back(s);
+    }
+    a->check();
+    return a.release();
+}
+
+std::size_t Automaton_len(const Automaton& a)
+{
+    return a.states.size();
+}
+
+/* An Automaton, a MemoryOne, or a player with a known automaton. */
+Automaton toAutomaton(bp::object o)
+{
+    bp::extract<const Automaton&> automaton(o);
+    if (automaton.check())
+        return automaton();
+    bp::extract<const MemoryOne&> memory_one(o);
+    if (memory_one.check())
+        return Automaton::fromMemoryOne(memory_one());
+    Automaton a;
+    bp::extract<const Player&> player(o);
+    if (!player.check() || !playerAutomaton(player(), a))
+        throw std::invalid_argument("not a finite-state strategy");
+    return a;
+}
+
+bp::tuple py_expected_scores(bp::object p1, bp::object p2, std::size_t num_rounds)
+{
+    ProductChain chain(toAutomaton(p1), toAutomaton(p2));
+    Expectation e = chain.expected(num_rounds);
+    return bp::make_tuple(e.p1_wins, e.p2_wins, e.ties);
+}
+
+bp::tuple py_long_run(bp::object p1, bp::object p2, double tolerance)
+{
+    ProductChain chain(toAutomaton(p1), toAutomaton(p2));
+    Expectation e = chain.longRun(tolerance);
+    return bp::make_tuple(e.p1_wins, e.p2_wins, e.ties);
+}
+
+bp::list py_sample_strategy_space(std::size_t count, std::uint64_t seed)
+{
+    bp::list rslt;
+    BOOST_FOREACH(const MemoryOne& s, sampleStrategySpace(count, seed)) {
+        rslt.append(s);
+    }
+    return rslt;
+}
+
+/* Runs `work` on a thread of its own while the calling thread, holding
+   the GIL between waits, handles signals. If a signal handler raises
+   (KeyboardInterrupt on Ctrl-C) `stop` is set, the work is waited for,
+   and the Python exception is raised.
+*/
+template <typename F>
+void runInterruptibly(F work, std::atomic<bool>& stop)
+{
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    std::exception_ptr error;
+    std::thread worker([&] {
+            try {
+                work();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            finished.notify_one();
+        });
+
+    bool interrupted = false;
+    for (;;) {
+        bool ready;
+        {
+            ReleaseGIL nogil;
+            std::unique_lock<std::mutex> lock(mutex);
+            ready = finished.wait_for(lock, std::chrono::milliseconds(50), [&] { return done; });
+        }
+        if (ready)
+            break;
+        if (!interrupted && PyErr_CheckSignals() != 0) {
+            interrupted = true;
+            stop = true;
+        }
+    }
+    worker.join();
+
+    if (interrupted)
+        bp::throw_error_already_set();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+/* Plays codes [begin, end) of the memory-one space against
+   `opponents` into the matrix file `path`. An interrupt stops the run
+   after the chunk in progress, leaving a valid file with the rows
+   finished so far, and is then raised.
+*/
+bp::dict py_play_strategy_space(const std::string& path,
+                                bp::object opponents,
+                                std::size_t num_rounds,
+                                std::uint32_t begin,
+                                std::uint32_t end,
+                                std::uint64_t seed)
+{
+    std::vector<MemoryOne> os;
+    for (bp::ssize_t i = 0, n = bp::len(opponents); i < n; ++i)
+        os.push_back(bp::extract<const MemoryOne&>(opponents[i]));
+
+    SpaceRun r;
+    std::atomic<bool> stop(false);
+    runInterruptibly([&] {
+            r = playStrategySpace(os, begin, end, num_rounds, seed, path, defaultPool(), stop);
+        }, stop);
+    bp::dict rslt;
+    rslt["rows"] = r.rows;
+    rslt["cols"] = r.cols;
+    rslt["matches"] = r.matches;
+    rslt["complete"] = r.complete;
+    return rslt;
+}
+
+/* Returns (begin, opponents, scores) from a matrix file, with scores
+ * a rows x cols int16 array. */
+bp::tuple py_load_strategy_space(const std::string& path)
+{
+    SpaceMatrix m = loadStrategySpace(path);
+    bp::list opponents;
+    BOOST_FOREACH(const MemoryOne& o, m.opponents) {
+        opponents.append(o);
+    }
+    return bp::make_tuple(m.begin, opponents, ownedArrayView(m.scores, m.rows, m.cols));
+}
+
+Evolution* Evolution_init(bp::object opponents,
+                          std::size_t population_size,
+                          std::size_t num_rounds,
+                          double mutation_rate,
+                          double crossover_rate,
+                          std::size_t elite,
+                          std::size_t tournament_size,
+                          std::uint64_t seed)
+{
+    std::vector<MemoryOne> os;
+    for (bp::ssize_t i = 0, n = bp::len(opponents); i < n; ++i)
+        os.push_back(bp::extract<const MemoryOne&>(opponents[i]));
+
+    EvolutionConfig config;
+    config.population_size = population_size;
+    config.num_rounds = num_rounds;
+    config.mutation_rate = mutation_rate;
+    config.crossover_rate = crossover_rate;
+    config.elite = elite;
+    config.tournament_size = tournament_size;
+    config.seed = seed;
+    return new Evolution(os, config);
+}
+
+/* Runs one generation. Returns a dict with its index, the population
+ * best first with its fitness, and how many genomes were evaluated
+ * and found in the cache. */
+bp::dict Evolution_step(Evolution& e)
+{
+    Generation g;
+    {
+        ReleaseGIL nogil;
+        g = e.step(defaultPool());
+    }
+
+    bp::list population;
+    BOOST_FOREACH(const MemoryOne& s, g.population) {
+        population.append(s);
+    }
+    bp::dict rslt;
+    rslt["generation"] = g.index;
+    rslt["population"] = population;
+    rslt["fitness"] = ownedArrayView(g.fitness, g.population.size());
+    rslt["evaluated"] = g.evaluated;
+    rslt["cache_hits"] = g.cache_hits;
+    return rslt;
+}
+
+/* Runs up to `generations` generations, passing each to `callback`,
+ * which may return False to stop early. Returns the last one. */
+bp::object Evolution_run(Evolution& e, std::size_t generations, bp::object callback)
+{
+    bp::object last;
+    for (std::size_t i = 0; i < generations; ++i) {
+        last = Evolution_step(e);
+        if (!callback.is_none()) {
+            bp::object keep_going = callback(last);
+            if (!keep_going.is_none() && !bp::extract<bool>(keep_going))
+                break;
+        }
+    }
+    return last;
+}
+
+MatrixGame py_strategy_game(bp::object strategies, std::size_t num_rounds)
+{
+    std::vector<MemoryOne> ss;
+    for (bp::ssize_t i = 0, n = bp::len(strategies); i < n; ++i)
+        ss.push_back(bp::extract<const MemoryOne&>(strategies[i]));
+    ReleaseGIL nogil;
+    return strategyGame(ss, num_rounds, defaultPool());
+}
+
+void Replicator_setFrequencies(Replicator& r, bp::object x)
+{
+    std::vector<double> freqs;
+    for (bp::ssize_t i = 0, n = bp::len(x); i < n; ++i)
+        freqs.push_back(bp::extract<double>(x[i]));
+    r.setFrequencies(freqs);
+}
+
+bp::object Replicator_frequencies(const Replicator& r)
+{
+    std::vector<double> x = r.frequencies();
+    return ownedArrayView(x, r.size());
+}
+
+/* Advances the dynamics. Returns the recorded frequencies as a
+ * float64 array with one row per record. */
+bp::object Replicator_advance(Replicator& r, std::size_t steps, double dt, std::size_t record_every)
+{
+    std::vector<double> trajectory;
+    {
+        ReleaseGIL nogil;
+        r.advance(steps, dt, record_every, trajectory, defaultPool());
+    }
+    return ownedArrayView(trajectory, trajectory.size() / r.size(), r.size());
+}
+
+void AgentPopulation_setCounts(AgentPopulation& p, bp::object counts)
+{
+    std::vector<std::size_t> cs;
+    for (bp::ssize_t i = 0, n = bp::len(counts); i < n; ++i)
+        cs.push_back(bp::extract<std::size_t>(counts[i]));
+    p.setCounts(cs);
+}
+
+bp::object AgentPopulation_counts(const AgentPopulation& p)
+{
+    std::vector<std::int64_t> counts = p.counts();
+    return ownedArrayView(counts, p.numStrategies());
+}
+
+/* The agents' strategies as a read-only uint8 array, updated in place
+ * as the population advances. */
+bp::object AgentPopulation_agents(bp::object self)
+{
+    const AgentPopulation& p = bp::extract<const AgentPopulation&>(self);
+    return arrayView(self, const_cast<unsigned char*>(p.agents()), p.size(), -1, true);
+}
+
+/* Advances the population. Returns the strategy counts after each
+ * generation as a generations x strategies int64 array. */
+bp::object AgentPopulation_advance(AgentPopulation& p, std::size_t generations)
+{
+    std::vector<std::int64_t> trajectory;
+    {
+        ReleaseGIL nogil;
+        p.advance(generations, trajectory, defaultPool());
+    }
+    return ownedArrayView(trajectory, generations, p.numStrategies());
+}
+
+/* The lattice's cells as a writable height x width uint8 array, kept
+ * in step with the lattice. Cells must be set to 0, 1 or 2. */
+bp::object Lattice_grid(bp::object self)
+{
+    Lattice& l = bp::extract<Lattice&>(self);
+    return arrayView(self, l.cells(), l.height(), l.width());
+}
+
+void Lattice_step(Lattice& l, std::size_t generations, unsigned threshold, bool moore)
+{
+    ReleaseGIL nogil;
+    l.step(generations, threshold, moore, defaultPool());
+}
+
+void Lattice_sweep(Lattice& l, std::size_t num_sweeps, std::uint64_t seed)
+{
+    ReleaseGIL nogil;
+    l.sweep(num_sweeps, seed, defaultPool());
+}
+
+bp::tuple Lattice_counts(const Lattice& l)
+{
+    std::vector<std::size_t> c = l.counts();
+    return bp::make_tuple(c[0], c[1], c[2]);
+}
+
+/* A recording of the move file at a path (a str), or of the moves in a
+ * buffer of bytes. It keeps a view of a bytes object while it lives,
+ * since that cannot change, and copies any other buffer, which might:
+ * the moves are only checked once. */
+std::shared_ptr<MoveRecording> MoveRecording_init(bp::object source)
+{
+    if (PyUnicode_Check(source.ptr()))
+        return std::make_shared<MoveRecording>(bp::extract<std::string>(source)());
+
+    std::unique_ptr<Py_buffer> view(new Py_buffer);
+    if (PyObject_GetBuffer(source.ptr(), view.get(), PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+        bp::throw_error_already_set();
+    if (view->itemsize != 1) {
+        PyBuffer_Release(view.get());
+        throw std::invalid_argument("moves must be one byte each");
+    }
+    if (!PyBytes_Check(source.ptr())) {
+        const unsigned char* p = static_cast<const unsigned char*>(view->buf);
+        std::vector<unsigned char> moves(p, p + view->len);
+        PyBuffer_Release(view.get());
+        return std::make_shared<MoveRecording>(std::move(moves));
+    }
+    // The last reference may go on a pool thread, or at exit.
+    Py_buffer* released = view.release();
+    return std::make_shared<MoveRecording>(
+        static_cast<const unsigned char*>(released->buf), released->len, [released] {
+            if (!pythonFinalizing()) {
+                ScopedGIL gil;
+                PyBuffer_Release(released);
+            }
+            delete released;
+        });
+}
+
+Move MoveRecording_getitem(const MoveRecording& r, std::size_t i)
+{
+    if (i >= r.size())
+        throw std::out_of_range("move index out of range");
+    return r.at(i);
+}
+
+void py_write_move_file(const std::string& path, bp::object moves)
+{
+    std::vector<unsigned char> ms;
+    if (PyObject_CheckBuffer(moves.ptr())) {
+        InputBuffer<unsigned char> b(moves);
+        ms.assign(b.data(), b.data() + b.size());
+    } else {
+        for (bp::ssize_t i = 0, n = bp::len(moves); i < n; ++i)
+            ms.push_back(bp::extract<unsigned char>(moves[i]));
+    }
+    writeMoveFile(path, ms.empty() ? 0 : &ms[0], ms.size());
+}
+
+ReplayPlayer* ReplayPlayer_init(const std::string& name,
+                                std::shared_ptr<MoveRecording> recording,
+                                std::size_t offset)
+{
+    return new ReplayPlayer(name, recording, offset);
+}
+
+/* Counts the rounds of a log, given as the path of a log file (a str)
+ * or as a buffer of bytes. */
+void NGramTrainer_add(NGramTrainer& t, bp::object source)
+{
+    if (PyUnicode_Check(source.ptr())) {
+        const std::string path = bp::extract<std::string>(source);
+        MappedFile log(path);
+        ReleaseGIL nogil;
+        log.adviseSequential();
+        t.add(log.data(), log.size(), defaultPool());
+    } else {
+        InputBuffer<unsigned char> log(source);
+        ReleaseGIL nogil;
+        t.add(log.data(), log.size(), defaultPool());
+    }
+}
+
+bp::dict NGramTrainer_write(const NGramTrainer& t, const std::string& path)
+{
+    NGramSummary summary;
+    {
+        ReleaseGIL nogil;
+        summary = t.write(path, defaultPool());
+    }
+    bp::dict rslt;
+    rslt["contexts"] = summary.contexts;
+    rslt["rounds"] = summary.rounds;
+    rslt["digest"] = summary.digest;
+    return rslt;
+}
+
+/* The counts of the subject's next move after `context`, a sequence of
+ * (subject, other) move pairs, oldest first; None if it never
+ * occurred. */
+bp::object NGramModel_counts(const NGramModel& m, bp::object context)
+{
+    const bp::ssize_t n = bp::len(context);
+    if (n > bp::ssize_t(m.order()))
+        throw std::invalid_argument("context is longer than the model's order");
+    std::uint64_t code = 0;
+    for (bp::ssize_t i = 0; i < n; ++i) {
+        unsigned subject = bp::extract<unsigned>(context[i][0]);
+        unsigned other = bp::extract<unsigned>(context[i][1]);
+        if (subject > 2 || other > 2)
+            throw std::invalid_argument("moves must be 0, 1 or 2");
+        code = code * 9 + subject * 3 + other;
+    }
+    const std::uint32_t* c = m.lookup(code, n);
+    if (!c)
+        return bp::object();
+    return bp::make_tuple(c[0], c[1], c[2]);
+}
+
+NGramPlayer* NGramPlayer_init(const std::string& name,
+                              std::shared_ptr<NGramModel> model,
+                              std::uint32_t min_count)
+{
+    return new NGramPlayer(name, model, min_count);
+}
+
+MctsPlayer* MctsPlayer_init(const std::string& name,
+                            std::size_t depth,
+                            double budget,
+                            std::size_t iterations,
+                            std::size_t threads,
+                            double exploration,
+                            std::size_t max_nodes,
+                            bp::object model,
+                            double prior_weight,
+                            std::uint64_t seed)
+{
+    if (budget < 0)
+        throw std::invalid_argument("budget must be non-negative");
+    MctsConfig config;
+    config.depth = depth;
+    config.budget_us = std::size_t(budget * 1e6);
+    config.max_iterations = iterations;
+    config.threads = threads;
+    config.exploration = exploration;
+    config.max_nodes = max_nodes;
+    config.prior_weight = prior_weight;
+    config.seed = seed;
+    std::shared_ptr<const NGramModel> m;
+    if (!model.is_none())
+        m = bp::extract<const std::shared_ptr<NGramModel>&>(model)();
+    return new MctsPlayer(name, config, defaultPool(), m);
+}
+
+bp::dict MctsPlayer_search_stats(const MctsPlayer& p, unsigned char seat)
+{
+    MctsStats stats = p.stats(seat);
+    bp::dict rslt;
+    rslt["iterations"] = stats.iterations;
+    rslt["nodes"] = stats.nodes;
+    rslt["reused"] = stats.reused;
+    return rslt;
+}
+
+/* `layers` is a sequence of (weights, bias) pairs, the weights a
+ * sequence of rows, one per output. */
+void py_write_mlp_model(const std::string& path, std::size_t window, bp::object layers)
+{
+    std::vector<MlpLayer> ls;
+    for (bp::ssize_t l = 0, n = bp::len(layers); l < n; ++l) {
+        bp::object weights = layers[l][0], bias = layers[l][1];
+        MlpLayer layer;
+        layer.outputs = bp::len(weights);
+        layer.inputs = layer.outputs ? bp::len(weights[0]) : 0;
+        for (std::size_t j = 0; j < layer.outputs; ++j) {
+            if (std::size_t(bp::len(weights[j])) != layer.inputs)
+                throw std::invalid_argument("weight rows differ in length");
+            for (std::size_t i = 0; i < layer.inputs; ++i)
+                layer.weights.push_back(bp::extract<float>(weights[j][i]));
+        }
+        for (bp::ssize_t j = 0, m = bp::len(bias); j < m; ++j)
+            layer.bias.push_back(bp::extract<float>(bias[j]));
+        ls.push_back(layer);
+    }
+    writeMlpModel(path, window, ls);
+}
+
+/* The model's logits for the opponent's next move after the rounds in
+ * which the player played `mine` and the opponent `theirs`. */
+bp::tuple MlpModel_logits(const MlpModel& m, bp::object mine, bp::object theirs)
+{
+    std::vector<unsigned char> ms, ts;
+    for (bp::ssize_t i = 0, n = bp::len(mine); i < n; ++i) {
+        ms.push_back(bp::extract<unsigned char>(mine[i]));
+        ts.push_back(bp::extract<unsigned char>(theirs[i]));
+        if (ms.back() > 2 || ts.back() > 2)
+            throw std::invalid_argument("moves must be 0, 1 or 2");
+    }
+    float logits[3];
+    m.logits(ms.empty() ? 0 : &ms[0], ts.empty() ? 0 : &ts[0], ms.size(), logits);
+    return bp::make_tuple(logits[0], logits[1], logits[2]);
+}
+
+MlpPlayer* MlpPlayer_init(const std::string& name, std::shared_ptr<MlpModel> model)
+{
+    return new MlpPlayer(name, model);
+}
+
+bp::list player_kinds()
+{
+    bp::list kinds;
+    BOOST_FOREACH(const std::string& k, playerRegistry().kinds()) {
+        kinds.append(k);
+    }
+    return kinds;
+}
+
+/* Plays `swiss_rounds` Swiss rounds over the whole population, each
+ * pairing players with similar points; see `runSwiss`. The lineup is
+ * copied first so that the population may grow while the GIL is
+ * released. */
+bp::tuple Population_swiss(const Population& p,
+                           std::size_t num_rounds,
+                           std::size_t swiss_rounds)
+{
+    std::vector<const Player*> ps = p.lineup();
+    return runSwiss(ps, num_rounds, swiss_rounds);
+}
+
+bp::dict Population_race(const Population& p,
+                         std::size_t k,
+                         std::size_t num_rounds,
+                         double delta,
+                         std::size_t max_matches,
+                         std::uint64_t seed)
+{
+    std::vector<const Player*> ps = p.lineup();
+    return runRace(ps, k, num_rounds, delta, max_matches, seed);
+}
+
+bp::list Population_tournament(const Population& p, std::size_t num_rounds)
+{
+    std::vector<const Player*> ps = p.lineup();
+    std::vector<MatchSummary> results;
+    {
+        ReleaseGIL nogil;
+        std::atomic<bool> stop(false);
+        results = roundRobin(ps, num_rounds, defaultPool(), stop);
+    }
+    return toList(results);
+}
+
+/* Reads a result tuple as returned by `tournament`. */
+MatchSummary toSummary(bp::object result)
+{
+    MatchSummary s;
+    s.p1 = bp::extract<std::size_t>(result[0]);
+    s.p2 = bp::extract<std::size_t>(result[1]);
+    s.p1_wins = bp::extract<std::size_t>(result[2]);
+    s.p2_wins = bp::extract<std::size_t>(result[3]);
+    s.ties = bp::extract<std::size_t>(result[4]);
+    return s;
+}
+
+Ratings* Ratings_init(std::size_t num_players, const std::string& system, double k)
+{
+    return new Ratings(num_players, ratingSystem(system), k);
+}
+
+std::string Ratings_system(const Ratings& r)
+{
+    const char* names[] = {"elo", "glicko", "trueskill"};
+    return names[r.system()];
+}
+
+void Ratings_update(Ratings& r, bp::object result)
+{
+    r.update(toSummary(result));
+}
+
+/* Rates a match from the scores returned by `play`. */
+void Ratings_updateScores(Ratings& r, std::size_t p1, std::size_t p2, bp::object scores)
+{
+    std::vector<int> s;
+    for (bp::ssize_t i = 0, n = bp::len(scores); i < n; ++i)
+        s.push_back(bp::extract<int>(scores[i]));
+    r.update(summarize(p1, p2, s));
+}
+
+void Ratings_updateBatch(Ratings& r, bp::object results)
+{
+    std::vector<MatchSummary> batch;
+    for (bp::ssize_t i = 0, n = bp::len(results); i < n; ++i)
+        batch.push_back(toSummary(results[i]));
+
+    ReleaseGIL nogil;
+    r.updateBatch(batch, defaultPool());
+}
+
+/* Ratings arrays as read-only zero-copy views. */
+
+bp::object Ratings_mean(bp::object self)
+{
+    const Ratings& r = bp::extract<const Ratings&>(self);
+    return arrayView(self, const_cast<double*>(r.mean()), r.numPlayers(), -1, true);
+}
+
+bp::object Ratings_deviation(bp::object self)
+{
+    const Ratings& r = bp::extract<const Ratings&>(self);
+    return arrayView(self, const_cast<double*>(r.deviation()), r.numPlayers(), -1, true);
+}
+
+bp::object Ratings_games(bp::object self)
+{
+    const Ratings& r = bp::extract<const Ratings&>(self);
+    return arrayView(self, const_cast<std::int64_t*>(r.games()), r.numPlayers(), -1, true);
+}
+
+void SharedResults_record(SharedResults& t,
+                          std::size_t match,
+                          std::size_t i,
+                          std::size_t j,
+                          const Player& p1,
+                          const Player& p2)
+{
+    ReleaseGIL nogil;
+    t.record(match, i, j, p1, p2);
+}
+
+/* SharedResults accessors returning zero-copy views. */
+
+bp::object SharedResults_headToHead(bp::object self)
+{
+    const SharedResults& t = bp::extract<const SharedResults&>(self);
+    return arrayView(self, t.headToHead(), t.numPlayers(), t.numPlayers());
+}
+
+bp::object SharedResults_matchPlayers(bp::object self)
+{
+    const SharedResults& t = bp::extract<const SharedResults&>(self);
+    return arrayView(self, t.matchPlayers(), t.numMatches(), 2);
+}
+
+bp::object SharedResults_scores(bp::object self)
+{
+    const SharedResults& t = bp::extract<const SharedResults&>(self);
+    return arrayView(self, t.matchScores(), t.numMatches(), t.numRounds());
+}
+
+BOOST_PYTHON_MODULE(rps)
+{
+    // register the to-python converter for rounds
+    bp::to_python_converter<
+        Round,
+        Round_to_tuple>();
+
+    // register the from-python converter rounds
+    Round_from_tuple();
+
+    bp::def("test", test, test_overloads());
+
+    bp::class_<PlayerWrap, boost::noncopyable>(
+        "Player", bp::init<const std::string&>())
+        .add_property("name", &PlayerWrap::name, &PlayerWrap::setName)
+        ;
+
+    bp::class_<Random, bp::bases<Player> >(
+        "Random",
+        boost::python::init<const std::string&>())
+        .def(bp::init<const std::string&, std::uint64_t>(bp::args("name", "seed")))
+        ;
+
+    bp::class_<TitForTat, bp::bases<Player> >(
+        "TitForTat",
+        boost::python::init<const std::string&>())
+        .def(bp::init<const std::string&, std::uint64_t>(bp::args("name", "seed")))
+        ;
+
+    bp::class_<FrequencyCounter, bp::bases<Player> >(
+        "FrequencyCounter",
+        boost::python::init<const std::string&>())
+        ;
+
+    bp::class_<CoroutinePlayer, bp::bases<Player>, boost::noncopyable>(
+        "CoroutinePlayer",
+        bp::init<const std::string&, const std::string&>(bp::args("name", "strategy")))
+        .add_property("strategy", &CoroutinePlayer::strategy)
+        ;
+
+    bp::class_<GamePlayerWrap, boost::noncopyable>(
+        "GamePlayer", bp::init<const std::string&>())
+        .add_property("name", &GamePlayerWrap::name, &GamePlayerWrap::setName)
+        ;
+
+    bp::class_<UniformGamePlayer, bp::bases<GamePlayer> >(
+        "UniformGamePlayer",
+        bp::init<const std::string&>())
+        ;
+
+    bp::class_<FixedGamePlayer, bp::bases<GamePlayer> >(
+        "FixedGamePlayer",
+        bp::init<const std::string&, unsigned>(bp::args("name", "move")))
+        ;
+
+    bp::class_<CopyGamePlayer, bp::bases<GamePlayer> >(
+        "CopyGamePlayer",
+        bp::init<const std::string&>())
+        ;
+
+    bp::class_<MatrixGame>("MatrixGame", bp::no_init)
+        .def("__init__", bp::make_constructor(MatrixGame_init))
+        .def("named", &MatrixGame::named)
+        .staticmethod("named")
+        .add_property("name", &MatrixGame::name)
+        .add_property("num_moves", &MatrixGame::numMoves)
+        .def("payoff", &MatrixGame::payoff, bp::args("a", "b"))
+        .def("payoff_matrix", MatrixGame_payoffMatrix)
+        .def("score", MatrixGame_score, bp::args("moves1", "moves2"))
+        .def("play", MatrixGame_play, bp::args("p1", "p2", "num_rounds"))
+        ;
+
+    bp::def("solve_equilibrium", py_solve_equilibrium,
+            (bp::arg("game"),
+             bp::arg("method")="regret_matching",
+             bp::arg("iterations")=10000));
+    bp::def("exploitability", py_exploitability, bp::args("game", "strategy"));
+
+    bp::class_<RegretMatcher, bp::bases<Player>, boost::noncopyable>(
+        "RegretMatcher",
+        bp::init<const std::string&, bp::optional<std::uint64_t> >(bp::args("name", "seed")))
+        .add_property("seed", &RegretMatcher::seed)
+        .def("strategy", RegretMatcher_strategy,
+             (bp::arg("my_pos"), bp::arg("context")=bp::object()))
+        ;
+
+    bp::class_<RegretMatchingGamePlayer, bp::bases<GamePlayer>, boost::noncopyable>(
+        "RegretMatchingGamePlayer",
+        bp::init<const std::string&, const MatrixGame&, bp::optional<std::uint64_t> >(
+            bp::args("name", "game", "seed")))
+        ;
+
+    bp::class_<SeatView>("SeatView", bp::no_init)
+        .add_property("seat", &SeatView::seat)
+        .add_property("num_seats", &SeatView::numSeats)
+        .add_property("num_rounds", &SeatView::rounds)
+        .def("mine", SeatView_mine)
+        .def("opponent", SeatView_opponent, bp::args("k"))
+        .def("opponent_seat", &SeatView::opponentSeat, bp::args("k"))
+        ;
+
+    bp::class_<SeatPlayerWrap, boost::noncopyable>(
+        "SeatPlayer", bp::init<const std::string&>())
+        .add_property("name", &SeatPlayerWrap::name, &SeatPlayerWrap::setName)
+        ;
+
+    bp::class_<SeatRandom, bp::bases<SeatPlayer> >(
+        "SeatRandom",
+        bp::init<const std::string&, bp::optional<std::uint64_t> >(bp::args("name", "seed")))
+        ;
+
+    bp::class_<BeatPlurality, bp::bases<SeatPlayer> >(
+        "BeatPlurality",
+        bp::init<const std::string&>())
+        ;
+
+    bp::class_<FixedSeat, bp::bases<SeatPlayer> >(
+        "FixedSeat",
+        bp::init<const std::string&, Move>(bp::args("name", "move")))
+        ;
+
+    bp::class_<ResultCache, std::shared_ptr<ResultCache>, boost::noncopyable>(
+        "ResultCache",
+        bp::init<std::size_t, bp::optional<const std::string&> >(bp::args("capacity", "directory")))
+        .add_property("capacity", &ResultCache::capacity)
+        .add_property("directory", &ResultCache::directory)
+        .add_property("hits", &ResultCache::hits)
+        .add_property("disk_hits", &ResultCache::diskHits)
+        .add_property("misses", &ResultCache::misses)
+        .def("__len__", &ResultCache::size)
+        .def("clear", &ResultCache::clear)
+        ;
+    bp::def("set_result_cache", set_result_cache, bp::args("cache"));
+
+    bp::def("player_kinds", player_kinds);
+
+    bp::class_<Population, boost::noncopyable>("Population")
+        .def("add", &Population::add,
+             (bp::arg("kind"), bp::arg("count"), bp::arg("name")="", bp::arg("seed")=0))
+        .def("__len__", &Population::size)
+        .def("__getitem__", &Population::operator[], bp::return_internal_reference<>())
+        .def("tournament", Population_tournament, bp::args("num_rounds"))
+        .def("swiss", Population_swiss, bp::args("num_rounds", "swiss_rounds"))
+        .def("race", Population_race,
+             (bp::arg("k"), bp::arg("num_rounds"), bp::arg("delta")=0.05,
+              bp::arg("max_matches")=0, bp::arg("seed")=0))
+        ;
+
+    bp::class_<Ratings>("Ratings", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 Ratings_init, bp::default_call_policies(),
+                 (bp::arg("num_players"), bp::arg("system")="elo", bp::arg("k")=32.0)))
+        .add_property("system", Ratings_system)
+        .add_property("num_players", &Ratings::numPlayers)
+        .def("update", Ratings_update, bp::args("result"))
+        .def("update_scores", Ratings_updateScores, bp::args("p1", "p2", "scores"))
+        .def("update_batch", Ratings_updateBatch, bp::args("results"))
+        .def("expected", &Ratings::expected, bp::args("i", "j"))
+        .def("mean", Ratings_mean)
+        .def("deviation", Ratings_deviation)
+        .def("games", Ratings_games)
+        ;
+
+    bp::class_<League, boost::noncopyable>(
+        "League",
+        bp::init<const std::string&, std::size_t>(bp::args("path", "num_rounds")))
+        .add_property("num_rounds", &League::numRounds)
+        .add_property("pending", &League::pending)
+        .def("__len__", &League::size)
+        .def("add", &League::add, bp::args("player"), bp::with_custodian_and_ward<1, 2>())
+        .def("remove", &League::remove, bp::args("name"))
+        .def("update", League_update)
+        .def("standings", League_standings)
+        .def("results", League_results)
+        .def("head_to_head", League_headToHead)
+        .def("ratings", League_ratings, (bp::arg("system")="elo"))
+        ;
+
+    bp::scope().attr("RANDOM_ENTRY") = RANDOM_ENTRY;
+
+    bp::class_<MemoryOne>("MemoryOne", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 MemoryOne_init, bp::default_call_policies(), (bp::arg("first"), bp::arg("table"))))
+        .def("named", &MemoryOne::named)
+        .staticmethod("named")
+        .def("from_code", &MemoryOne::fromCode)
+        .staticmethod("from_code")
+        .add_property("first", MemoryOne_first)
+        .add_property("table", MemoryOne_table)
+        .add_property("deterministic", &MemoryOne::deterministic)
+        .add_property("code", &MemoryOne::code)
+        ;
+
+    bp::class_<MemoryOnePlayer, bp::bases<Player> >(
+        "MemoryOnePlayer",
+        bp::init<const std::string&, const MemoryOne&, bp::optional<std::uint64_t> >(
+            bp::args("name", "strategy", "seed")))
+        ;
+
+    bp::def("play_lanes", py_play_lanes,
+            (bp::arg("strategies"), bp::arg("pairs"), bp::arg("num_rounds"), bp::arg("seed")=0));
+
+    bp::class_<Automaton>("Automaton", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 Automaton_init, bp::default_call_policies(), (bp::arg("states"))))
+        .def("from_memory_one", &Automaton::fromMemoryOne)
+        .staticmethod("from_memory_one")
+        .def("__len__", Automaton_len)
+        ;
+
+    bp::def("expected_scores", py_expected_scores, bp::args("p1", "p2", "num_rounds"));
+    bp::def("long_run", py_long_run,
+            (bp::arg("p1"), bp::arg("p2"), bp::arg("tolerance")=1e-12));
+
+    bp::def("sample_strategy_space", py_sample_strategy_space,
+            (bp::arg("count"), bp::arg("seed")=0));
+    bp::def("play_strategy_space", py_play_strategy_space,
+            (bp::arg("path"), bp::arg("opponents"), bp::arg("num_rounds"),
+             bp::arg("begin")=0, bp::arg("end")=std::uint32_t(MemoryOne::NUM_DETERMINISTIC), bp::arg("seed")=0));
+    bp::def("load_strategy_space", py_load_strategy_space, bp::args("path"));
+
+    bp::class_<Evolution, boost::noncopyable>("Evolution", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 Evolution_init, bp::default_call_policies(),
+                 (bp::arg("opponents"), bp::arg("population_size")=100, bp::arg("num_rounds")=100,
+                  bp::arg("mutation_rate")=0.05, bp::arg("crossover_rate")=0.7,
+                  bp::arg("elite")=2, bp::arg("tournament_size")=3, bp::arg("seed")=0)))
+        .def("step", Evolution_step)
+        .def("run", Evolution_run, (bp::arg("generations"), bp::arg("callback")=bp::object()))
+        .def("fitness", &Evolution::fitness)
+        .add_property("generation", &Evolution::generation)
+        .add_property("cache_size", &Evolution::cacheSize)
+        ;
+
+    bp::def("strategy_game", py_strategy_game, bp::args("strategies", "num_rounds"));
+
+    bp::class_<Replicator>(
+        "Replicator",
+        bp::init<const MatrixGame&, double>((bp::arg("game"), bp::arg("mutation")=0.0)))
+        .def("set_frequencies", Replicator_setFrequencies)
+        .def("frequencies", Replicator_frequencies)
+        .def("advance", Replicator_advance,
+             (bp::arg("steps"), bp::arg("dt")=0.01, bp::arg("record_every")=1))
+        .add_property("time", &Replicator::time)
+        ;
+
+    bp::class_<AgentPopulation, boost::noncopyable>(
+        "AgentPopulation",
+        bp::init<const MatrixGame&, std::size_t, double, double, std::uint64_t>(
+            (bp::arg("game"), bp::arg("num_agents"), bp::arg("selection")=1.0,
+             bp::arg("mutation")=0.001, bp::arg("seed")=0)))
+        .def("set_counts", AgentPopulation_setCounts)
+        .def("counts", AgentPopulation_counts)
+        .def("advance", AgentPopulation_advance)
+        .def("__len__", &AgentPopulation::size)
+        .add_property("agents", AgentPopulation_agents)
+        .add_property("generation", &AgentPopulation::generation)
+        ;
+
+    bp::class_<Lattice, boost::noncopyable>(
+        "Lattice",
+        bp::init<std::size_t, std::size_t, std::uint64_t>(
+            (bp::arg("width"), bp::arg("height"), bp::arg("seed")=0)))
+        .def("step", Lattice_step,
+             (bp::arg("generations")=1, bp::arg("threshold")=1, bp::arg("moore")=false))
+        .def("sweep", Lattice_sweep, (bp::arg("sweeps")=1, bp::arg("seed")=0))
+        .def("randomize", &Lattice::randomize)
+        .def("counts", Lattice_counts)
+        .add_property("grid", Lattice_grid)
+        .add_property("width", &Lattice::width)
+        .add_property("height", &Lattice::height)
+        .add_property("generation", &Lattice::generation)
+        .add_property("sweeps", &Lattice::sweeps)
+        ;
+
+    bp::class_<MoveRecording, std::shared_ptr<MoveRecording>, boost::noncopyable>(
+        "MoveRecording", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 MoveRecording_init, bp::default_call_policies(), (bp::arg("source"))))
+        .def("__len__", &MoveRecording::size)
+        .def("__getitem__", MoveRecording_getitem)
+        .add_property("digest", &MoveRecording::digest)
+        ;
+
+    bp::def("write_move_file", py_write_move_file, bp::args("path", "moves"));
+
+    bp::class_<ReplayPlayer, bp::bases<Player>, boost::noncopyable>("ReplayPlayer", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 ReplayPlayer_init, bp::default_call_policies(),
+                 (bp::arg("name"), bp::arg("recording"), bp::arg("offset")=0)))
+        .add_property("offset", &ReplayPlayer::offset)
+        ;
+
+    bp::scope().attr("ROUND_BREAK") = ROUND_BREAK;
+
+    bp::class_<NGramTrainer, boost::noncopyable>(
+        "NGramTrainer",
+        bp::init<unsigned, bool>((bp::arg("order")=4, bp::arg("both_seats")=true)))
+        .def("add", NGramTrainer_add, bp::args("source"))
+        .def("write", NGramTrainer_write, bp::args("path"))
+        .add_property("order", &NGramTrainer::order)
+        .add_property("both_seats", &NGramTrainer::bothSeats)
+        .add_property("rounds", &NGramTrainer::rounds)
+        ;
+
+    bp::class_<NGramModel, std::shared_ptr<NGramModel>, boost::noncopyable>(
+        "NGramModel", bp::init<std::string>(bp::args("path")))
+        .def("__len__", &NGramModel::size)
+        .def("counts", NGramModel_counts, bp::args("context"))
+        .add_property("order", &NGramModel::order)
+        .add_property("both_seats", &NGramModel::bothSeats)
+        .add_property("rounds", &NGramModel::rounds)
+        .add_property("digest", &NGramModel::digest)
+        ;
+
+    bp::class_<NGramPlayer, bp::bases<Player>, boost::noncopyable>("NGramPlayer", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 NGramPlayer_init, bp::default_call_policies(),
+                 (bp::arg("name"), bp::arg("model"), bp::arg("min_count")=1)))
+        .add_property("min_count", &NGramPlayer::minCount)
+        ;
+
+    bp::class_<MctsPlayer, bp::bases<Player>, boost::noncopyable>("MctsPlayer", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 MctsPlayer_init, bp::default_call_policies(),
+                 (bp::arg("name"), bp::arg("depth")=4, bp::arg("budget")=0.002,
+                  bp::arg("iterations")=0, bp::arg("threads")=1, bp::arg("exploration")=1.0,
+                  bp::arg("max_nodes")=1 << 15, bp::arg("model")=bp::object(),
+                  bp::arg("prior_weight")=10.0, bp::arg("seed")=0)))
+        .def("search_stats", MctsPlayer_search_stats, (bp::arg("seat")=0))
+        ;
+
+    bp::def("write_mlp_model", py_write_mlp_model, bp::args("path", "window", "layers"));
+
+    bp::class_<MlpModel, std::shared_ptr<MlpModel>, boost::noncopyable>(
+        "MlpModel", bp::init<std::string>(bp::args("path")))
+        .def("logits", MlpModel_logits, bp::args("mine", "theirs"))
+        .add_property("window", &MlpModel::window)
+        .add_property("num_layers", &MlpModel::numLayers)
+        .add_property("digest", &MlpModel::digest)
+        ;
+
+    bp::class_<MlpPlayer, bp::bases<Player>, boost::noncopyable>("MlpPlayer", bp::no_init)
+        .def("__init__", bp::make_constructor(
+                 MlpPlayer_init, bp::default_call_policies(), (bp::arg("name"), bp::arg("model"))))
+        ;
+
+    bp::def("play_multi", py_play_multi, bp::args("players", "num_rounds"));
+
+    bp::enum_<Move>("Move")
+        .value("Rock", Rock)
+        .value("Paper", Paper)
+        .value("Scissors", Scissors)
+        ;
+
+    bp::def("score", score2);
+
+    bp::register_exception_translator<PythonError>(translatePythonError);
+
+    bp::class_<MatchContext, boost::noncopyable>("MatchContext")
+        .def("reserve", &MatchContext::reserve, bp::args("num_rounds"))
+        .add_property("capacity", &MatchContext::capacity)
+        ;
+
+    bp::def("play", py_play,
+            (bp::arg("p1"), bp::arg("p2"), bp::arg("num_rounds"),
+             bp::arg("context")=bp::object()));
+
+    bp::def("histogram", py_histogram, bp::args("moves"));
+
+    bp::def("strategies", strategy_names);
+    bp::def("play_strategies", py_play_strategies, bp::args("s1", "s2", "num_rounds"));
+
+    bp::def("tournament", py_tournament, bp::args("players", "num_rounds"));
+    bp::def("swiss", py_swiss, bp::args("players", "num_rounds", "swiss_rounds"));
+    bp::def("race", py_race,
+            (bp::arg("players"), bp::arg("k"), bp::arg("num_rounds"), bp::arg("delta")=0.05,
+             bp::arg("max_matches")=0, bp::arg("seed")=0));
+
+    exposeTask<PlayTask>("PlayTask");
+    exposeTask<TournamentTask>("TournamentTask");
+    bp::def("submit_play", submit_play, bp::args("p1", "p2", "num_rounds"));
+    bp::def("submit_tournament", submit_tournament, bp::args("players", "num_rounds"));
+
+    bp::object ns = bp::scope().attr("__dict__");
+    bp::exec(ASYNC_SOURCE, ns, ns);
+
+    bp::class_<SharedResults, boost::noncopyable>(
+        "SharedResults",
+        bp::init<const std::string&, std::size_t, std::size_t, std::size_t>(
+            bp::args("name", "num_players", "num_matches", "num_rounds")))
+        .def(bp::init<const std::string&>(bp::args("name")))
+        .add_property("name", &SharedResults::name)
+        .add_property("created", &SharedResults::isOwner)
+        .add_property("num_players", &SharedResults::numPlayers)
+        .add_property("num_matches", &SharedResults::numMatches)
+        .add_property("num_rounds", &SharedResults::numRounds)
+        .def("record", SharedResults_record,
+             bp::args("match", "i", "j", "p1", "p2"))
+        .def("unlink", &SharedResults::unlink)
+        .def("head_to_head", SharedResults_headToHead)
+        .def("match_players", SharedResults_matchPlayers)
+        .def("scores", SharedResults_scores)
+        ;
+}
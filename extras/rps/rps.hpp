@@ -0,0 +1,707 @@
+// This is the rock-paper-scissors engine behind the extended `rps`
+// module.
+//
+// It is the same Player/Round/play machinery built up over the course
+// of the rps exercises, pulled into a header so that the native
+// subsystems (shared results, tournaments, ...) can share it.
+
+#ifndef RPS_EXTRAS_RPS_HPP
+#define RPS_EXTRAS_RPS_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/random.hpp>
+
+#include "game.hpp"
+#include "history.hpp"
+#include "player_state.hpp"
+#include "rng.hpp"
+
+// Possible moves that a player can make
+enum Move {
+    Rock,
+    Paper,
+    Scissors
+};
+
+// A Move->Move->score map.
+typedef std::map<Move, std::map<Move, int> > ScoreMap;
+
+// Builds the score-map used in scoring rounds.
+inline ScoreMap makeScoreMap() {
+    ScoreMap smap;
+
+    std::map<Move, int> rock;
+    rock[Rock] = 0;
+    rock[Paper] = 1;
+    rock[Scissors] = -1;
+    smap[Rock] = rock;
+
+    std::map<Move, int> paper;
+    paper[Rock] = -1;
+    paper[Paper] = 0;
+    paper[Scissors] = 1;
+    smap[Paper] = paper;
+
+    std::map<Move, int> scissors;
+    scissors[Rock] = 1;
+    scissors[Paper] = -1;
+    scissors[Scissors] = 0;
+    smap[Scissors] = scissors;
+
+    return smap;
+}
+
+// Returns a score-map for use in scoring rounds. The map is built on
+// first use, which is thread-safe since matches may run concurrently.
+inline const ScoreMap& scoreMap() {
+    static const ScoreMap smap = makeScoreMap();
+    return smap;
+}
+
+/* The moves made by two players in a single round of play. */
+struct Round
+{
+    Round(Move p1_move, Move p2_move) :
+        p1(p1_move),
+        p2(p2_move)
+        {}
+
+    Move p1,  // The move made by player 1
+        p2;  // The move made by player 2
+};
+
+/* One player's view of a match in progress: its own moves and its
+   opponent's, each as a byte array, plus the rounds themselves for
+   players written against them. Strategies read `mine()` and
+   `theirs()` instead of branching on their position. Views of a match
+   in a MatchContext also carry the seat's PlayerStateSlot.
+*/
+class HistoryView
+{
+public:
+    HistoryView(const SplitHistory& split,
+                const std::vector<Round>& rounds,
+                unsigned char my_pos,
+                PlayerStateSlot* slot=0) :
+        split_(&split),
+        rounds_(&rounds),
+        my_pos_(my_pos),
+        slot_(slot)
+        {}
+
+    std::size_t size() const { return split_->size(); }
+    bool empty() const { return split_->size() == 0; }
+    unsigned char position() const { return my_pos_; }
+
+    const unsigned char* mine() const { return split_->seat(my_pos_); }
+    const unsigned char* theirs() const { return split_->seat(my_pos_ ^ 1); }
+
+    const std::vector<Round>& rounds() const { return *rounds_; }
+
+    /* The seat's state slot, or null outside a MatchContext. */
+    PlayerStateSlot* stateSlot() const { return slot_; }
+
+private:
+    const SplitHistory* split_;
+    const std::vector<Round>* rounds_;
+    unsigned char my_pos_;
+    PlayerStateSlot* slot_;
+};
+
+/* Compares two Moves, m1 to m2, to determine the score for the round.
+
+   Returns -1 if m1 beats m2, 1 if m2 beats m1, and 0 for a tie. This
+   agrees with `scoreMap()` but uses the RockPaperScissors game table,
+   which is m2's payoff against m1.
+*/
+inline int score(Move m1, Move m2) {
+    return gamePayoff<RockPaperScissors>(m2, m1);
+}
+
+/* Calculate the scores for a sequence of rounds.
+ */
+inline std::vector<int> score(const std::vector<Round>& rounds) {
+    std::vector<int> rslt;
+    BOOST_FOREACH(const Round& r, rounds) {
+        rslt.push_back(score(r.p1, r.p2));
+    }
+    return rslt;
+}
+
+namespace detail {
+
+struct NameTable
+{
+    std::mutex mutex;
+    std::unordered_map<std::string, std::size_t> refs;
+};
+
+inline NameTable& nameTable()
+{
+    static NameTable* table = new NameTable;
+    return *table;
+}
+
+}  // namespace detail
+
+/* Returns the canonical copy of `name`. Players with equal names share
+   one string, so a large population of players costs one pointer per
+   name. Each call takes a reference to the name which `releaseName`
+   gives back; a name is dropped once no player holds it.
+*/
+inline const std::string* internName(const std::string& name)
+{
+    detail::NameTable& table = detail::nameTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    std::unordered_map<std::string, std::size_t>::iterator it =
+        table.refs.insert(std::make_pair(name, std::size_t(0))).first;
+    ++it->second;
+    return &it->first;
+}
+
+inline void releaseName(const std::string* name)
+{
+    detail::NameTable& table = detail::nameTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    std::unordered_map<std::string, std::size_t>::iterator it = table.refs.find(*name);
+    if (--it->second == 0)
+        table.refs.erase(it);
+}
+
+/* Accumulates a 64-bit hash of a player's configuration. */
+class Fingerprint
+{
+public:
+    Fingerprint() : hash_(0x243f6a8885a308d3ull) {}
+
+    Fingerprint& add(std::uint64_t v)
+        {
+            hash_ = mix64(hash_ ^ v);
+            return *this;
+        }
+
+    Fingerprint& add(const std::string& s)
+        {
+            add(s.size());
+            BOOST_FOREACH(char c, s) {
+                add(static_cast<unsigned char>(c));
+            }
+            return *this;
+        }
+
+    std::uint64_t value() const { return hash_; }
+
+private:
+    std::uint64_t hash_;
+};
+
+/* The basic Player interface.
+
+   Players have a name and implement `nextMove` for determining how
+   they play.
+*/
+class Player
+{
+public:
+    Player(const std::string& name) : name_(internName(name)) {}
+    Player(const Player& other) : name_(internName(*other.name_)) {}
+    virtual ~Player() { releaseName(name_); }
+
+    Player& operator=(const Player& other)
+        {
+            setName(*other.name_);
+            return *this;
+        }
+
+    /* For each move a player is given the history of play up to this
+     * point. The position indicates if this player is player 1
+     * (my_pos=0) or player 2 (my_pos=1).
+     */
+    virtual Move nextMove(const std::vector<Round>& history,
+                          unsigned char my_pos) const = 0;
+
+    /* The move `play` asks for. Players which scan the history can
+     * override this to work on the split view; by default it forwards
+     * to `nextMove`.
+     */
+    virtual Move choose(const HistoryView& view) const
+        {
+            return nextMove(view.rounds(), view.position());
+        }
+
+    /* Players whose moves depend only on their configuration and the
+     * history add that configuration (type, parameters and seed, but
+     * not the name) to `fp` and return true. Their matches may then be
+     * answered from a result cache.
+     */
+    virtual bool fingerprint(Fingerprint&) const { return false; }
+
+    std::string name() const { return *name_; }
+    void setName(const std::string& n)
+        {
+            const std::string* old = name_;
+            name_ = internName(n);
+            releaseName(old);
+        }
+
+private:
+    const std::string* name_;
+};
+
+/* Thrown by `play` when a match is cancelled before it finishes. */
+class MatchCancelled : public std::runtime_error
+{
+public:
+    MatchCancelled() : std::runtime_error("match cancelled") {}
+};
+
+/* A store of match scores, keyed by `matchKey`. When one is installed
+ * with `setMatchCache`, `play` consults it for every match between
+ * fingerprinted players. */
+class MatchCache
+{
+public:
+    virtual ~MatchCache() {}
+
+    /* Fills `scores` and returns true if the match is known. */
+    virtual bool lookup(std::uint64_t key,
+                        std::size_t num_rounds,
+                        std::vector<int>& scores) = 0;
+    virtual void store(std::uint64_t key, const std::vector<int>& scores) = 0;
+};
+
+namespace detail {
+
+inline std::mutex& matchCacheMutex()
+{
+    static std::mutex* mutex = new std::mutex;
+    return *mutex;
+}
+
+inline std::shared_ptr<MatchCache>& matchCacheSlot()
+{
+    static std::shared_ptr<MatchCache>* slot = new std::shared_ptr<MatchCache>;
+    return *slot;
+}
+
+}  // namespace detail
+
+/* Installs `cache` for all matches, or removes it if null. Matches
+ * already running keep the cache they started with. */
+inline void setMatchCache(std::shared_ptr<MatchCache> cache)
+{
+    std::lock_guard<std::mutex> lock(detail::matchCacheMutex());
+    detail::matchCacheSlot().swap(cache);
+}
+
+inline std::shared_ptr<MatchCache> matchCache()
+{
+    std::lock_guard<std::mutex> lock(detail::matchCacheMutex());
+    return detail::matchCacheSlot();
+}
+
+/* The cache key of a match: both players' fingerprints in seat order
+ * and the number of rounds. Returns false if either player has no
+ * fingerprint. */
+inline bool matchKey(const Player& p1,
+                     const Player& p2,
+                     std::size_t num_rounds,
+                     std::uint64_t& key)
+{
+    Fingerprint f1, f2;
+    if (!p1.fingerprint(f1) || !p2.fingerprint(f2))
+        return false;
+    key = Fingerprint().add(f1.value()).add(f2.value()).add(num_rounds).value();
+    return true;
+}
+
+/* Calculate the scores for a sequence of rounds into `rslt`, reusing
+ * its storage. */
+inline void score(const std::vector<Round>& rounds, std::vector<int>& rslt) {
+    rslt.clear();
+    BOOST_FOREACH(const Round& r, rounds) {
+        rslt.push_back(score(r.p1, r.p2));
+    }
+}
+
+/* The buffers a match is played in: the history in both layouts, the
+   scores, and the state of stateful players in each seat. Clearing
+   them between matches keeps their storage, so once a context has
+   grown to the longest match it plays, further matches allocate
+   nothing.
+
+   A context serves one match at a time; `play` throws
+   std::logic_error if it is handed a context which is already in use.
+*/
+class MatchContext : private boost::noncopyable
+{
+public:
+    MatchContext() : busy_(false) {}
+
+    /* Forgets the previous match. Rounds and scores are trivially
+     * destructible, so this is O(1). */
+    void reset()
+        {
+            history_.clear();
+            split_.clear();
+            scores_.clear();
+        }
+
+    void reserve(std::size_t num_rounds)
+        {
+            history_.reserve(num_rounds);
+            split_.reserve(num_rounds);
+            scores_.reserve(num_rounds);
+        }
+
+    /* The number of rounds the context can hold without allocating. */
+    std::size_t capacity() const { return history_.capacity(); }
+
+    bool busy() const { return busy_.load(std::memory_order_relaxed); }
+
+    const std::vector<Round>& history() const { return history_; }
+    const std::vector<int>& scores() const { return scores_; }
+
+    /* The state slot of a seat, holding what the player there kept
+     * from the last match. */
+    const PlayerStateSlot& state(unsigned char seat) const { return states_[seat & 1]; }
+
+    /* Hands over the scores of the last match. */
+    std::vector<int> releaseScores()
+        {
+            std::vector<int> rslt;
+            rslt.swap(scores_);
+            return rslt;
+        }
+
+private:
+    friend class MatchContextUse;
+
+    std::vector<Round> history_;
+    SplitHistory split_;
+    std::vector<int> scores_;
+    PlayerStateSlot states_[2];
+    std::atomic<bool> busy_;
+};
+
+/* Marks a MatchContext as in use for the lifetime of the object. */
+class MatchContextUse : private boost::noncopyable
+{
+public:
+    explicit MatchContextUse(MatchContext& context) : context_(context)
+        {
+            if (context_.busy_.exchange(true))
+                throw std::logic_error("match context is already in use");
+        }
+
+    ~MatchContextUse() { context_.busy_.store(false); }
+
+    std::vector<Round>& history() { return context_.history_; }
+    SplitHistory& split() { return context_.split_; }
+    std::vector<int>& scores() { return context_.scores_; }
+    PlayerStateSlot& state(unsigned char seat) { return context_.states_[seat & 1]; }
+
+private:
+    MatchContext& context_;
+};
+
+/* The calling thread's MatchContext. Each pool worker reuses its own
+ * across all the matches it plays. */
+inline MatchContext& threadMatchContext()
+{
+    static thread_local MatchContext context;
+    return context;
+}
+
+/* Play two Players against each other for a number of rounds. Returns a sequence of scores:
+
+   -1 -> player 1 wins
+   1 -> player 2 wins
+   0 -> tie
+
+   The match is played in `context`, and the scores returned are the
+   context's, valid until it plays its next match. If a result cache
+   is installed and knows the match, the scores come from the cache and
+   the context's history is left empty.
+
+   `cancelled` is checked before every round; once it is set the match
+   is abandoned by throwing MatchCancelled.
+*/
+inline const std::vector<int>& play(const Player& p1,
+                                    const Player& p2,
+                                    std::vector<int>::size_type num_rounds,
+                                    const std::atomic<bool>& cancelled,
+                                    MatchContext& context)
+{
+    MatchContextUse use(context);
+    context.reset();
+
+    std::shared_ptr<MatchCache> cache = matchCache();
+    std::uint64_t key = 0;
+    if (cache && !matchKey(p1, p2, num_rounds, key))
+        cache.reset();
+    if (cache && cache->lookup(key, num_rounds, use.scores()))
+        return context.scores();
+
+    context.reserve(num_rounds);
+
+    std::vector<Round>& history = use.history();
+    SplitHistory& split = use.split();
+    const HistoryView v1(split, history, 0, &use.state(0)), v2(split, history, 1, &use.state(1));
+    for (std::vector<int>::size_type i = 0; i < num_rounds; ++i) {
+        if (cancelled.load(std::memory_order_relaxed))
+            throw MatchCancelled();
+
+        Move m1 = p1.choose(v1);
+        Move m2 = p2.choose(v2);
+        history.push_back(Round(m1, m2));
+        split.append(m1, m2);
+    }
+
+    score(history, use.scores());
+    if (cache)
+        cache->store(key, context.scores());
+    return context.scores();
+}
+
+inline std::vector<int> play(const Player& p1,
+                             const Player& p2,
+                             std::vector<int>::size_type num_rounds,
+                             const std::atomic<bool>& cancelled)
+{
+    MatchContext context;
+    play(p1, p2, num_rounds, cancelled, context);
+    return context.releaseScores();
+}
+
+inline std::vector<int> play(const Player& p1,
+                             const Player& p2,
+                             std::vector<int>::size_type num_rounds)
+{
+    static const std::atomic<bool> never(false);
+    return play(p1, p2, num_rounds, never);
+}
+
+/* Utility class for generating random Moves.
+ */
+class RandomMoveGenerator
+{
+public:
+    RandomMoveGenerator(int seed) : rng_(seed),
+                                    dist_(1, 3)
+        {}
+
+    Move operator()() {
+        switch (dist_(rng_)) {
+            case 1:
+                return Rock;
+                break;
+
+            case 2:
+                return Paper;
+                break;
+
+            case 3:
+            default:
+                return Scissors;
+                break;
+        }
+    }
+
+private:
+    boost::random::mt19937 rng_;
+    boost::random::uniform_int_distribution<> dist_;
+};
+
+/* Generates random Moves. Each thread has its own generator so that
+ * matches can run concurrently. */
+inline Move randomMove() {
+    static thread_local RandomMoveGenerator rmg(
+        static_cast<int>(std::time(0) ^
+                         std::hash<std::thread::id>()(std::this_thread::get_id())));
+    return rmg();
+}
+
+/* A Player which simply does random moves in play. Given a seed it
+ * draws them from a counter-based stream instead, so its play is
+ * repeatable. */
+class Random : public Player
+{
+public:
+    Random(const std::string& name) :
+        Player(name),
+        seeded_(false),
+        seed_(0)
+        {}
+
+    Random(const std::string& name, std::uint64_t seed) :
+        Player(name),
+        seeded_(true),
+        seed_(seed)
+        {}
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            if (!seeded_)
+                return randomMove();
+            return static_cast<Move>(
+                boundedValue(streamValue(seed_ ^ my_pos, history.size()), 3));
+        }
+
+    bool fingerprint(Fingerprint& fp) const
+        {
+            fp.add("Random").add(seed_);
+            return seeded_;
+        }
+
+private:
+    bool seeded_;
+    std::uint64_t seed_;
+};
+
+/* A Player which simply does whatever its opponent did in the last
+ * round. On the first round it plays randomly, or from its seed if it
+ * has one. */
+class TitForTat : public Player
+{
+public:
+    TitForTat(const std::string& name) :
+        Player(name),
+        seeded_(false),
+        seed_(0)
+        {}
+
+    TitForTat(const std::string& name, std::uint64_t seed) :
+        Player(name),
+        seeded_(true),
+        seed_(seed)
+        {}
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            assert(my_pos == 0 || my_pos == 1);
+
+            if (history.empty())
+                return firstMove(my_pos);
+
+            const Round& r = *history.rbegin();
+            return (my_pos == 0) ? r.p2 : r.p1;
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            if (view.empty())
+                return firstMove(view.position());
+            return static_cast<Move>(view.theirs()[view.size() - 1]);
+        }
+
+    bool fingerprint(Fingerprint& fp) const
+        {
+            fp.add("TitForTat").add(seed_);
+            return seeded_;
+        }
+
+private:
+    Move firstMove(unsigned char my_pos) const
+        {
+            if (!seeded_)
+                return randomMove();
+            return static_cast<Move>(boundedValue(streamValue(seed_ ^ my_pos, 0), 3));
+        }
+
+    bool seeded_;
+    std::uint64_t seed_;
+};
+
+/* Builds the split view of `history` and asks `p` to choose from it.
+ * Players overriding `choose` implement `nextMove` with this. */
+inline Move chooseFromRounds(const Player& p,
+                             const std::vector<Round>& history,
+                             unsigned char my_pos)
+{
+    SplitHistory split;
+    split.reserve(history.size());
+    BOOST_FOREACH(const Round& r, history) {
+        split.append(r.p1, r.p2);
+    }
+    return p.choose(HistoryView(split, history, my_pos));
+}
+
+/* A Player which plays whatever beats its opponent's most frequent
+ * move so far, counting with the histogram scan. On the first round
+ * it plays randomly. */
+class FrequencyCounter : public Player
+{
+public:
+    FrequencyCounter(const std::string& name) :
+        Player(name)
+        {}
+
+    Move nextMove(const std::vector<Round>& history,
+                  unsigned char my_pos) const
+        {
+            return chooseFromRounds(*this, history, my_pos);
+        }
+
+    Move choose(const HistoryView& view) const
+        {
+            if (view.empty())
+                return randomMove();
+
+            std::size_t counts[3] = {0, 0, 0};
+            histogram(view.theirs(), view.size(), counts);
+            int frequent = Rock;
+            for (int m = Paper; m <= Scissors; ++m)
+                if (counts[m] > counts[frequent])
+                    frequent = m;
+            return static_cast<Move>((frequent + 1) % 3);
+        }
+};
+
+/* Simple test which runs some rounds and prints some results. */
+inline std::string test(std::vector<int>::size_type num_rounds=100)
+{
+    TitForTat p1("t4t");
+    Random p2("random");
+    std::vector<int> results = play(p1, p2, num_rounds);
+
+    std::vector<int>::size_type p1_wins, p2_wins;
+    p1_wins = p2_wins = 0;
+
+    BOOST_FOREACH(int r, results) {
+        if (-1 == r)
+            ++p1_wins;
+        else if (1 == r)
+            ++p2_wins;
+
+        std::cout << r << "\n";
+    }
+
+    if (p1_wins > p2_wins)
+        return "Player " + p1.name() + " wins!";
+    else if (p2_wins > p1_wins)
+        return "Player " + p2.name() + " wins!";
+    else
+        return "It was a tie!";
+}
+
+#endif
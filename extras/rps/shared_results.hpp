@@ -0,0 +1,246 @@
+// A results table living in POSIX shared memory.
+//
+// Worker processes (e.g. a multiprocessing pool) attach to the table by
+// name and write match results straight into it; the parent reads the
+// counters and score arrays in place, so nothing is pickled on the way
+// back.
+
+#ifndef RPS_EXTRAS_SHARED_RESULTS_HPP
+#define RPS_EXTRAS_SHARED_RESULTS_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "rps.hpp"
+
+/* The layout of a shared results segment:
+
+   header | head-to-head counters | match players | match scores
+
+   Every section starts on a cache-line boundary. The head-to-head
+   counters are `num_players` x `num_players` int64 values, where entry
+   (i, j) is the number of rounds player i has won against player j.
+   They are only ever updated atomically. The match players are
+   `num_matches` x 2 int32 player indices and the match scores are
+   `num_matches` x `num_rounds` int8 values as returned by `play()`.
+   Each match row is written by exactly one worker.
+*/
+class SharedResults : private boost::noncopyable
+{
+public:
+    /* Creates a new segment. Fails if one with this name already exists. */
+    SharedResults(const std::string& name,
+                  std::size_t num_players,
+                  std::size_t num_matches,
+                  std::size_t num_rounds) :
+        name_(name),
+        owner_(true)
+        {
+            if (num_players == 0)
+                throw std::invalid_argument("num_players must be positive");
+
+            Header h;
+            h.magic = MAGIC;
+            h.num_players = num_players;
+            h.num_matches = num_matches;
+            h.num_rounds = num_rounds;
+            size_ = segmentSize(h);
+
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0)
+                throw std::runtime_error(systemError("shm_open"));
+
+            if (ftruncate(fd, size_) != 0) {
+                std::string msg = systemError("ftruncate");
+                close(fd);
+                shm_unlink(name.c_str());
+                throw std::runtime_error(msg);
+            }
+
+            map(fd);
+            *header() = h;
+
+            std::int32_t* players = matchPlayers();
+            for (std::size_t i = 0; i < 2 * num_matches; ++i)
+                players[i] = -1;
+        }
+
+    /* Attaches to an existing segment created by another process. */
+    SharedResults(const std::string& name) :
+        name_(name),
+        owner_(false)
+        {
+            int fd = shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd < 0)
+                throw std::runtime_error(systemError("shm_open"));
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                std::string msg = systemError("fstat");
+                close(fd);
+                throw std::runtime_error(msg);
+            }
+            size_ = st.st_size;
+            if (size_ < sizeof(Header)) {
+                close(fd);
+                throw std::runtime_error(name + " is not a results segment");
+            }
+
+            map(fd);
+            if (header()->magic != MAGIC || segmentSize(*header()) != size_) {
+                munmap(base_, size_);
+                throw std::runtime_error(name + " is not a results segment");
+            }
+        }
+
+    ~SharedResults()
+        {
+            munmap(base_, size_);
+        }
+
+    /* Removes the segment name. Attached processes keep their mapping. */
+    void unlink()
+        {
+            if (shm_unlink(name_.c_str()) != 0)
+                throw std::runtime_error(systemError("shm_unlink"));
+        }
+
+    /* Plays `p1` (index `i`) against `p2` (index `j`) and stores the
+       result as match number `match`.
+    */
+    void record(std::size_t match,
+                std::size_t i,
+                std::size_t j,
+                const Player& p1,
+                const Player& p2)
+        {
+            store(match, i, j, play(p1, p2, numRounds()));
+        }
+
+    /* Stores an already played match. `scores` must hold `num_rounds`
+       entries.
+    */
+    void store(std::size_t match,
+               std::size_t i,
+               std::size_t j,
+               const std::vector<int>& scores)
+        {
+            checkIndex(match, numMatches(), "match");
+            checkIndex(i, numPlayers(), "player");
+            checkIndex(j, numPlayers(), "player");
+            if (scores.size() != numRounds())
+                throw std::invalid_argument("wrong number of rounds");
+
+            std::int64_t i_wins = 0, j_wins = 0;
+            std::int8_t* row = matchScores() + match * numRounds();
+            for (std::size_t r = 0; r < scores.size(); ++r) {
+                row[r] = static_cast<std::int8_t>(scores[r]);
+                i_wins += (scores[r] == -1);
+                j_wins += (scores[r] == 1);
+            }
+
+            std::int32_t* players = matchPlayers() + 2 * match;
+            players[0] = static_cast<std::int32_t>(i);
+            players[1] = static_cast<std::int32_t>(j);
+
+            std::int64_t* h2h = headToHead();
+            std::size_t n = numPlayers();
+            std::atomic_ref<std::int64_t>(h2h[i * n + j]).fetch_add(
+                i_wins, std::memory_order_relaxed);
+            std::atomic_ref<std::int64_t>(h2h[j * n + i]).fetch_add(
+                j_wins, std::memory_order_relaxed);
+        }
+
+    std::string name() const { return name_; }
+    bool isOwner() const { return owner_; }
+    std::size_t numPlayers() const { return header()->num_players; }
+    std::size_t numMatches() const { return header()->num_matches; }
+    std::size_t numRounds() const { return header()->num_rounds; }
+
+    std::int64_t* headToHead() const
+        {
+            return reinterpret_cast<std::int64_t*>(base_ + headToHeadOffset());
+        }
+
+    std::int32_t* matchPlayers() const
+        {
+            return reinterpret_cast<std::int32_t*>(base_ + matchPlayersOffset(*header()));
+        }
+
+    std::int8_t* matchScores() const
+        {
+            return reinterpret_cast<std::int8_t*>(base_ + matchScoresOffset(*header()));
+        }
+
+private:
+    static const std::uint64_t MAGIC = 0x5250535245535531ull;  // "RPSRESU1"
+
+    struct Header
+    {
+        std::uint64_t magic;
+        std::uint64_t num_players;
+        std::uint64_t num_matches;
+        std::uint64_t num_rounds;
+    };
+
+    static std::size_t align(std::size_t n) { return (n + 63) & ~std::size_t(63); }
+
+    static std::size_t headToHeadOffset() { return align(sizeof(Header)); }
+
+    static std::size_t matchPlayersOffset(const Header& h)
+        {
+            return headToHeadOffset() + align(h.num_players * h.num_players * sizeof(std::int64_t));
+        }
+
+    static std::size_t matchScoresOffset(const Header& h)
+        {
+            return matchPlayersOffset(h) + align(2 * h.num_matches * sizeof(std::int32_t));
+        }
+
+    static std::size_t segmentSize(const Header& h)
+        {
+            return matchScoresOffset(h) + align(h.num_matches * h.num_rounds);
+        }
+
+    static std::string systemError(const std::string& call)
+        {
+            return call + ": " + std::strerror(errno);
+        }
+
+    static void checkIndex(std::size_t idx, std::size_t size, const char* what)
+        {
+            if (idx >= size)
+                throw std::out_of_range(std::string(what) + " index out of range");
+        }
+
+    void map(int fd)
+        {
+            void* p = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            std::string msg = systemError("mmap");
+            close(fd);
+            if (p == MAP_FAILED)
+                throw std::runtime_error(msg);
+            base_ = static_cast<char*>(p);
+        }
+
+    Header* header() const { return reinterpret_cast<Header*>(base_); }
+
+    std::string name_;
+    bool owner_;
+    std::size_t size_;
+    char* base_;
+};
+
+#endif
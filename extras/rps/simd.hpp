@@ -0,0 +1,101 @@
+// Small data-parallel kernels shared by the numeric subsystems.
+//
+// These use GCC/Clang vector extensions rather than intrinsics, so they
+// compile to whatever vector width the target supports (SSE2 at least
+// on x86-64) and still build elsewhere. Floating point sums are split
+// over independent lanes, which the compiler is not allowed to do by
+// itself without -ffast-math.
+
+#ifndef RPS_EXTRAS_SIMD_HPP
+#define RPS_EXTRAS_SIMD_HPP
+
+#include <cstddef>
+#include <cstring>
+
+typedef double DoubleLanes __attribute__((vector_size(32)));
+typedef float FloatLanes __attribute__((vector_size(32)));
+
+// Vectors are passed by reference: passing a 32-byte vector by value
+// has a different ABI with and without AVX, which GCC warns about.
+
+/* Loads a whole vector from `p`; callers must have sizeof(V) bytes
+ * there. Shorter arrays take the scalar path instead. */
+template <typename V, typename T>
+inline void loadLanes(V& v, const T* p)
+{
+    std::memcpy(&v, p, sizeof(V));
+}
+
+template <typename V, typename T>
+inline void storeLanes(T* p, const V& v)
+{
+    std::memcpy(p, &v, sizeof(V));
+}
+
+/* Returns sum(a[i] * b[i]) for i < n. */
+inline double dot(const double* a, const double* b, std::size_t n)
+{
+    const std::size_t W = sizeof(DoubleLanes) / sizeof(double);
+    DoubleLanes acc0 = {0, 0, 0, 0}, acc1 = {0, 0, 0, 0};
+    std::size_t i = 0;
+    for (; i + 2 * W <= n; i += 2 * W) {
+        DoubleLanes a0, b0, a1, b1;
+        loadLanes(a0, a + i);
+        loadLanes(b0, b + i);
+        loadLanes(a1, a + i + W);
+        loadLanes(b1, b + i + W);
+        acc0 += a0 * b0;
+        acc1 += a1 * b1;
+    }
+    acc0 += acc1;
+    double sum = acc0[0] + acc0[1] + acc0[2] + acc0[3];
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+inline float dot(const float* a, const float* b, std::size_t n)
+{
+    const std::size_t W = sizeof(FloatLanes) / sizeof(float);
+    FloatLanes acc = {0, 0, 0, 0, 0, 0, 0, 0};
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+        FloatLanes va, vb;
+        loadLanes(va, a + i);
+        loadLanes(vb, b + i);
+        acc += va * vb;
+    }
+    float sum = 0;
+    for (std::size_t l = 0; l < W; ++l)
+        sum += acc[l];
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+/* y[i] += alpha * x[i] for i < n. */
+template <typename T>
+inline void axpy(T alpha, const T* x, T* y, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+        y[i] += alpha * x[i];
+}
+
+/* Returns sum(x[i]) for i < n. */
+inline double sum(const double* x, std::size_t n)
+{
+    const std::size_t W = sizeof(DoubleLanes) / sizeof(double);
+    DoubleLanes acc = {0, 0, 0, 0};
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+        DoubleLanes v;
+        loadLanes(v, x + i);
+        acc += v;
+    }
+    double total = acc[0] + acc[1] + acc[2] + acc[3];
+    for (; i < n; ++i)
+        total += x[i];
+    return total;
+}
+
+#endif
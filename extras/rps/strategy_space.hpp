@@ -0,0 +1,259 @@
+// The space of deterministic memory-one strategies, played in full.
+//
+// There are 3^10 of them (MemoryOne::fromCode numbers them). Between
+// two deterministic strategies, every round after the first follows
+// from the previous pair of moves, one of nine, so a match settles
+// into a cycle within ten rounds and its score for any length takes at
+// most ten steps to find. Matches against opponents with random entries
+// go through the lane engine instead.
+//
+// Results are written as a matrix of net scores (rounds won minus
+// rounds lost by the row strategy), one int16 per match, in a file
+// laid out as
+//
+//     "RPSSPACE"                      8 bytes
+//     begin, rows, cols, num_rounds   uint32 each
+//     the opponents' tables           10 bytes per column
+//     the matrix                      rows x cols int16, row-major
+//
+// where row i is the strategy with code begin + i.
+
+#ifndef RPS_EXTRAS_STRATEGY_SPACE_HPP
+#define RPS_EXTRAS_STRATEGY_SPACE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "lanes.hpp"
+#include "memory_one.hpp"
+#include "rng.hpp"
+#include "thread_pool.hpp"
+
+namespace detail {
+
+/* The rounds won by each of two deterministic strategies over
+ * `num_rounds` rounds, skipping over the cycle the match falls into. */
+inline void deterministicMatch(const MemoryOne& a,
+                               const MemoryOne& b,
+                               std::size_t num_rounds,
+                               std::size_t& wins1,
+                               std::size_t& wins2)
+{
+    // seen[s] is the round after which the previous moves were s, and
+    // at1, at2 the wins up to it.
+    std::size_t seen[9], at1[9], at2[9];
+    std::fill(seen, seen + 9, num_rounds + 1);
+    unsigned m1 = a.first, m2 = b.first;
+    bool skipped = false;
+    wins1 = wins2 = 0;
+    for (std::size_t r = 0; r < num_rounds; ) {
+        wins1 += m1 == (m2 + 1) % 3;
+        wins2 += m2 == (m1 + 1) % 3;
+        ++r;
+
+        unsigned s = m1 * 3 + m2;
+        if (!skipped && seen[s] <= num_rounds) {
+            std::size_t period = r - seen[s];
+            std::size_t cycles = (num_rounds - r) / period;
+            wins1 += cycles * (wins1 - at1[s]);
+            wins2 += cycles * (wins2 - at2[s]);
+            r += cycles * period;
+            skipped = true;
+        }
+        seen[s] = r;
+        at1[s] = wins1;
+        at2[s] = wins2;
+        m1 = a.table[s];
+        m2 = b.table[m2 * 3 + (s / 3)];
+    }
+}
+
+}  // namespace detail
+
+/* `count` distinct deterministic strategies, drawn uniformly from the
+ * space and listed in code order. */
+inline std::vector<MemoryOne> sampleStrategySpace(std::size_t count, std::uint64_t seed)
+{
+    if (count > MemoryOne::NUM_DETERMINISTIC)
+        throw std::invalid_argument("the space has only 59049 strategies");
+
+    // Floyd's algorithm: one draw per chosen code.
+    std::unordered_set<std::uint32_t> chosen;
+    std::uint32_t n = MemoryOne::NUM_DETERMINISTIC;
+    for (std::uint32_t j = n - count; j < n; ++j) {
+        std::uint32_t t = boundedValue(streamValue(seed, j), j + 1);
+        chosen.insert(chosen.count(t) ? j : t);
+    }
+    std::vector<std::uint32_t> codes(chosen.begin(), chosen.end());
+    std::sort(codes.begin(), codes.end());
+
+    std::vector<MemoryOne> rslt;
+    BOOST_FOREACH(std::uint32_t c, codes) {
+        rslt.push_back(MemoryOne::fromCode(c));
+    }
+    return rslt;
+}
+
+/* What a run of playStrategySpace did. A stopped run leaves a valid
+ * file with the rows finished so far. */
+struct SpaceRun
+{
+    std::size_t rows, cols, matches;
+    bool complete;
+};
+
+/* Plays the strategies with codes in [begin, end) against each of
+   `opponents` for `num_rounds` rounds and writes the matrix to `path`.
+   Rows are played in chunks spread over the pool and written as each
+   chunk finishes, so memory stays bounded however large the run.
+*/
+inline SpaceRun playStrategySpace(const std::vector<MemoryOne>& opponents,
+                                  std::uint32_t begin,
+                                  std::uint32_t end,
+                                  std::size_t num_rounds,
+                                  std::uint64_t seed,
+                                  const std::string& path,
+                                  ThreadPool& pool,
+                                  std::atomic<bool>& stop)
+{
+    const std::size_t CHUNK = 256;
+
+    if (begin > end || end > MemoryOne::NUM_DETERMINISTIC)
+        throw std::out_of_range("strategy codes out of range");
+    if (num_rounds > 32767)
+        throw std::invalid_argument("net scores are stored as int16: at most 32767 rounds");
+    if (opponents.empty())
+        throw std::invalid_argument("no opponents");
+    BOOST_FOREACH(const MemoryOne& o, opponents) {
+        if (!o.valid())
+            throw std::invalid_argument("invalid memory-one strategy");
+    }
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("cannot write strategy space file " + path);
+    std::uint32_t header[4] = { begin, end - begin, std::uint32_t(opponents.size()),
+                                std::uint32_t(num_rounds) };
+    out.write("RPSSPACE", 8);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    BOOST_FOREACH(const MemoryOne& o, opponents) {
+        out.write(reinterpret_cast<const char*>(&o.first), 1);
+        out.write(reinterpret_cast<const char*>(o.table), 9);
+    }
+    if (!out)
+        throw std::runtime_error("cannot write strategy space file " + path);
+
+    // Opponents with random entries are played in lanes; the rest
+    // deterministically.
+    std::vector<std::uint32_t> random_cols, fixed_cols;
+    for (std::uint32_t c = 0; c < opponents.size(); ++c)
+        (opponents[c].deterministic() ? fixed_cols : random_cols).push_back(c);
+
+    const std::size_t cols = opponents.size();
+    SpaceRun rslt = { 0, cols, 0, false };
+    std::vector<std::int16_t> scores;
+    for (std::uint32_t first = begin; first < end; first += CHUNK) {
+        if (stop.load(std::memory_order_relaxed))
+            break;
+        const std::uint32_t rows = std::min<std::uint32_t>(CHUNK, end - first);
+        scores.assign(rows * cols, 0);
+
+        parallelFor(pool, rows, [&](std::size_t i) {
+                MemoryOne row = MemoryOne::fromCode(first + i);
+                BOOST_FOREACH(std::uint32_t c, fixed_cols) {
+                    std::size_t w1, w2;
+                    detail::deterministicMatch(row, opponents[c], num_rounds, w1, w2);
+                    scores[i * cols + c] = std::int16_t(w1) - std::int16_t(w2);
+                }
+            });
+
+        if (!random_cols.empty()) {
+            std::vector<MemoryOne> strategies(opponents);
+            std::vector<std::pair<std::uint32_t, std::uint32_t> > pairs;
+            for (std::uint32_t i = 0; i < rows; ++i) {
+                strategies.push_back(MemoryOne::fromCode(first + i));
+                BOOST_FOREACH(std::uint32_t c, random_cols) {
+                    pairs.push_back(std::make_pair(std::uint32_t(cols + i), c));
+                }
+            }
+            LaneResults lr = playLanes(strategies, pairs, num_rounds,
+                                       streamValue(seed, first), pool);
+            for (std::size_t m = 0; m < pairs.size(); ++m)
+                scores[(pairs[m].first - cols) * cols + pairs[m].second] =
+                    std::int16_t(lr.p1_wins[m]) - std::int16_t(lr.p2_wins[m]);
+        }
+
+        out.write(reinterpret_cast<const char*>(scores.data()), scores.size() * sizeof(std::int16_t));
+        if (!out)
+            throw std::runtime_error("cannot write strategy space file " + path);
+        rslt.rows += rows;
+        rslt.matches += rows * cols;
+    }
+
+    rslt.complete = rslt.rows == end - begin;
+    if (!rslt.complete) {
+        header[1] = rslt.rows;
+        out.seekp(8);
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+    out.flush();
+    if (!out)
+        throw std::runtime_error("cannot write strategy space file " + path);
+    return rslt;
+}
+
+/* A matrix written by playStrategySpace. */
+struct SpaceMatrix
+{
+    std::uint32_t begin, rows, cols, num_rounds;
+    std::vector<MemoryOne> opponents;
+    std::vector<std::int16_t> scores;
+};
+
+/* Reads a matrix back, checking its size against the file's and its
+ * opponents' tables as the MemoryOne constructor would. */
+inline SpaceMatrix loadStrategySpace(const std::string& path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    const std::streamoff size = in.tellg();
+    in.seekg(0);
+    char magic[8];
+    std::uint32_t header[4];
+    if (!in.read(magic, 8) || std::memcmp(magic, "RPSSPACE", 8) != 0 ||
+        !in.read(reinterpret_cast<char*>(header), sizeof(header)))
+        throw std::runtime_error("not a strategy space file: " + path);
+
+    SpaceMatrix m;
+    m.begin = header[0];
+    m.rows = header[1];
+    m.cols = header[2];
+    m.num_rounds = header[3];
+    if (std::uint64_t(size) != 8 + sizeof(header) + 10 * std::uint64_t(m.cols) +
+        sizeof(std::int16_t) * std::uint64_t(m.rows) * m.cols)
+        throw std::runtime_error("strategy space file does not match its header: " + path);
+    m.opponents.resize(m.cols);
+    BOOST_FOREACH(MemoryOne& o, m.opponents) {
+        if (!in.read(reinterpret_cast<char*>(&o.first), 1) ||
+            !in.read(reinterpret_cast<char*>(o.table), 9))
+            throw std::runtime_error("truncated strategy space file: " + path);
+        if (!o.valid())
+            throw std::runtime_error("not a strategy space file: " + path);
+    }
+    m.scores.resize(std::size_t(m.rows) * m.cols);
+    if (!in.read(reinterpret_cast<char*>(m.scores.data()), m.scores.size() * sizeof(std::int16_t)))
+        throw std::runtime_error("truncated strategy space file: " + path);
+    return m;
+}
+
+#endif
@@ -0,0 +1,175 @@
+// Swiss-system tournaments.
+//
+// Instead of every player meeting every other, a Swiss tournament plays
+// a fixed number of rounds in which players with equal or similar
+// points are paired. About log2(N) rounds separate the strong from the
+// weak, so N players need N/2 matches per round rather than N(N-1)/2 in
+// total.
+
+#ifndef RPS_EXTRAS_SWISS_HPP
+#define RPS_EXTRAS_SWISS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "rps.hpp"
+#include "thread_pool.hpp"
+#include "tournament.hpp"
+
+/* The outcome of a Swiss tournament. Points are counted in halves: a
+   match won (by winning more rounds) is worth 2, a drawn match or a
+   bye 1. `ranking` orders the players by points, then by the sum of
+   their opponents' points (the Buchholz score), then by index.
+*/
+struct SwissResult
+{
+    std::vector<unsigned> half_points;
+    std::vector<unsigned> buchholz;
+    std::vector<std::size_t> ranking;
+    std::vector<MatchSummary> matches;
+};
+
+/* Pairs players for one Swiss round.
+
+   Players are bucketed by points, best first, and paired down the
+   list: each takes the nearest player below it that it has not met,
+   looking at most `window` places ahead, and otherwise its immediate
+   neighbour. With an odd number of players the lowest-placed player
+   that has not had a bye sits out; its index is returned in `bye`
+   (or `half_points.size()` if there is none).
+*/
+inline std::vector<std::pair<std::size_t, std::size_t> >
+swissPairings(const std::vector<unsigned>& half_points,
+              const std::unordered_set<std::uint64_t>& met,
+              std::vector<bool>& had_bye,
+              std::size_t& bye,
+              std::size_t window=64)
+{
+    const std::size_t n = half_points.size();
+    unsigned top = 0;
+    BOOST_FOREACH(unsigned p, half_points) {
+        top = std::max(top, p);
+    }
+
+    // Counting sort into point buckets, highest first and stable by
+    // index within a bucket.
+    std::vector<std::size_t> start(top + 2, 0);
+    BOOST_FOREACH(unsigned p, half_points) {
+        ++start[top - p + 1];
+    }
+    for (unsigned b = 0; b <= top; ++b)
+        start[b + 1] += start[b];
+    std::vector<std::size_t> order(n);
+    for (std::size_t i = 0; i < n; ++i)
+        order[start[top - half_points[i]]++] = i;
+
+    bye = n;
+    if (n % 2) {
+        std::size_t k = n;
+        while (k > 0 && had_bye[order[k - 1]])
+            --k;
+        std::size_t pos = (k > 0) ? k - 1 : n - 1;
+        bye = order[pos];
+        had_bye[bye] = true;
+        order.erase(order.begin() + pos);
+    }
+
+    std::vector<std::pair<std::size_t, std::size_t> > pairings;
+    pairings.reserve(order.size() / 2);
+    std::vector<bool> paired(order.size(), false);
+    std::size_t next = 0;
+    for (std::size_t a = 0; a < order.size(); ++a) {
+        if (paired[a])
+            continue;
+        paired[a] = true;
+        next = std::max(next, a + 1);
+        while (next < order.size() && paired[next])
+            ++next;
+
+        std::size_t choice = next, looked = 0;
+        for (std::size_t b = next; b < order.size() && looked < window; ++b) {
+            if (paired[b])
+                continue;
+            ++looked;
+            std::size_t i = std::min(order[a], order[b]), j = std::max(order[a], order[b]);
+            if (!met.count((std::uint64_t(i) << 32) | j)) {
+                choice = b;
+                break;
+            }
+        }
+        paired[choice] = true;
+        pairings.push_back(std::make_pair(std::min(order[a], order[choice]),
+                                          std::max(order[a], order[choice])));
+    }
+    return pairings;
+}
+
+/* Plays a Swiss tournament of `swiss_rounds` rounds, each match lasting
+   `num_rounds` rounds. Each round's matches run in parallel on `pool`;
+   `stop` behaves as for `playPairings`.
+*/
+inline SwissResult swiss(const std::vector<const Player*>& players,
+                         std::size_t num_rounds,
+                         std::size_t swiss_rounds,
+                         ThreadPool& pool,
+                         std::atomic<bool>& stop)
+{
+    const std::size_t n = players.size();
+    SwissResult rslt;
+    rslt.half_points.assign(n, 0);
+    rslt.buchholz.assign(n, 0);
+    if (n < 2)
+        swiss_rounds = 0;
+
+    std::unordered_set<std::uint64_t> met;
+    std::vector<bool> had_bye(n, false);
+    for (std::size_t round = 0; round < swiss_rounds; ++round) {
+        std::size_t bye;
+        std::vector<std::pair<std::size_t, std::size_t> > pairings =
+            swissPairings(rslt.half_points, met, had_bye, bye);
+
+        std::vector<MatchSummary> results =
+            playPairings(players, pairings, num_rounds, pool, stop);
+
+        if (bye < n)
+            rslt.half_points[bye] += 1;
+        BOOST_FOREACH(const MatchSummary& m, results) {
+            met.insert((std::uint64_t(m.p1) << 32) | m.p2);
+            if (m.p1_wins > m.p2_wins)
+                rslt.half_points[m.p1] += 2;
+            else if (m.p2_wins > m.p1_wins)
+                rslt.half_points[m.p2] += 2;
+            else {
+                rslt.half_points[m.p1] += 1;
+                rslt.half_points[m.p2] += 1;
+            }
+        }
+        rslt.matches.insert(rslt.matches.end(), results.begin(), results.end());
+    }
+
+    BOOST_FOREACH(const MatchSummary& m, rslt.matches) {
+        rslt.buchholz[m.p1] += rslt.half_points[m.p2];
+        rslt.buchholz[m.p2] += rslt.half_points[m.p1];
+    }
+
+    rslt.ranking.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+        rslt.ranking[i] = i;
+    std::sort(rslt.ranking.begin(), rslt.ranking.end(), [&](std::size_t a, std::size_t b) {
+            if (rslt.half_points[a] != rslt.half_points[b])
+                return rslt.half_points[a] > rslt.half_points[b];
+            if (rslt.buchholz[a] != rslt.buchholz[b])
+                return rslt.buchholz[a] > rslt.buchholz[b];
+            return a < b;
+        });
+    return rslt;
+}
+
+#endif
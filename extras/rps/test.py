@@ -0,0 +1,692 @@
+import array
+import asyncio
+import multiprocessing
+import os
+import random
+import signal
+import struct
+import tempfile
+import threading
+
+import rps
+
+# Shared-memory results written by worker processes.
+NUM_PLAYERS, NUM_ROUNDS = 3, 50
+PAIRS = [(i, j) for i in range(NUM_PLAYERS) for j in range(NUM_PLAYERS) if i != j]
+SHM_NAME = '/rps_test_%d' % os.getpid()
+
+
+def shared_results_worker(match):
+    table = rps.SharedResults(SHM_NAME)
+    players = [rps.TitForTat('t4t'), rps.Random('random'), rps.Random('random2')]
+    i, j = PAIRS[match]
+    table.record(match, i, j, players[i], players[j])
+
+
+table = rps.SharedResults(SHM_NAME, NUM_PLAYERS, len(PAIRS), NUM_ROUNDS)
+try:
+    with multiprocessing.get_context('fork').Pool(2) as pool:
+        pool.map(shared_results_worker, range(len(PAIRS)))
+
+    h2h = table.head_to_head()
+    scores = table.scores()
+    assert h2h.shape == (NUM_PLAYERS, NUM_PLAYERS)
+    assert scores.shape == (len(PAIRS), NUM_ROUNDS)
+    assert [tuple(p) for p in table.match_players().tolist()] == PAIRS
+    total_wins = sum(sum(row) for row in h2h.tolist())
+    decided = sum(1 for row in scores.tolist() for s in row if s != 0)
+    assert total_wins == decided
+finally:
+    table.unlink()
+
+
+# Asynchronous play on the native thread pool.
+class Failing(rps.Player):
+    def next_move(self, history, pos):
+        raise KeyError('broken strategy')
+
+
+class Slow(rps.Player):
+    def next_move(self, history, pos):
+        return rps.Move.Rock
+
+
+async def async_checks():
+    scores = await rps.play_async(rps.TitForTat('t4t'), rps.Random('random'), 20)
+    assert len(scores) == 20
+
+    players = [rps.TitForTat('t4t'), rps.Random('r1'), rps.Random('r2')]
+    results = await rps.tournament_async(players, 10)
+    assert [(i, j) for i, j, _, _, _ in results] == [(0, 1), (0, 2), (1, 2)]
+    assert all(w1 + w2 + t == 10 for _, _, w1, w2, t in results)
+
+    try:
+        await rps.play_async(Failing('f'), rps.Random('r'), 5)
+    except KeyError:
+        pass
+    else:
+        raise AssertionError('expected KeyError')
+
+    future = rps.play_async(Slow('s'), rps.Random('r'), 10 ** 5)
+    await asyncio.sleep(0.05)
+    future.cancel()
+    try:
+        await future
+    except asyncio.CancelledError:
+        pass
+    else:
+        raise AssertionError('expected CancelledError')
+
+asyncio.run(async_checks())
+assert len(rps.tournament([rps.Random('a'), rps.Random('b')], 5)) == 1
+
+# Coroutine strategies.
+assert 'tit_for_tat' in rps.strategies()
+cycle = rps.CoroutinePlayer('cycle', 'cycle')
+beat_last = rps.CoroutinePlayer('beat_last', 'beat_last')
+for _ in range(2):
+    # cycle always plays what beats its own last move, as does beat_last.
+    assert rps.play(cycle, beat_last, 30)[1:] == [0] * 29
+assert len(rps.play(cycle, cycle, 10)) == 10
+# Each match keeps its own run, so one instance can play many at once.
+opponents = [rps.TitForTat('t%d' % i, i) for i in range(8)]
+expected = [rps.play(cycle, t, 40).count(-1) for t in opponents]
+assert [w for i, _, w, _, _ in rps.tournament([cycle] + opponents, 40) if i == 0] == expected
+assert rps.play_strategies('cycle', 'beat_last', 30)[1:] == [0] * 29
+
+# Generic matrix games.
+rps_game = rps.MatrixGame.named('rps')
+custom = rps.MatrixGame([[0, -1, 1], [1, 0, -1], [-1, 1, 0]])
+moves1, moves2 = bytes([0, 1, 2, 0]), bytes([1, 1, 0, 2])
+assert rps_game.score(moves1, moves2)[0].tolist() == [-1.0, 0.0, -1.0, 1.0]
+assert custom.score(moves1, moves2)[1].tolist() == rps_game.score(moves1, moves2)[1].tolist()
+assert [rps.score(rps.Move.values[a], rps.Move.values[b]) for a, b in zip(moves1, moves2)] == \
+    rps_game.score(moves1, moves2)[1].tolist()
+assert rps.MatrixGame.named('rpsls').payoff(4, 3) == 1.0
+
+pd = rps.MatrixGame.named('prisoners_dilemma')
+moves, payoffs = pd.play(rps.CopyGamePlayer('copy'), rps.FixedGamePlayer('defect', 1), 3)
+assert moves.tolist() == [[0, 1], [1, 1], [1, 1]]
+assert payoffs.tolist() == [[0.0, 5.0], [1.0, 1.0], [1.0, 1.0]]
+
+
+class Alternate(rps.GamePlayer):
+    def next_move(self, history, pos, num_moves):
+        return len(history) % num_moves
+
+moves, _ = rps.MatrixGame.named('rpsls').play(Alternate('alt'), rps.UniformGamePlayer('u'), 7)
+assert [m for m, _ in moves.tolist()] == [0, 1, 2, 3, 4, 0, 1]
+
+# Equilibrium solvers.
+for method in ('regret_matching', 'fictitious_play', 'lp'):
+    x = rps.solve_equilibrium(rps.MatrixGame.named('rpsls'), method, 5000)
+    assert all(abs(p - 0.2) < 0.02 for p in x.tolist()), (method, x.tolist())
+    assert rps.exploitability(rps.MatrixGame.named('rpsls'), x) < 0.05
+
+# A skewed RPS where rock wins double: the equilibrium is (1/4, 1/2, 1/4).
+skewed = rps.MatrixGame([[0, -1, 2], [1, 0, -1], [-2, 1, 0]])
+x = rps.solve_equilibrium(skewed, 'lp').tolist()
+assert all(abs(p - q) < 1e-9 for p, q in zip(x, [1 / 4, 1 / 2, 1 / 4])), x
+assert rps.exploitability(skewed, [1 / 3] * 3) > 0.1
+
+# Regret-matching learners.
+class AlwaysRock(rps.Player):
+    def next_move(self, history, pos):
+        return rps.Move.Rock
+
+learner = rps.RegretMatcher('rm', 7)
+learned = rps.MatchContext()
+scores = rps.play(AlwaysRock('rock'), learner, 200, learned)
+assert scores[-50:] == [1] * 50
+assert learner.strategy(1, learned)[rps.Move.Paper] == 1.0
+assert all(abs(p - 1 / 3) < 1e-6 for p in learner.strategy(1))
+# It learns in each match separately, even with matches running at once.
+lineup = [learner] + [rps.TitForTat('t%d' % i, i) for i in range(6)]
+expected = [rps.play(learner, t, 60).count(-1) for t in lineup[1:]]
+assert [w for i, _, w, _, _ in rps.tournament(lineup, 60) if i == 0] == expected
+assert rps.play(AlwaysRock('rock'), rps.RegretMatcher('rm', 7), 200) == scores
+
+moves, _ = rps.MatrixGame.named('prisoners_dilemma').play(
+    rps.RegretMatchingGamePlayer('rm', rps.MatrixGame.named('prisoners_dilemma'), 3),
+    rps.CopyGamePlayer('copy'), 100)
+assert [m for m, _ in moves.tolist()[-10:]] == [1] * 10
+# It learns in each match separately, even with matches running at once:
+# these opponents keep four matches in lockstep, round by round.
+class PatternGamePlayer(rps.GamePlayer):
+    def __init__(self, name, step, barrier=None):
+        rps.GamePlayer.__init__(self, name)
+        self.step = step
+        self.barrier = barrier
+
+    def next_move(self, history, pos, num_moves):
+        if self.barrier:
+            self.barrier.wait(10)
+        return len(history) * self.step // 7 % num_moves
+
+game = rps.MatrixGame.named('rps')
+game_learner = rps.RegretMatchingGamePlayer('rm', game, 3)
+expected = [game.play(game_learner, PatternGamePlayer('p', s), 100)[0].tolist() for s in range(1, 5)]
+barrier = threading.Barrier(4)
+played = [None] * 4
+def play_pattern(s):
+    played[s - 1] = game.play(game_learner, PatternGamePlayer('p', s, barrier), 100)[0].tolist()
+threads = [threading.Thread(target=play_pattern, args=(s,)) for s in range(1, 5)]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+assert played == expected
+
+# Free-for-all games.
+class CopyNext(rps.SeatPlayer):
+    def next_move(self, view):
+        if view.num_rounds == 0:
+            return rps.Move.Paper
+        return rps.Move.values[view.opponent(0)[-1]]
+
+seats = [rps.FixedSeat('rock', rps.Move.Rock), rps.FixedSeat('rock2', rps.Move.Rock),
+         rps.FixedSeat('scissors', rps.Move.Scissors), CopyNext('copy')]
+scores, history = rps.play_multi(seats, 3)
+assert history.shape == (4, 3)
+assert history.tolist()[3] == [1, 0, 0]
+# Round 1: paper beats both rocks, rocks beat scissors, scissors beat paper.
+# Rounds 2-3: three rocks beat scissors.
+assert scores == [0 + 1 + 1, 0 + 1 + 1, -1 - 3 - 3, 1 + 1 + 1]
+assert sum(rps.play_multi([rps.SeatRandom('r', i) for i in range(64)] + [rps.BeatPlurality('b')], 50)[0]) == 0
+
+# Split history scans.
+moves = bytes([0] * 40 + [1] * 33 + [2] * 27)
+assert rps.histogram(moves) == [40, 33, 27]
+assert rps.histogram(b'') == [0, 0, 0]
+assert rps.histogram(bytes([7] * 32)) == rps.histogram(bytes([7] * 31)) == [0, 0, 0]
+assert rps.play(AlwaysRock('rock'), rps.FrequencyCounter('freq'), 100)[1:] == [1] * 99
+
+# Reusable match contexts.
+context = rps.MatchContext()
+assert rps.play(AlwaysRock('rock'), rps.FrequencyCounter('freq'), 100, context)[1:] == [1] * 99
+assert context.capacity >= 100
+assert rps.play(AlwaysRock('rock'), AlwaysRock('rock2'), 50, context=context) == [0] * 50
+assert context.capacity >= 100
+
+# Natively created populations.
+assert 'coroutine:beat_last' in rps.player_kinds()
+population = rps.Population()
+assert population.add('tit_for_tat', 3) == 0
+assert population.add('regret_matcher', 1000, 'rm', seed=5) == 3
+assert population.add('coroutine:cycle', 2) == 1003
+assert len(population) == 1005
+assert population[0].name == 'tit_for_tat' and population[4].name == 'rm'
+assert isinstance(population[4], rps.RegretMatcher) and population[4].seed == 6
+assert population[1004].strategy == 'cycle'
+small = rps.Population()
+small.add('frequency_counter', 2)
+small.add('coroutine:cycle', 1)
+assert len(small.tournament(30)) == 3
+# Seeded kinds make the same population, and the same results, every time.
+def seeded_population():
+    p = rps.Population()
+    p.add('random', 4, seed=11)
+    p.add('tit_for_tat', 4, seed=20)
+    return p
+assert seeded_population().tournament(40) == seeded_population().tournament(40)
+try:
+    population.add('nope', 1)
+    assert False
+except ValueError:
+    pass
+
+# Ratings.
+ratings = rps.Ratings(2)
+ratings.update_scores(0, 1, rps.play(AlwaysRock('rock'), rps.FrequencyCounter('freq'), 10))
+mean = ratings.mean()
+assert mean[1] > 1500 > mean[0] and abs(mean[0] + mean[1] - 3000) < 1e-9
+assert ratings.games().tolist() == [1, 1] and ratings.expected(1, 0) > 0.5
+
+results = rps.tournament([rps.FrequencyCounter('f'), AlwaysRock('r'),
+                          rps.CoroutinePlayer('c', 'cycle'), rps.RegretMatcher('rm', 1)], 50)
+for system in ('elo', 'glicko', 'trueskill'):
+    forward, backward = rps.Ratings(4, system), rps.Ratings(4, system)
+    forward.update_batch(results)
+    backward.update_batch(list(reversed(results)))
+    assert forward.mean().tolist() == backward.mean().tolist()
+    assert forward.deviation().tolist() == backward.deviation().tolist()
+    assert forward.mean()[0] > forward.mean()[1]
+    if system != 'elo':
+        assert max(forward.deviation()) < rps.Ratings(1, system).deviation()[0]
+trueskill = rps.Ratings(2, 'trueskill')
+trueskill.update((0, 1, 5, 1, 0))
+assert trueskill.mean()[0] > 25 > trueskill.mean()[1]
+
+# Swiss tournaments.
+ranking, points, results = rps.swiss([AlwaysRock('r0'), rps.FrequencyCounter('f'),
+                                      AlwaysRock('r1'), AlwaysRock('r2'), AlwaysRock('r3')], 20, 3)
+assert ranking[0] == 1 and points[1] == 3.0
+assert sum(points) == 6 * 1.0 + 3 * 0.5 and len(results) == 6
+assert len({(m[0], m[1]) for m in results}) == 6
+big = rps.Population()
+big.add('regret_matcher', 1000, seed=1)
+big.add('frequency_counter', 24)
+ranking, points, results = big.swiss(30, 10)
+assert len(results) == 10 * 512 and sorted(ranking) == list(range(1024))
+assert points[ranking[0]] >= points[ranking[-1]]
+
+# Racing for the top k.
+field = [AlwaysRock('r%d' % i) for i in range(20)] + [rps.FrequencyCounter('f')]
+result = rps.race(field, 1, 10, max_matches=10**5, seed=3)
+assert result['top'] == [20] and result['confident']
+assert result['round_robin_matches'] == 210
+assert sum(result['matches']) == 2 * result['total_matches']
+capped = rps.race(field, 1, 10, max_matches=25)
+assert capped['total_matches'] == 25 and not capped['confident']
+assert capped['saved'] == 1 - 25 / 210
+
+# Result caching.
+assert rps.play(rps.Random('a', 1), rps.TitForTat('t', 2), 50) == \
+    rps.play(rps.Random('b', 1), rps.TitForTat('u', 2), 50)
+with tempfile.TemporaryDirectory() as cache_dir:
+    cache = rps.ResultCache(2, cache_dir)
+    rps.set_result_cache(cache)
+    try:
+        first = rps.play(rps.Random('a', 1), rps.TitForTat('t', 2), 50)
+        assert rps.play(rps.Random('b', 1), rps.TitForTat('u', 2), 50) == first
+        assert (cache.hits, cache.misses) == (1, 1)
+        rps.play(rps.TitForTat('t', 2), rps.Random('a', 1), 50)
+        rps.play(rps.Random('a', 1), rps.TitForTat('t', 2), 51)
+        rps.play(rps.Random('a', 1), rps.Random('r'), 50)
+        assert (cache.misses, len(cache)) == (3, 2)
+        assert rps.play(rps.Random('a', 1), rps.TitForTat('t', 2), 50) == first
+        assert cache.disk_hits == 1
+
+        rps.set_result_cache(rps.ResultCache(10, cache_dir))
+        rps.tournament([rps.Random('a', 1), rps.TitForTat('t', 2), rps.RegretMatcher('m', 3)], 50)
+        warm = rps.ResultCache(10, cache_dir)
+        rps.set_result_cache(warm)
+        rps.tournament([rps.Random('a', 1), rps.TitForTat('t', 2), rps.RegretMatcher('m', 3)], 50)
+        assert (warm.disk_hits, warm.misses) == (3, 0)
+    finally:
+        rps.set_result_cache(None)
+
+# Incremental leagues.
+with tempfile.TemporaryDirectory() as league_dir:
+    path = os.path.join(league_dir, 'league.tsv')
+    league = rps.League(path, 20)
+    for i in range(4):
+        league.add(rps.Random('r%d' % i, i))
+    assert league.pending == 6 and league.update() == 6
+    league.add(rps.FrequencyCounter('freq'))
+    assert league.pending == 4 and league.update() == 4
+    standings = league.standings()
+    assert [s[1] for s in standings] == [4] * 5
+    assert sum(s[2] for s in standings) == sum(s[3] for s in standings)
+    table = league.head_to_head()
+    assert table.shape == (5, 5) and table.tolist()[0][0] == 0
+    assert len(league.results()) == 10 and len(league.ratings('glicko').mean()) == 5
+
+    league.remove('r0')
+    assert [s[1] for s in league.standings()] == [3] * 4
+
+    reopened = rps.League(path, 20)
+    for i in range(4):
+        reopened.add(rps.Random('r%d' % i, i))
+    assert reopened.pending == 0 and [s[1] for s in reopened.standings()] == [3] * 4
+    reopened.add(rps.Random('r4', 4))
+    assert reopened.pending == 4 and reopened.update() == 4 and [s[1] for s in reopened.standings()] == [4] * 5
+    # Results were kept by fingerprint: a player without one, or one
+    # rejoining with a different seed, starts afresh.
+    reopened.add(rps.FrequencyCounter('freq'))
+    assert reopened.pending == 5
+    reseeded = rps.League(path, 20)
+    reseeded.add(rps.Random('r0', 100))
+    reseeded.add(rps.Random('r1', 1))
+    reseeded.add(rps.Random('r2', 2))
+    assert reseeded.pending == 2
+    try:
+        rps.League(path, 21)
+        assert False
+    except ValueError:
+        pass
+
+# Memory-one strategies and the lane engine.
+names = ['cycle', 'rock', 'beat_last', 'win_stay_lose_shift', 'random']
+strategies = [rps.MemoryOne.named(n) for n in names]
+assert rps.MemoryOne.from_code(strategies[0].code).table == strategies[0].table
+assert not strategies[2].deterministic and strategies[2].table[1] == 2
+pairs = [(0, 1), (1, 0), (0, 0), (3, 1)] * 20
+p1, p2, ties = rps.play_lanes(strategies, pairs, 100)
+for m, (i, j) in enumerate(pairs[:3]):
+    scores = rps.play(rps.MemoryOnePlayer('a', strategies[i]), rps.MemoryOnePlayer('b', strategies[j]), 100)
+    assert (p1[m], p2[m], ties[m]) == (scores.count(-1), scores.count(1), scores.count(0))
+assert p1[3] + p2[3] + ties[3] == 100 and p1[3] >= 98
+flat = array.array('I', [x for pair in pairs for x in pair])
+assert rps.play_lanes(strategies, flat, 100)[0].tolist() == p1.tolist()
+p1, p2, ties = rps.play_lanes(strategies, [(4, 4)] * 1000, 300, seed=5)
+assert abs(sum(p1) / 300000.0 - 1 / 3.0) < 0.01 and abs(sum(p2) / 300000.0 - 1 / 3.0) < 0.01
+
+# Exact analysis of finite-state strategies.
+wins1, wins2, tied = rps.expected_scores(rps.TitForTat('t'), rps.Random('r'), 100)
+assert abs(wins1 - 100 / 3.0) < 1e-9 and abs(wins1 + wins2 + tied - 100) < 1e-9
+cycle, rock = rps.MemoryOne.named('cycle'), rps.MemoryOne.named('rock')
+scores = rps.play(rps.MemoryOnePlayer('c', cycle), rps.MemoryOnePlayer('r', rock), 100)
+assert rps.expected_scores(cycle, rock, 100) == (scores.count(-1), scores.count(1), scores.count(0))
+assert [round(x, 9) for x in rps.long_run(cycle, rock)] == [round(1 / 3.0, 9)] * 3
+assert [round(x, 9) for x in rps.long_run(rps.MemoryOne.named('beat_last'), rock)] == [1.0, 0.0, 0.0]
+biased = rps.Automaton([((0.5, 0.5, 0.0), [0] * 9)])
+assert len(biased) == 1
+assert [round(x, 9) for x in rps.long_run(biased, rps.MemoryOne.named('paper'))] == [0.0, 0.5, 0.5]
+try:
+    rps.expected_scores(rps.FrequencyCounter('f'), rock, 10)
+    assert False
+except ValueError:
+    pass
+
+# The memory-one strategy space.
+sample = rps.sample_strategy_space(50, seed=2)
+codes = [o.code for o in sample]
+assert len(set(codes)) == 50 and codes == sorted(codes)
+opponents = sample[:20] + [rps.MemoryOne.named('random')]
+with tempfile.TemporaryDirectory() as space_dir:
+    path = os.path.join(space_dir, 'space.bin')
+    run = rps.play_strategy_space(path, opponents, 101, begin=1000, end=1300)
+    assert run == {'rows': 300, 'cols': 21, 'matches': 6300, 'complete': True}
+    begin, loaded, matrix = rps.load_strategy_space(path)
+    assert begin == 1000 and [o.table for o in loaded] == [o.table for o in opponents]
+    assert matrix.shape == (300, 21)
+    for row, col in [(0, 0), (17, 5), (299, 19), (123, 3)]:
+        scores = rps.play(rps.MemoryOnePlayer('a', rps.MemoryOne.from_code(1000 + row)),
+                          rps.MemoryOnePlayer('b', opponents[col]), 101)
+        assert matrix[row, col] == scores.count(-1) - scores.count(1)
+    assert all(abs(matrix[row, 20]) <= 101 for row in range(300))
+
+    # An interrupted run leaves the rows it finished.
+    threading.Timer(0.05, os.kill, (os.getpid(), signal.SIGINT)).start()
+    try:
+        rps.play_strategy_space(path, [rps.MemoryOne.named('random')] * 8, 32767)
+        assert False
+    except KeyboardInterrupt:
+        pass
+    begin, _, matrix = rps.load_strategy_space(path)
+    assert begin == 0 and 0 < matrix.shape[0] < 59049 and matrix.shape[0] % 256 == 0
+    try:
+        rps.play_strategy_space(os.path.join(space_dir, 'missing', 'space.bin'), opponents, 10)
+        assert False
+    except RuntimeError:
+        pass
+
+    # Corrupted files are refused rather than trusted.
+    with open(path, 'rb') as f:
+        good = f.read()
+    corrupted = {
+        'opponent': good[:24] + bytes([200]) + bytes([250] * 9) + good[34:],
+        'rows': good[:12] + struct.pack('<I', 1 << 30) + good[16:],
+        'short': good[:-1],
+    }
+    for name, data in corrupted.items():
+        with open(path, 'wb') as f:
+            f.write(data)
+        try:
+            rps.load_strategy_space(path)
+            assert False, name
+        except RuntimeError:
+            pass
+
+# Evolving memory-one strategies.
+rock = rps.MemoryOne.named('rock')
+seen = []
+evolution = rps.Evolution([rock, rps.MemoryOne.named('cycle'), rps.MemoryOne.named('random')],
+                          population_size=40, num_rounds=60, seed=4)
+last = evolution.run(30, lambda g: seen.append(g['fitness'][0]))
+assert len(seen) == 30 and last['generation'] == 29 and evolution.generation == 30
+assert seen == sorted(seen) and seen[-1] > 0.5
+assert abs(evolution.fitness(last['population'][0]) - seen[-1]) < 1e-12
+assert last['cache_hits'] > 0 and evolution.cache_size < 30 * 40
+# Genomes with random entries are evaluated exactly as well.
+beat_last = rps.MemoryOne.named('beat_last')
+wins, losses, _ = rps.expected_scores(rps.MemoryOnePlayer('b', beat_last), rps.MemoryOnePlayer('r', rock), 100)
+assert abs(rps.Evolution([rock]).fitness(beat_last) - (wins - losses) / 100) < 1e-12
+again = rps.Evolution([rock, rps.MemoryOne.named('cycle'), rps.MemoryOne.named('random')],
+                      population_size=40, num_rounds=60, seed=4)
+stopped = again.run(30, lambda g: g['generation'] < 4)
+assert stopped['generation'] == 4 and [s.code for s in stopped['population']] == \
+    [s.code for s in rps.Evolution([rock, rps.MemoryOne.named('cycle'), rps.MemoryOne.named('random')],
+                                   population_size=40, num_rounds=60, seed=4).run(5)['population']]
+
+# Population dynamics.
+pure = rps.strategy_game([rps.MemoryOne.named(n) for n in ('rock', 'paper', 'scissors')], 10)
+assert pure.payoff_matrix().tolist() == rps.MatrixGame.named('rps').payoff_matrix().tolist()
+replicator = rps.Replicator(pure, mutation=0.3)
+replicator.set_frequencies([0.8, 0.1, 0.1])
+trajectory = replicator.advance(3000, dt=0.01, record_every=100)
+assert trajectory.shape == (30, 3) and abs(replicator.time - 30) < 1e-9
+assert all(abs(x - 1 / 3.0) < 1e-3 for x in replicator.frequencies().tolist())
+assert all(abs(sum(row) - 1) < 1e-9 for row in trajectory.tolist())
+
+dominated = rps.strategy_game([rps.MemoryOne.named('paper'), rps.MemoryOne.named('rock')], 10)
+agents = rps.AgentPopulation(dominated, 100000, selection=5.0, mutation=0.0, seed=1)
+assert len(agents) == 100000 and agents.agents.readonly
+counts = agents.advance(20)
+assert counts.shape == (20, 2) and all(sum(row) == 100000 for row in counts.tolist())
+assert counts[19, 0] > 99000 and counts[19, 0] == agents.counts()[0]
+assert sum(agents.agents) == counts[19, 1]
+again = rps.AgentPopulation(dominated, 100000, selection=5.0, mutation=0.0, seed=1)
+assert again.advance(20).tolist() == counts.tolist()
+cyclic = rps.AgentPopulation(pure, 30000, mutation=0.01, seed=2)
+cyclic.set_counts([30000, 0, 0])
+assert min(cyclic.advance(200).tolist()[199]) > 0
+
+# Spatial rock-paper-scissors.
+lattice = rps.Lattice(40, 24, seed=3)
+grid = lattice.grid
+assert grid.shape == (24, 40) and sum(lattice.counts()) == 960
+grid[5, 7] = 0
+grid[5, 8] = 1
+before = grid.tolist()
+lattice.step()
+after = lattice.grid.tolist()
+assert after[5][7] == 1 and lattice.generation == 1
+for y in range(24):
+    for x in range(40):
+        p = (before[y][x] + 1) % 3
+        invaded = p in (before[(y + 1) % 24][x], before[y - 1][x], before[y][(x + 1) % 40], before[y][x - 1])
+        assert after[y][x] == (p if invaded else before[y][x])
+lattice.step(3, threshold=3, moore=True)
+lattice.sweep(2, seed=1)
+swept = lattice.grid.tolist()
+again = rps.Lattice(40, 24, seed=3)
+again.grid[5, 7] = 0
+again.grid[5, 8] = 1
+again.step()
+again.step(3, threshold=3, moore=True)
+again.sweep(2, seed=1)
+assert again.grid.tolist() == swept and again.sweeps == 2
+again.grid[3, 3] = 7
+for update in (again.step, again.sweep, again.counts):
+    try:
+        update()
+        assert False
+    except ValueError:
+        pass
+
+# Replaying recorded moves.
+recorded = bytes([0, 1, 2, 2, 1, 0, 0])
+from_buffer = rps.MoveRecording(recorded)
+with tempfile.TemporaryDirectory() as replay_dir:
+    path = os.path.join(replay_dir, 'moves.rps')
+    rps.write_move_file(path, recorded)
+    assert os.path.getsize(path) == 16 + 2
+    from_file = rps.MoveRecording(path)
+assert len(from_file) == 7 and [int(from_file[i]) for i in range(7)] == list(recorded)
+assert from_file.digest == from_buffer.digest
+replay = rps.ReplayPlayer('human', from_file, offset=2)
+scores = rps.play(replay, AlwaysRock('rock'), 10)
+assert scores == [-1 if m == 1 else (1 if m == 2 else 0) for m in (recorded * 3)[2:12]]
+field = [rps.ReplayPlayer('h%d' % i, from_buffer, offset=i) for i in range(7)]
+assert len(rps.tournament(field, 20)) == 21
+del from_buffer, field
+try:
+    rps.MoveRecording(bytes([0, 3]))
+    assert False
+except ValueError:
+    pass
+# A buffer that can change is copied, so it cannot slip in a bad move.
+mutable = bytearray(recorded)
+from_bytearray = rps.MoveRecording(mutable)
+mutable[0] = 3
+assert from_bytearray.digest == from_file.digest and int(from_bytearray[0]) == 0
+with tempfile.TemporaryDirectory() as replay_dir:
+    # A header claiming 2**64 - 1 moves.
+    path = os.path.join(replay_dir, 'huge.rps')
+    with open(path, 'wb') as f:
+        f.write(b'RPSMOVES' + b'\xff' * 8 + b'\x00' * 4)
+    try:
+        rps.MoveRecording(path)
+        assert False
+    except RuntimeError:
+        pass
+
+# N-gram models trained on round logs.
+def ngram_reference(log, order, both_seats):
+    counts = {}
+    history = []
+    for r in log:
+        if r == rps.ROUND_BREAK:
+            history = []
+            continue
+        seats = [(r, r // 3)] + ([(r % 3 * 3 + r // 3, r % 3)] if both_seats else [])
+        for seat, (code, move) in enumerate(seats):
+            rounds = [h[seat] for h in history]
+            for j in range(min(len(rounds), order) + 1):
+                key = tuple(rounds[len(rounds) - j:])
+                counts.setdefault(key, [0, 0, 0])[move] += 1
+        history.append((r, r % 3 * 3 + r // 3))
+    return counts
+
+# Player 1 cycles through the moves; player 2 plays at random.
+log = bytearray()
+for m in range(300):
+    if m:
+        log.append(rps.ROUND_BREAK)
+    for i in range(500):
+        log.append((i + m) % 3 * 3 + (i * i + 7 * m) % 11 % 3)
+with tempfile.TemporaryDirectory() as ngram_dir:
+    trainer = rps.NGramTrainer(order=2)
+    trainer.add(bytes(log))
+    summary = trainer.write(os.path.join(ngram_dir, 'whole.ngram'))
+    assert summary['rounds'] == trainer.rounds == 150000
+
+    # Logs split at a break count the same as one log.
+    split = log.index(rps.ROUND_BREAK, 70000)
+    with open(os.path.join(ngram_dir, 'tail.log'), 'wb') as f:
+        f.write(log[split:])
+    parts = rps.NGramTrainer(order=2)
+    parts.add(log[:split])
+    parts.add(os.path.join(ngram_dir, 'tail.log'))
+    assert parts.write(os.path.join(ngram_dir, 'parts.ngram')) == summary
+
+    model = rps.NGramModel(os.path.join(ngram_dir, 'whole.ngram'))
+    reference = ngram_reference(log, 2, True)
+    assert len(model) == summary['contexts'] == len(reference)
+    assert model.order == 2 and model.rounds == 150000 and model.digest == summary['digest']
+    for key, c in reference.items():
+        context = [(code // 3, code % 3) for code in key]
+        assert model.counts(context) == tuple(c)
+    # Player 1 never plays the same move twice running.
+    assert model.counts([(0, 0), (0, 0)]) is None
+
+    # It has learned that a player who played Rock then Paper plays
+    # Scissors next.
+    cycle = rps.ReplayPlayer('cycle', rps.MoveRecording(bytes([0, 1, 2])))
+    predictor = rps.NGramPlayer('ngram', model)
+    assert rps.play(predictor, cycle, 100).count(-1) >= 98
+    # Writing a model replaces the file rather than rewriting the one
+    # already mapped.
+    rps.NGramTrainer(order=1).write(os.path.join(ngram_dir, 'whole.ngram'))
+    assert model.counts([(0, 0)]) == tuple(reference[(0,)])
+    assert rps.NGramModel(os.path.join(ngram_dir, 'whole.ngram')).order == 1
+    assert sorted(os.listdir(ngram_dir)) == ['parts.ngram', 'tail.log', 'whole.ngram']
+    del predictor, model
+    # A damaged model with no free slot finds nothing rather than
+    # probing forever.
+    with open(os.path.join(ngram_dir, 'full.ngram'), 'wb') as f:
+        f.write(b'RPSNGRAM' + struct.pack('<6Q', 0, 1, 16, 0, 0, 0) +
+                struct.pack('<16Q', *[1 << 63] * 16) + bytes(16 * 12))
+    assert rps.NGramModel(os.path.join(ngram_dir, 'full.ngram')).counts([]) is None
+    try:
+        rps.NGramTrainer(order=2).add(bytes([9]))
+        assert False
+    except ValueError:
+        pass
+
+# Monte Carlo tree search.
+def mcts_match(**kwargs):
+    player = rps.MctsPlayer('mcts', **kwargs)
+    return player, rps.play(player, rps.ReplayPlayer('cycle', rps.MoveRecording(bytes([0, 1, 2]))), 60)
+
+searcher, scores = mcts_match(iterations=300, budget=0, seed=3)
+assert scores.count(-1) >= 50
+assert mcts_match(iterations=300, budget=0, seed=3)[1] == scores
+stats = searcher.search_stats()
+assert stats['iterations'] == 300 and stats['reused'] > 0 and stats['nodes'] > 0
+assert rps.play(searcher, AlwaysRock('rock'), 30).count(-1) >= 25
+# Each match searches its own tree, even with matches running at once.
+searcher = rps.MctsPlayer('mcts', iterations=200, budget=0, seed=5)
+lineup = [searcher] + [rps.ReplayPlayer('r%d' % i, rps.MoveRecording(bytes([0, 1, 2, 2, 1])), offset=i)
+                       for i in range(5)] + [rps.TitForTat('t%d' % i, i) for i in range(5)]
+expected = [rps.play(searcher, p, 60).count(-1) for p in lineup[1:]]
+for _ in range(2):
+    assert [w for i, _, w, _, _ in rps.tournament(lineup, 60) if i == 0] == expected
+
+# Several workers under a time budget, in a small tree.
+searcher, scores = mcts_match(depth=3, budget=0.001, threads=4, max_nodes=2000)
+assert scores.count(-1) >= 45 and searcher.search_stats()['nodes'] < 2000
+
+# With an n-gram prior it beats the cycle from the second round on.
+with tempfile.TemporaryDirectory() as mcts_dir:
+    trainer = rps.NGramTrainer(order=2, both_seats=False)
+    trainer.add(bytes(i % 3 * 3 + (i * i) % 7 % 3 for i in range(3000)))
+    trainer.write(os.path.join(mcts_dir, 'cycle.ngram'))
+    prior = rps.NGramModel(os.path.join(mcts_dir, 'cycle.ngram'))
+assert mcts_match(iterations=300, budget=0, model=prior)[1][1:6] == [-1] * 5
+for bad in [dict(depth=0), dict(depth=17), dict(budget=0), dict(threads=0),
+            dict(prior_weight=0), dict(prior_weight=-1), dict(prior_weight=float('inf')),
+            dict(exploration=-0.5), dict(exploration=float('nan'))]:
+    try:
+        rps.MctsPlayer('bad', **bad)
+        assert False
+    except ValueError:
+        pass
+
+# Quantized MLP predictors.
+def mlp_reference(layers, window, mine, theirs):
+    x = [0.0] * (9 * window)
+    for k in range(min(window, len(mine))):
+        x[k * 9 + theirs[-1 - k] * 3 + mine[-1 - k]] = 1.0
+    for l, (weights, bias) in enumerate(layers):
+        x = [sum(w * v for w, v in zip(row, x)) + b for row, b in zip(weights, bias)]
+        if l + 1 < len(layers):
+            x = [max(v, 0.0) for v in x]
+    return x
+
+# Predicts that the opponent repeats its last move.
+repeat = [[[1.0 if t == m else 0.0 for t in range(3) for _ in range(3)] for m in range(3)],
+          [0.0, 0.0, 0.0]]
+rng = random.Random(5)
+hidden = [[[rng.uniform(-1, 1) for _ in range(18)] for _ in range(40)], [rng.uniform(-0.1, 0.1) for _ in range(40)]]
+output = [[[rng.uniform(-1, 1) for _ in range(40)] for _ in range(3)], [0.0, 0.1, -0.1]]
+with tempfile.TemporaryDirectory() as mlp_dir:
+    rps.write_mlp_model(os.path.join(mlp_dir, 'repeat.mlp'), 1, [repeat])
+    rps.write_mlp_model(os.path.join(mlp_dir, 'deep.mlp'), 2, [hidden, output])
+    repeat_model = rps.MlpModel(os.path.join(mlp_dir, 'repeat.mlp'))
+    deep = rps.MlpModel(os.path.join(mlp_dir, 'deep.mlp'))
+assert repeat_model.window == 1 and deep.num_layers == 2
+assert rps.play(rps.MlpPlayer('mlp', repeat_model), AlwaysRock('rock'), 50)[1:] == [-1] * 49
+for mine, theirs in [([], []), ([2], [0]), ([0, 1, 2], [2, 2, 1])]:
+    got = deep.logits(mine, theirs)
+    want = mlp_reference([hidden, output], 2, mine, theirs)
+    assert max(abs(g - w) for g, w in zip(got, want)) < 0.05 * max(map(abs, want)) + 0.01
+try:
+    rps.write_mlp_model(os.path.join(tempfile.gettempdir(), 'bad.mlp'), 1, [hidden])
+    assert False
+except ValueError:
+    pass
+
+print('ok')
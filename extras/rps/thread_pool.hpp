@@ -0,0 +1,148 @@
+// A fixed-size pool of native worker threads.
+//
+// Work submitted to the pool never holds the GIL; anything that calls
+// back into Python (e.g. a Player implemented in Python) acquires it
+// for the duration of the call.
+
+#ifndef RPS_EXTRAS_THREAD_POOL_HPP
+#define RPS_EXTRAS_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+class ThreadPool : private boost::noncopyable
+{
+public:
+    typedef std::function<void()> Job;
+
+    ThreadPool(std::size_t num_threads) : stopping_(false)
+        {
+            num_threads = std::max<std::size_t>(num_threads, 1);
+            for (std::size_t i = 0; i < num_threads; ++i)
+                threads_.push_back(std::thread(&ThreadPool::run, this));
+        }
+
+    ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            ready_.notify_all();
+            for (std::size_t i = 0; i < threads_.size(); ++i)
+                threads_[i].join();
+        }
+
+    std::size_t size() const { return threads_.size(); }
+
+    /* Queues a job. Jobs must not throw. */
+    void submit(const Job& job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                jobs_.push_back(job);
+            }
+            ready_.notify_one();
+        }
+
+private:
+    void run()
+        {
+            for (;;) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                    if (jobs_.empty())
+                        return;
+                    job.swap(jobs_.front());
+                    jobs_.pop_front();
+                }
+                job();
+            }
+        }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Job> jobs_;
+    std::vector<std::thread> threads_;
+    bool stopping_;
+};
+
+/* The pool shared by the module's parallel drivers, sized to the
+ * machine. It is deliberately never destroyed: joining workers from a
+ * static destructor while the interpreter is shutting down can
+ * deadlock on the GIL.
+ */
+inline ThreadPool& defaultPool()
+{
+    static ThreadPool* pool = new ThreadPool(std::thread::hardware_concurrency());
+    return *pool;
+}
+
+/* Calls `fn(i)` for every i in [0, n) using the pool and the calling
+   thread, and returns once all calls have finished.
+
+   The caller takes part in the work and only waits for helpers which
+   actually picked some up, so this is safe to call from a job already
+   running on the pool. `fn` must not throw.
+*/
+template <typename Fn>
+void parallelFor(ThreadPool& pool, std::size_t n, Fn fn)
+{
+    if (n == 0)
+        return;
+
+    struct State
+    {
+        std::atomic<std::size_t> next;
+        std::mutex mutex;
+        std::condition_variable idle;
+        std::size_t running;
+        bool closed;
+    };
+
+    std::shared_ptr<State> state(new State);
+    state->next = 0;
+    state->running = 0;
+    state->closed = false;
+
+    Fn* body = &fn;
+    std::size_t helpers = std::min(pool.size(), n - 1);
+    for (std::size_t h = 0; h < helpers; ++h) {
+        pool.submit([state, body, n] {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (state->closed)
+                        return;
+                    ++state->running;
+                }
+                for (std::size_t i; (i = state->next++) < n; )
+                    (*body)(i);
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    --state->running;
+                }
+                state->idle.notify_all();
+            });
+    }
+
+    for (std::size_t i; (i = state->next++) < n; )
+        fn(i);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->closed = true;
+    state->idle.wait(lock, [&state] { return state->running == 0; });
+}
+
+#endif
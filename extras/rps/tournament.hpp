@@ -0,0 +1,124 @@
+// Tournament drivers which run many matches on the native thread pool.
+
+#ifndef RPS_EXTRAS_TOURNAMENT_HPP
+#define RPS_EXTRAS_TOURNAMENT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "rps.hpp"
+#include "thread_pool.hpp"
+
+/* The outcome of one match between the players at indices `p1` and
+ * `p2` of a lineup. */
+struct MatchSummary
+{
+    MatchSummary() : p1(0), p2(0), p1_wins(0), p2_wins(0), ties(0) {}
+
+    std::size_t p1, p2;
+    std::size_t p1_wins, p2_wins, ties;
+};
+
+/* Tallies the scores of a match as returned by `play`. */
+inline MatchSummary summarize(std::size_t p1,
+                              std::size_t p2,
+                              const std::vector<int>& scores)
+{
+    MatchSummary s;
+    s.p1 = p1;
+    s.p2 = p2;
+    for (std::size_t r = 0; r < scores.size(); ++r) {
+        s.p1_wins += (scores[r] == -1);
+        s.p2_wins += (scores[r] == 1);
+    }
+    s.ties = scores.size() - s.p1_wins - s.p2_wins;
+    return s;
+}
+
+/* Plays a match and tallies it in the calling thread's MatchContext,
+   so that a worker playing many matches does not allocate for them.
+   If that context is busy further up this thread's stack (a Python
+   player running a tournament of its own) a fresh one is used.
+*/
+inline MatchSummary playSummary(const std::vector<const Player*>& players,
+                                std::size_t i,
+                                std::size_t j,
+                                std::size_t num_rounds,
+                                const std::atomic<bool>& stop)
+{
+    MatchContext& context = threadMatchContext();
+    if (!context.busy())
+        return summarize(i, j, play(*players[i], *players[j], num_rounds, stop, context));
+
+    MatchContext fresh;
+    return summarize(i, j, play(*players[i], *players[j], num_rounds, stop, fresh));
+}
+
+/* All pairings (i, j) with i < j of `num_players` players. */
+inline std::vector<std::pair<std::size_t, std::size_t> >
+roundRobinPairings(std::size_t num_players)
+{
+    std::vector<std::pair<std::size_t, std::size_t> > pairings;
+    if (num_players > 1)
+        pairings.reserve(num_players * (num_players - 1) / 2);
+    for (std::size_t i = 0; i < num_players; ++i)
+        for (std::size_t j = i + 1; j < num_players; ++j)
+            pairings.push_back(std::make_pair(i, j));
+    return pairings;
+}
+
+/* Plays the given pairings of `players` in parallel. The results are
+   in the same order as `pairings`.
+
+   Setting `stop` abandons the run with MatchCancelled. If a match
+   throws, `stop` is set so that the remaining matches finish early and
+   the first exception is rethrown.
+*/
+inline std::vector<MatchSummary>
+playPairings(const std::vector<const Player*>& players,
+             const std::vector<std::pair<std::size_t, std::size_t> >& pairings,
+             std::size_t num_rounds,
+             ThreadPool& pool,
+             std::atomic<bool>& stop)
+{
+    std::vector<MatchSummary> results(pairings.size());
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    parallelFor(pool, pairings.size(), [&](std::size_t m) {
+            if (stop.load(std::memory_order_relaxed))
+                return;
+            std::size_t i = pairings[m].first, j = pairings[m].second;
+            try {
+                results[m] = playSummary(players, i, j, num_rounds, stop);
+            } catch (const std::exception&) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                stop = true;
+            }
+        });
+
+    if (error)
+        std::rethrow_exception(error);
+    if (stop)
+        throw MatchCancelled();
+    return results;
+}
+
+/* Plays every player against every other player once. */
+inline std::vector<MatchSummary>
+roundRobin(const std::vector<const Player*>& players,
+           std::size_t num_rounds,
+           ThreadPool& pool,
+           std::atomic<bool>& stop)
+{
+    return playPairings(players, roundRobinPairings(players.size()),
+                        num_rounds, pool, stop);
+}
+
+#endif